@@ -11,11 +11,12 @@
 
 #include <string>
 #include "soa.hpp"
+#include "productcatalog.hpp"
 #include "marketdataservice.hpp"
 
 enum OrderType { FOK, IOC, MARKET, LIMIT, STOP };
 
-enum Market { BROKERTEC, ESPEED, CME };
+// enum Market is defined in the marketdataservice.hpp
 
 /**
  * An execution order that can be placed on an exchange.
@@ -29,7 +30,7 @@ public:
     
     // ctor for an order
     ExecutionOrder() = default;
-    ExecutionOrder(const T& _product, PricingSide _side, string _orderId, OrderType _orderType, double _price, long _visibleQuantity, long _hiddenQuantity, string _parentOrderId, bool _isChildOrder);
+    ExecutionOrder(const T& _product, PricingSide _side, string _orderId, OrderType _orderType, double _price, long _visibleQuantity, long _hiddenQuantity, string _parentOrderId, bool _isChildOrder, Market _market = BROKERTEC);
     
     // Get the product
     const T& GetProduct() const;
@@ -58,6 +59,9 @@ public:
     // Is child order?
     bool IsChildOrder() const;
     
+    // Get the venue the order is sent to
+    Market GetMarket() const { return market; }
+    
     // Change attributes to strings
     vector<string> ToStrings() const;
     
@@ -71,11 +75,12 @@ private:
     long hiddenQuantity;
     string parentOrderId;
     bool isChildOrder;
+    Market market = BROKERTEC;
     
 };
 
 template<typename T>
-ExecutionOrder<T>::ExecutionOrder(const T& _product, PricingSide _side, string _orderId, OrderType _orderType, double _price, long _visibleQuantity, long _hiddenQuantity, string _parentOrderId, bool _isChildOrder) :
+ExecutionOrder<T>::ExecutionOrder(const T& _product, PricingSide _side, string _orderId, OrderType _orderType, double _price, long _visibleQuantity, long _hiddenQuantity, string _parentOrderId, bool _isChildOrder, Market _market) :
 product(_product)
 {
     side = _side;
@@ -86,6 +91,7 @@ product(_product)
     hiddenQuantity = _hiddenQuantity;
     parentOrderId = _parentOrderId;
     isChildOrder = _isChildOrder;
+    market = _market;
 }
 
 template<typename T>
@@ -201,6 +207,7 @@ vector<string> ExecutionOrder<T>::ToStrings() const
     _strings.push_back(_hiddenQuantity);
     _strings.push_back(_parentOrderId);
     _strings.push_back(_isChildOrder);
+    _strings.push_back(GetMarketName(market));
     return _strings;
 }
 
@@ -216,20 +223,23 @@ public:
     
     // ctor for an order
     AlgoExecution() = default;
-    AlgoExecution(const T& _product, PricingSide _side, string _orderId, OrderType _orderType, double _price, long _visibleQuantity, long _hiddenQuantity, string _parentOrderId, bool _isChildOrder);
+    AlgoExecution(const T& _product, PricingSide _side, string _orderId, OrderType _orderType, double _price, long _visibleQuantity, long _hiddenQuantity, string _parentOrderId, bool _isChildOrder, Market _market = BROKERTEC);
     
     // Get the order
     ExecutionOrder<T>* GetExecutionOrder() const;
     
+    // Get the venue the order is routed to
+    Market GetMarket() const { return executionOrder->GetMarket(); }
+    
 private:
     ExecutionOrder<T>* executionOrder;
     
 };
 
 template<typename T>
-AlgoExecution<T>::AlgoExecution(const T& _product, PricingSide _side, string _orderId, OrderType _orderType, double _price, long _visibleQuantity, long _hiddenQuantity, string _parentOrderId, bool _isChildOrder)
+AlgoExecution<T>::AlgoExecution(const T& _product, PricingSide _side, string _orderId, OrderType _orderType, double _price, long _visibleQuantity, long _hiddenQuantity, string _parentOrderId, bool _isChildOrder, Market _market)
 {
-    executionOrder = new ExecutionOrder<T>(_product, _side, _orderId, _orderType, _price, _visibleQuantity, _hiddenQuantity, _parentOrderId, _isChildOrder);
+    executionOrder = new ExecutionOrder<T>(_product, _side, _orderId, _orderType, _price, _visibleQuantity, _hiddenQuantity, _parentOrderId, _isChildOrder, _market);
 }
 
 template<typename T>
@@ -238,6 +248,119 @@ ExecutionOrder<T>* AlgoExecution<T>::GetExecutionOrder() const
     return executionOrder;
 }
 
+/**
+ * One slice of a parent order routed to a venue.
+ */
+struct RouteSlice
+{
+    Market market;
+    double price;
+    long quantity;
+};
+
+/**
+ * Smart order router splitting parent orders across the venues quoting a product.
+ * It keeps the top of book of every venue, as cached by the venue order books, and fills
+ * a parent order from the best priced venues first, so it moves away from the best price as little as possible.
+ */
+class SmartOrderRouter
+{
+public:
+    // Store the top of book of a product on a venue
+    void Update(ProductIndex _index, Market _market, const BidOffer& _bidOffer);
+    
+    // Get the best bid and offer across the venues of a product, with the quantity of the first venue at that price
+    BidOffer GetBestBidOffer(ProductIndex _index);
+    
+    // Split an order of _quantity on _side, or of everything at the best price if _quantity is 0,
+    // write one slice per venue to _slices, which must hold MARKET_COUNT, and return the number of slices
+    size_t Route(ProductIndex _index, PricingSide _side, long _quantity, RouteSlice* _slices);
+    
+private:
+    // top of book of every venue of a product, venues that never quoted have a zero quantity
+    struct VenueQuotes
+    {
+        BidOffer quotes[MARKET_COUNT];
+        VenueQuotes()
+        {
+            for (int m = 0; m < MARKET_COUNT; ++m) quotes[m] = BidOffer(Order(INT_MIN, 0, BID), Order(INT_MAX, 0, OFFER));
+        }
+    };
+    ProductStore<VenueQuotes> venueQuotes;
+    
+    // Get the quote of a venue on one side
+    static const Order& GetQuote(const VenueQuotes& _quotes, int _market, PricingSide _side);
+    
+    // Whether _a is a better price than _b on _side
+    static bool IsBetter(double _a, double _b, PricingSide _side) { return _side == BID ? _a > _b : _a < _b; }
+};
+
+void SmartOrderRouter::Update(ProductIndex _index, Market _market, const BidOffer& _bidOffer)
+{
+    venueQuotes[_index].quotes[_market] = _bidOffer;
+}
+
+const Order& SmartOrderRouter::GetQuote(const VenueQuotes& _quotes, int _market, PricingSide _side)
+{
+    return _side == BID ? _quotes.quotes[_market].GetBidOrder() : _quotes.quotes[_market].GetOfferOrder();
+}
+
+BidOffer SmartOrderRouter::GetBestBidOffer(ProductIndex _index)
+{
+    const VenueQuotes& _quotes = venueQuotes[_index];
+    Order _best[2] = { Order(INT_MIN, 0, BID), Order(INT_MAX, 0, OFFER) };
+    for (int s = 0; s < 2; ++s)
+    {
+        PricingSide _side = (PricingSide)s;
+        for (int m = 0; m < MARKET_COUNT; ++m)
+        {
+            const Order& _quote = GetQuote(_quotes, m, _side);
+            if (_quote.GetQuantity() > 0 && IsBetter(_quote.GetPrice(), _best[s].GetPrice(), _side)) _best[s] = _quote;
+        }
+    }
+    return BidOffer(_best[BID], _best[OFFER]);
+}
+
+size_t SmartOrderRouter::Route(ProductIndex _index, PricingSide _side, long _quantity, RouteSlice* _slices)
+{
+    const VenueQuotes& _quotes = venueQuotes[_index];
+    
+    // venues with a quote, best price first and in venue order at the same price
+    int _venues[MARKET_COUNT];
+    size_t _count = 0;
+    for (int m = 0; m < MARKET_COUNT; ++m)
+    {
+        const Order& _quote = GetQuote(_quotes, m, _side);
+        if (_quote.GetQuantity() <= 0) continue;
+        size_t i = _count++;
+        for (; i > 0 && IsBetter(_quote.GetPrice(), GetQuote(_quotes, _venues[i - 1], _side).GetPrice(), _side); --i)
+            _venues[i] = _venues[i - 1];
+        _venues[i] = m;
+    }
+    if (_count == 0) return 0;
+    
+    long _left = _quantity;
+    if (_left <= 0)
+    {
+        double _bestPrice = GetQuote(_quotes, _venues[0], _side).GetPrice();
+        for (size_t i = 0; i < _count; ++i)
+        {
+            const Order& _quote = GetQuote(_quotes, _venues[i], _side);
+            if (_quote.GetPrice() == _bestPrice) _left += _quote.GetQuantity();
+        }
+    }
+    
+    size_t _sliceCount = 0;
+    for (size_t i = 0; i < _count && _left > 0; ++i)
+    {
+        const Order& _quote = GetQuote(_quotes, _venues[i], _side);
+        long _taken = min(_left, _quote.GetQuantity());
+        _slices[_sliceCount++] = RouteSlice{(Market)_venues[i], _quote.GetPrice(), _taken};
+        _left -= _taken;
+    }
+    return _sliceCount;
+}
+
 // will define later
 template<typename T>
 class AlgoExecutionToMarketDataListener;
@@ -247,71 +370,79 @@ template<typename T>
 class AlgoExecutionService : public Service<string, AlgoExecution<T> >
 {
 private:
-    map<string, AlgoExecution<T> > algoExecutions;
+    ProductStore<AlgoExecution<T> > algoExecutions;
     vector<ServiceListener<AlgoExecution<T> >*> listeners;
     AlgoExecutionToMarketDataListener<T>* listener;
+    SmartOrderRouter router;
     double spread;
     long count;
+    ProductStore<long> counts; // orders per product, when the side alternates per product
+    bool perProduct;
+    long orderSize;
 public:
     AlgoExecutionService();
     ~AlgoExecutionService() {} // set empty
     AlgoExecution<T>& GetData(string _key) { return algoExecutions[_key]; }
-    void OnMessage(AlgoExecution<T>& _data) { algoExecutions[_data.GetExecutionOrder()->GetProduct().GetProductId()] = _data;}
+    AlgoExecution<T>& GetData(ProductIndex _index) { return algoExecutions[_index]; }
+    void OnMessage(AlgoExecution<T>& _data) { algoExecutions[_data.GetExecutionOrder()->GetProduct().GetProductIndex()] = _data;}
     void AddListener(ServiceListener<AlgoExecution<T> >* _listener) { listeners.push_back(_listener); }
     const vector<ServiceListener<AlgoExecution<T> >*>& GetListeners() const { return listeners; }
     AlgoExecutionToMarketDataListener<T>* GetListener() { return listener; }
-    void AlgoExecuteOrder(OrderBook<T>& _orderBook);
+    void AlgoExecuteOrder(OrderBook<T>& _orderBook) { AlgoExecuteOrder(_orderBook, ListenerFanout<AlgoExecution<T> >(listeners)); }
+    template<typename Sink>
+    void AlgoExecuteOrder(OrderBook<T>& _orderBook, Sink&& _sink);
+    // Set the size of the parent orders, 0 (the default) takes everything quoted at the best price
+    void SetOrderSize(long _orderSize) { orderSize = _orderSize; }
+    // Alternate the side per product instead of across all products, so that the products can run in parallel
+    void SetPerProduct(bool _perProduct) { perProduct = _perProduct; }
 };
 
 template<typename T>
 AlgoExecutionService<T>::AlgoExecutionService()
 {
-    algoExecutions = map<string, AlgoExecution<T> >();
+    algoExecutions = ProductStore<AlgoExecution<T> >();
     listeners = vector<ServiceListener<AlgoExecution<T> >*>();
     listener = new AlgoExecutionToMarketDataListener<T>(this);
     spread = 1.0 / 128.0;
     count = 0;
+    counts = ProductStore<long>();
+    perProduct = false;
+    orderSize = 0;
 }
 
 template<typename T>
-void AlgoExecutionService<T>::AlgoExecuteOrder(OrderBook<T>& _orderBook)
+template<typename Sink>
+void AlgoExecutionService<T>::AlgoExecuteOrder(OrderBook<T>& _orderBook, Sink&& _sink)
 {
-    T _product = _orderBook.GetProduct();
-    string _productId = _product.GetProductId();
-    PricingSide _side;
-    string _orderId = GenerateId();
-    double _price;
-    long _quantity;
-    
-    BidOffer _bidOffer = _orderBook.GetBidOffer();
-    Order _bidOrder = _bidOffer.GetBidOrder();
-    double _bidPrice = _bidOrder.GetPrice();
-    long _bidQuantity = _bidOrder.GetQuantity();
-    Order _offerOrder = _bidOffer.GetOfferOrder();
-    double _offerPrice = _offerOrder.GetPrice();
-    long _offerQuantity = _offerOrder.GetQuantity();
+    const T& _product = _orderBook.GetProduct();
+    ProductIndex _index = _product.GetProductIndex();
+    
+    // the book is of one venue, the decision is taken on the best prices across venues
+    router.Update(_index, _orderBook.GetMarket(), _orderBook.GetBidOffer());
+    BidOffer _bidOffer = router.GetBestBidOffer(_index);
+    double _bidPrice = _bidOffer.GetBidOrder().GetPrice();
+    double _offerPrice = _bidOffer.GetOfferOrder().GetPrice();
     
     if (_offerPrice - _bidPrice <= spread)
     {
-        switch (count % 2)
+        long& _count = perProduct ? counts[_index] : count;
+        PricingSide _side = _count % 2 == 0 ? BID : OFFER;
+        _count++;
+        
+        RouteSlice _slices[MARKET_COUNT];
+        size_t _sliceCount = router.Route(_index, _side, orderSize, _slices);
+        string _orderId = GenerateId();
+        // an order filled on one venue is sent as is, otherwise every venue gets a child of it
+        for (size_t i = 0; i < _sliceCount; ++i)
         {
-            case 0:
-                _price = _bidPrice;
-                _quantity = _bidQuantity;
-                _side = BID;
-                break;
-            case 1:
-                _price = _offerPrice;
-                _quantity = _offerQuantity;
-                _side = OFFER;
-                break;
+            bool _isChildOrder = _sliceCount > 1;
+            string _childOrderId = _isChildOrder ? GenerateId() : _orderId;
+            string _parentOrderId = _isChildOrder ? _orderId : "";
+            AlgoExecution<T> _algoExecution(_product, _side, _childOrderId, MARKET, _slices[i].price, _slices[i].quantity, 0, _parentOrderId, _isChildOrder, _slices[i].market);
+            algoExecutions[_index] = _algoExecution;
+            
+            _sink(_algoExecution);
         }
-        count++;
-        AlgoExecution<T> _algoExecution(_product, _side, _orderId, MARKET, _price, _quantity, 0, "", false);
-        algoExecutions[_productId] = _algoExecution;
-        
-        for (auto l = listeners.begin(); l != listeners.end(); ++l)
-            (*l)->ProcessAdd(_algoExecution);
     }
 }
 
@@ -324,8 +455,10 @@ public:
     AlgoExecutionToMarketDataListener(AlgoExecutionService<T>* _service) { service = _service; }
     ~AlgoExecutionToMarketDataListener() {} // set empty
     void ProcessAdd(OrderBook<T>& _data) { service->AlgoExecuteOrder(_data); }
+    template<typename Sink>
+    void ProcessAdd(OrderBook<T>& _data, Sink&& _sink) { service->AlgoExecuteOrder(_data, _sink); }
     void ProcessRemove(OrderBook<T>& _data) {} // set empty
-    void ProcessUpdate(OrderBook<T>& _data) {} // set empty
+    void ProcessUpdate(OrderBook<T>& _data) { service->AlgoExecuteOrder(_data); }
 };
 
 #endif /* algoexecutionservice_hpp */
@@ -11,6 +11,7 @@
 
 #include <string>
 #include "soa.hpp"
+#include "productcatalog.hpp"
 #include "pricingservice.hpp"
 
 enum PricingSide { BID, OFFER };
@@ -128,58 +129,67 @@ template<typename T>
 class AlgoStreamingService : public Service<string, AlgoStream<T> >
 {
 private:
-    map<string, AlgoStream<T> > algoStreams;
+    ProductStore<AlgoStream<T> > algoStreams;
     vector<ServiceListener<AlgoStream<T> >*> listeners;
-    ServiceListener<Price<T> >* listener;
+    AlgoStreamingToPricingListener<T>* listener;
     long count;
+    ProductStore<long> counts; // streams per product, when the visible size alternates per product
+    bool perProduct;
 public:
     AlgoStreamingService();
     ~AlgoStreamingService() {} // set empty
     AlgoStream<T>& GetData(string _key) { return algoStreams[_key]; }
+    AlgoStream<T>& GetData(ProductIndex _index) { return algoStreams[_index]; }
     void OnMessage(AlgoStream<T>& _data);
     void AddListener(ServiceListener<AlgoStream<T> >* _listener) { listeners.push_back(_listener); }
     const vector<ServiceListener<AlgoStream<T> >*>& GetListeners() const { return listeners; }
-    ServiceListener<Price<T> >* GetListener() { return listener; }
-    void AlgoPublishPrice(Price<T>& _price);
+    AlgoStreamingToPricingListener<T>* GetListener() { return listener; }
+    void AlgoPublishPrice(Price<T>& _price) { AlgoPublishPrice(_price, ListenerFanout<AlgoStream<T> >(listeners)); }
+    template<typename Sink>
+    void AlgoPublishPrice(Price<T>& _price, Sink&& _sink);
+    // Alternate the visible size per product instead of across all products, so that the products can run in parallel
+    void SetPerProduct(bool _perProduct) { perProduct = _perProduct; }
 };
 
 template<typename T>
 AlgoStreamingService<T>::AlgoStreamingService()
 {
-    algoStreams = map<string, AlgoStream<T> >();
+    algoStreams = ProductStore<AlgoStream<T> >();
     listeners = vector<ServiceListener<AlgoStream<T> >*>();
     listener = new AlgoStreamingToPricingListener<T>(this);
     count = 0;
+    counts = ProductStore<long>();
+    perProduct = false;
 }
 
 
 template<typename T>
 void AlgoStreamingService<T>::OnMessage(AlgoStream<T>& _data)
 {
-    algoStreams[_data.GetPriceStream()->GetProduct().GetProductId()] = _data;
+    algoStreams[_data.GetPriceStream()->GetProduct().GetProductIndex()] = _data;
 }
 
 template<typename T>
-void AlgoStreamingService<T>::AlgoPublishPrice(Price<T>& _price)
+template<typename Sink>
+void AlgoStreamingService<T>::AlgoPublishPrice(Price<T>& _price, Sink&& _sink)
 {
-    T _product = _price.GetProduct();
-    string _productId = _product.GetProductId();
+    const T& _product = _price.GetProduct();
     
     double _mid = _price.GetMid();
     double _bidOfferSpread = _price.GetBidOfferSpread();
     double _bidPrice = _mid - _bidOfferSpread / 2.0;
     double _offerPrice = _mid + _bidOfferSpread / 2.0;
-    long _visibleQuantity = (count % 2 + 1) * 10000000;
+    long& _count = perProduct ? counts[_product.GetProductIndex()] : count;
+    long _visibleQuantity = (_count % 2 + 1) * 10000000;
     long _hiddenQuantity = _visibleQuantity * 2;
     
-    count++;
+    _count++;
     PriceStreamOrder _bidOrder(_bidPrice, _visibleQuantity, _hiddenQuantity, BID);
     PriceStreamOrder _offerOrder(_offerPrice, _visibleQuantity, _hiddenQuantity, OFFER);
     AlgoStream<T> _algoStream(_product, _bidOrder, _offerOrder);
-    algoStreams[_productId] = _algoStream;
+    algoStreams[_product.GetProductIndex()] = _algoStream;
     
-    for (auto l = listeners.begin(); l != listeners.end(); ++l)
-        (*l)->ProcessAdd(_algoStream);
+    _sink(_algoStream);
 }
 
 
@@ -192,6 +202,8 @@ public:
     AlgoStreamingToPricingListener(AlgoStreamingService<T>* _service) { service = _service; }
     ~AlgoStreamingToPricingListener() {} // set empty
     void ProcessAdd(Price<T>& _data) { service->AlgoPublishPrice(_data); }
+    template<typename Sink>
+    void ProcessAdd(Price<T>& _data, Sink&& _sink) { service->AlgoPublishPrice(_data, _sink); }
     void ProcessRemove(Price<T>& _data) {} // set empty
     void ProcessUpdate(Price<T>& _data) {} // set empty
 };
@@ -0,0 +1,106 @@
+//
+//  analyticsbenchmark.cpp
+//  tradingsystem
+//
+//  Measures the bond analytics on 6 to 5000 bonds when one tick moves the mid of one bond beyond the tolerance:
+//  the read of its PV01, which solves that bond only, against a Refresh of the catalog before the read, and the
+//  solve of the whole catalog when the analytics are built. The bonds past those of products.txt are made up as
+//  in scenariobenchmark. The PV01s read after the ticks are checked against analytics built at the same mids.
+//
+//  usage: analyticsbenchmark [ticks]
+//
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+
+using namespace std;
+#include <stdio.h>
+#include "products.hpp"
+#include "tools.hpp"
+#include "soa.hpp"
+#include "productcatalog.hpp"
+#include "bondanalytics.hpp"
+
+// keeps the PV01s read from being optimized away
+volatile double pv01Sink;
+
+// add made up bonds to the catalog until it holds _count
+void AddBonds(size_t _count)
+{
+    ProductCatalog& _catalog = GetProductCatalog();
+    const int _tenors[] = { 2, 3, 5, 7, 10, 30 };
+    const float _coupons[] = { 0.0175f, 0.01875f, 0.02f, 0.02125f, 0.0225f, 0.0275f };
+    while (_catalog.Size() < _count)
+    {
+        size_t i = _catalog.Size();
+        int _tenor = _tenors[i % 6];
+        char _cusip[32];
+        snprintf(_cusip, sizeof(_cusip), "SYN%06zu", i);
+        date _maturity = VALUATION_DATE + months(12 * (_tenor - 1) + (int)(i / 6) % (12 * _tenor) + 1);
+        _catalog.Add(Bond(_cusip, CUSIP, "US" + to_string(_tenor) + "Y", _coupons[i % 6], _maturity), 0.);
+    }
+}
+
+int main(int argc, const char * argv[])
+{
+    long _tickCount = argc > 1 ? stol(argv[1]) : 20000;
+    if (_tickCount <= 0 || !GetProductCatalog().Load("products.txt"))
+    {
+        cerr << "usage: " << argv[0] << " [ticks], products.txt must be readable" << endl;
+        return 1;
+    }
+
+    bool _ok = true;
+    const size_t _sizes[] = { 6, 50, 500, 5000 };
+    for (size_t _size : _sizes)
+    {
+        // the analytics take the bonds of the catalog when they are built
+        AddBonds(_size);
+        long long _start = MonotonicClock::Now();
+        unique_ptr<BondAnalytics> _analytics(new BondAnalytics());
+        long long _buildNanos = MonotonicClock::Now() - _start;
+        unique_ptr<BondAnalytics> _refreshed(new BondAnalytics());
+
+        // every tick moves the mid of a random bond by a multiple of twice the tolerance
+        vector<double> _uniform = GenerateUniform(_tickCount * 2, 12345);
+        vector<double> _mids(_size, 100.);
+        long long _readNanos = 0, _refreshNanos = 0;
+        double _sum = 0.;
+        for (long t = 0; t < _tickCount; ++t)
+        {
+            ProductIndex _index = (ProductIndex)(_uniform[2 * t] * _size);
+            _mids[_index] = 98. + (int)(_uniform[2 * t + 1] * 64) * 2. * MID_TOLERANCE;
+
+            _analytics->SetMid(_index, _mids[_index]);
+            _start = MonotonicClock::Now();
+            _sum += _analytics->GetPV01(_index);
+            _readNanos += MonotonicClock::Now() - _start;
+
+            _refreshed->SetMid(_index, _mids[_index]);
+            _start = MonotonicClock::Now();
+            _refreshed->Refresh();
+            _sum -= _refreshed->GetPV01(_index);
+            _refreshNanos += MonotonicClock::Now() - _start;
+        }
+        pv01Sink = _sum;
+
+        // every bond read once more, against analytics solved at the same mids from par
+        BondAnalytics _expected;
+        for (size_t i = 0; i < _size; ++i) _expected.SetMid((ProductIndex)i, _mids[i]);
+        double _maxError = 0.;
+        for (size_t i = 0; i < _size; ++i)
+        {
+            double _pv01 = _expected.GetPV01((ProductIndex)i);
+            _maxError = max(_maxError, fabs(_analytics->GetPV01((ProductIndex)i) - _pv01) / _pv01);
+        }
+        _ok = _ok && _maxError < 1e-9;
+
+        cout << _size << " bonds: " << (double)_readNanos / _tickCount << "ns a tick solving the bond read against "
+             << (double)_refreshNanos / _tickCount << "ns refreshing the catalog, " << _buildNanos / 1e3
+             << "us solving the whole catalog, " << _analytics->GetSolveCount() << " passes, max relative error "
+             << _maxError << endl;
+    }
+    return _ok ? 0 : 1;
+}
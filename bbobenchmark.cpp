@@ -0,0 +1,113 @@
+//
+//  bbobenchmark.cpp
+//  tradingsystem
+//
+//  Measures the best bid/offer kept by the OrderBook against a scan of both stacks on every read,
+//  the way GetBidOffer used to find it, on books 5, 50 and 500 levels deep. Random modifications,
+//  cancels and adds hit every level, and the cached best bid/offer is checked against the scan after each.
+//
+//  usage: bbobenchmark [updates] [reads per update]
+//
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <climits>
+
+using namespace std;
+#include <stdio.h>
+#include "products.hpp"
+#include "tools.hpp"
+#include "soa.hpp"
+#include "productcatalog.hpp"
+#include "pricingservice.hpp"
+#include "algostreamingservice.hpp"
+#include "marketdataservice.hpp"
+
+// keeps the prices read from being optimized away
+volatile double readSink;
+
+// the best bid/offer found by scanning both stacks
+BidOffer ScanBidOffer(const OrderBook<Bond>& _orderBook)
+{
+    Order _bidOrder(INT_MIN, 0, BID);
+    for (auto b = _orderBook.GetBidStack().begin(); b != _orderBook.GetBidStack().end(); ++b)
+        if (b->GetPrice() > _bidOrder.GetPrice()) _bidOrder = *b;
+    Order _offerOrder(INT_MAX, 0, OFFER);
+    for (auto o = _orderBook.GetOfferStack().begin(); o != _orderBook.GetOfferStack().end(); ++o)
+        if (o->GetPrice() < _offerOrder.GetPrice()) _offerOrder = *o;
+    return BidOffer(_bidOrder, _offerOrder);
+}
+
+bool SameOrder(const Order& _a, const Order& _b)
+{
+    return _a.GetPrice() == _b.GetPrice() && _a.GetQuantity() == _b.GetQuantity();
+}
+
+int main(int argc, const char * argv[])
+{
+    long _updateCount = argc > 1 ? stol(argv[1]) : 200000;
+    int _reads = argc > 2 ? atoi(argv[2]) : 4;
+    if (_updateCount <= 0 || _reads <= 0 || !GetProductCatalog().Load("products.txt"))
+    {
+        cerr << "usage: " << argv[0] << " [updates] [reads per update], products.txt must be readable" << endl;
+        return 1;
+    }
+    const Bond& _bond = GetProductCatalog().GetBond((ProductIndex)0);
+    vector<double> _uniform = GenerateUniform(_updateCount * 3, 12345);
+
+    bool _ok = true;
+    const int _depths[] = { 5, 50, 500 };
+    for (int _depth : _depths)
+    {
+        // the levels of a side are a tick apart, away from a mid of 100
+        vector<Order> _bidStack, _offerStack;
+        for (int k = 0; k < _depth; ++k)
+        {
+            _bidStack.push_back(Order(100. - (k + 1) / 256., 1000000L * (k + 1), BID));
+            _offerStack.push_back(Order(100. + (k + 1) / 256., 1000000L * (k + 1), OFFER));
+        }
+        OrderBook<Bond> _cached(_bond, _bidStack, _offerStack);
+        OrderBook<Bond> _scanned(_bond, _bidStack, _offerStack);
+
+        // the same updates on both books: modify, cancel or add a random level, then read the best bid/offer
+        long long _cachedNanos = 0, _scannedNanos = 0;
+        long _mismatches = 0;
+        double _sum = 0.;
+        for (long u = 0; u < _updateCount; ++u)
+        {
+            PricingSide _side = _uniform[3 * u] < 0.5 ? BID : OFFER;
+            int _level = (int)(_uniform[3 * u + 1] * _depth);
+            double _price = _side == BID ? 100. - (_level + 1) / 256. : 100. + (_level + 1) / 256.;
+            long _quantity = 1000000L * (1 + (long)(_uniform[3 * u + 2] * 10));
+            int _action = (int)(_uniform[3 * u + 2] * 1000) % 5;
+
+            long long _start = MonotonicClock::Now();
+            if (_action < 3) _cached.ModifyLevel(_price, _quantity, _side);
+            else if (_action == 3) _cached.CancelLevel(_price, _side);
+            else _cached.AddLevel(_price, _quantity, _side);
+            for (int r = 0; r < _reads; ++r) _sum += _cached.GetBidOffer().GetBidOrder().GetPrice();
+            _cachedNanos += MonotonicClock::Now() - _start;
+
+            _start = MonotonicClock::Now();
+            if (_action < 3) _scanned.ModifyLevel(_price, _quantity, _side);
+            else if (_action == 3) _scanned.CancelLevel(_price, _side);
+            else _scanned.AddLevel(_price, _quantity, _side);
+            for (int r = 0; r < _reads; ++r) _sum -= ScanBidOffer(_scanned).GetBidOrder().GetPrice();
+            _scannedNanos += MonotonicClock::Now() - _start;
+
+            BidOffer _expected = ScanBidOffer(_cached);
+            BidOffer _bidOffer = _cached.GetBidOffer();
+            if (!SameOrder(_bidOffer.GetBidOrder(), _expected.GetBidOrder()) || !SameOrder(_bidOffer.GetOfferOrder(), _expected.GetOfferOrder()))
+                ++_mismatches;
+        }
+        readSink = _sum;
+        _ok = _ok && _mismatches == 0;
+
+        cout << _depth << " levels: " << (double)_cachedNanos / _updateCount << "ns per update and " << _reads
+             << " cached reads against " << (double)_scannedNanos / _updateCount << "ns scanning, "
+             << _cached.GetBidStack().size() + _cached.GetOfferStack().size() << " levels left, "
+             << _mismatches << " mismatches" << endl;
+    }
+    return _ok ? 0 : 1;
+}
@@ -0,0 +1,316 @@
+/**
+ * bondanalytics.hpp
+ * Defines the analytics of the bonds of the catalog: yield, duration, convexity and PV01 from the coupon schedule.
+ * A bond pays its coupon semiannually up to its maturity, so its dirty price has a closed form in the yield
+ * and the Newton solve of the yields runs over a dense list of the bonds whose mid moved.
+ */
+#ifndef BOND_ANALYTICS_HPP
+#define BOND_ANALYTICS_HPP
+
+#include <cmath>
+#include <cstdlib>
+#include <memory>
+#include <atomic>
+#include <vector>
+#include "products.hpp"
+#include "soa.hpp"
+#include "productcatalog.hpp"
+#include "pricingservice.hpp"
+
+using namespace std;
+
+// date the analytics are computed for
+const date VALUATION_DATE = from_string("2018/12/24");
+
+// move of the mid, in price points, below which the analytics are not recomputed
+const double MID_TOLERANCE = 1. / 128.;
+
+// the sectors of the curve the risk is bucketed into
+enum RiskBucket { FRONT_END, BELLY, LONG_END };
+const size_t RISK_BUCKET_COUNT = 3;
+
+// Get the sector of a bond from the tenor of its ticker: up to 3 years front end, up to 10 years belly, long end beyond
+RiskBucket GetRiskBucket(const Bond& _bond)
+{
+    const string& _ticker = _bond.GetTicker();
+    size_t _digit = _ticker.find_first_of("0123456789");
+    int _tenor = _digit == string::npos ? 0 : atoi(_ticker.c_str() + _digit);
+    if (_tenor <= 3) return FRONT_END;
+    if (_tenor <= 10) return BELLY;
+    return LONG_END;
+}
+
+// Get the name of a bucket
+string GetRiskBucketName(RiskBucket _bucket)
+{
+    switch (_bucket)
+    {
+        case FRONT_END:
+            return "FrontEnd";
+        case BELLY:
+            return "Belly";
+        case LONG_END:
+            return "LongEnd";
+    }
+    return "";
+}
+
+/**
+ * Analytics of a bond at a clean price.
+ * The prices and PV01 are per 100 face, the PV01 is the move of the dirty price for one basis point of yield.
+ */
+struct BondMetrics
+{
+    double price; // clean price
+    double dirtyPrice;
+    double yield; // semiannual compounding
+    double duration; // modified duration
+    double convexity;
+    double pv01;
+};
+
+/**
+ * Analytics of every bond of the catalog.
+ * Mids can be set from any thread, one writer per product. The metrics are read, and refreshed, by one thread
+ * at a time: a read refreshes the bond read if its mid moved by more than the tolerance, Refresh every such bond
+ * in one Newton pass. Before a bond has a mid it is priced at par.
+ */
+class BondAnalytics
+{
+public:
+    // ctor for the analytics of the bonds of the catalog
+    BondAnalytics(date _valuationDate = VALUATION_DATE, double _tolerance = MID_TOLERANCE);
+    BondAnalytics(const BondAnalytics&) = delete;
+    BondAnalytics& operator=(const BondAnalytics&) = delete;
+
+    // Set the mid of a bond, the analytics are recomputed on the next read if it moved beyond the tolerance
+    void SetMid(ProductIndex _index, double _mid) { if (_index < size) mids[_index].store(_mid, memory_order_relaxed); }
+
+    // Get the analytics of a bond at its latest mid
+    BondMetrics GetMetrics(ProductIndex _index);
+
+    // Get the PV01 of a bond at its latest mid, the PV01 of the catalog for a bond it does not know
+    double GetPV01(ProductIndex _index);
+
+    // Refresh every bond whose mid moved beyond the tolerance, before reading the metrics of many
+    void Refresh();
+
+    // Get the schedule of a bond: coupon per period, fraction of a period up to the next coupon and number of coupons left
+    double GetCoupon(ProductIndex _index) const { return coupons[_index]; }
+    double GetFraction(ProductIndex _index) const { return fractions[_index]; }
+    double GetPeriods(ProductIndex _index) const { return periods[_index]; }
+
+    // Get the dirty price of a bond at a yield
+    double GetDirtyPrice(ProductIndex _index, double _yield) const { return DirtyPrice(_yield, coupons[_index], fractions[_index], periods[_index]); }
+
+    // Get the number of Newton passes run so far
+    long GetSolveCount() const { return solveCount; }
+
+    // Get the number of bonds
+    size_t Size() const { return size; }
+
+private:
+    size_t size;
+    double tolerance;
+    unique_ptr<atomic<double>[]> mids; // latest mids, NAN until the first price
+
+    // schedule, one entry per bond
+    vector<double> coupons; // coupon paid every period, per 100 face
+    vector<double> fractions; // fraction of a period up to the next coupon
+    vector<double> periods; // number of coupons left
+    vector<double> accrued;
+
+    // metrics at the mid they were solved for
+    vector<double> solvedMids;
+    vector<double> yields;
+    vector<double> dirtyPrices;
+    vector<double> durations;
+    vector<double> convexities;
+    vector<double> pv01s;
+    vector<double> targets; // dirty prices to solve for
+    vector<size_t> work; // the bonds to solve in the next pass
+    long solveCount;
+
+    // Queue a bond for the next pass if its mid moved beyond the tolerance
+    void Stale(size_t _index);
+
+    // Solve the yields of the bonds of the work list and compute their metrics
+    void Solve();
+
+    // Dirty price at a yield of _periods coupons of _coupon, the first one _fraction of a period away, and the principal with the last one
+    static double DirtyPrice(double _yield, double _coupon, double _fraction, double _periods);
+
+    // Same, with the sum of the times of the flows, in periods, weighted by their present values
+    static double DirtyPrice(double _yield, double _coupon, double _fraction, double _periods, double& _weightedTime);
+};
+
+BondAnalytics::BondAnalytics(date _valuationDate, double _tolerance)
+{
+    const ProductCatalog& _catalog = GetProductCatalog();
+    size = _catalog.Size();
+    tolerance = _tolerance;
+    mids.reset(new atomic<double>[size]);
+    coupons = fractions = periods = accrued = vector<double>(size, 0.);
+    solvedMids = yields = dirtyPrices = durations = convexities = pv01s = targets = vector<double>(size, 0.);
+    solveCount = 0;
+
+    for (size_t i = 0; i < size; ++i)
+    {
+        const Bond& _bond = _catalog.GetBond((ProductIndex)i);
+        mids[i].store(NAN, memory_order_relaxed);
+
+        // coupon dates step back from the maturity by six months, to the last one before the valuation date
+        const date& _maturity = _bond.GetMaturityDate();
+        int _left = 1;
+        date _next = _maturity;
+        while (_maturity - months(6 * _left) > _valuationDate) _next = _maturity - months(6 * _left++);
+        date _previous = _maturity - months(6 * _left);
+
+        coupons[i] = 100. * _bond.GetCoupon() / 2.;
+        fractions[i] = (double)(_next - _valuationDate).days() / (double)(_next - _previous).days();
+        periods[i] = _left;
+        accrued[i] = coupons[i] * (1. - fractions[i]);
+
+        // at par until the first price
+        targets[i] = 100. + accrued[i];
+        yields[i] = _bond.GetCoupon();
+        work.push_back(i);
+    }
+    Solve();
+}
+
+inline double BondAnalytics::DirtyPrice(double _yield, double _coupon, double _fraction, double _periods)
+{
+    double _weightedTime;
+    return DirtyPrice(_yield, _coupon, _fraction, _periods, _weightedTime);
+}
+
+inline double BondAnalytics::DirtyPrice(double _yield, double _coupon, double _fraction, double _periods, double& _weightedTime)
+{
+    // discount factor of a period, the flows are at _fraction + k periods for k < _periods
+    double _v = 1. / (1. + _yield / 2.);
+    double _vn = pow(_v, _periods);
+    double _vw = pow(_v, _fraction);
+    double _vLast = _vn / _v;
+    double _rv = 1. - _v;
+    // sums of v^k and k v^k over the coupons, as many coupons as periods when the yield is zero
+    double _annuity = fabs(_rv) > 1e-12 ? (1. - _vn) / _rv : _periods;
+    double _timeAnnuity = fabs(_rv) > 1e-12 ? _v * (1. - _periods * _vLast + (_periods - 1.) * _vn) / (_rv * _rv) : _periods * (_periods - 1.) / 2.;
+
+    double _price = _vw * (_coupon * _annuity + 100. * _vLast);
+    _weightedTime = _vw * (_coupon * (_fraction * _annuity + _timeAnnuity) + 100. * _vLast * (_fraction + _periods - 1.));
+    return _price;
+}
+
+void BondAnalytics::Solve()
+{
+    ++solveCount;
+    const double _bp = 0.0001;
+    double* _yields = yields.data();
+    const double* _targets = targets.data();
+    const double* _coupons = coupons.data();
+    const double* _fractions = fractions.data();
+    const double* _periods = periods.data();
+
+    // Newton from the previous yields over the bonds still moving, a converged bond leaves the list
+    size_t _active = work.size();
+    for (int _iteration = 0; _iteration < 32 && _active > 0; ++_iteration)
+    {
+        size_t _left = 0;
+        for (size_t w = 0; w < _active; ++w)
+        {
+            size_t i = work[w];
+            double _weightedTime;
+            double _price = DirtyPrice(_yields[i], _coupons[i], _fractions[i], _periods[i], _weightedTime);
+            // dP/dy = -v/2 * sum of t CF v^t
+            double _slope = -_weightedTime / (2. + _yields[i]);
+            double _step = (_price - _targets[i]) / _slope;
+            _yields[i] -= _step;
+            // the converged bonds are swapped past the ones still moving
+            if (fabs(_step) >= 1e-12) swap(work[_left++], work[w]);
+        }
+        _active = _left;
+    }
+
+    for (auto w = work.begin(); w != work.end(); ++w)
+    {
+        size_t i = *w;
+        double _weightedTime;
+        double _price = DirtyPrice(_yields[i], _coupons[i], _fractions[i], _periods[i], _weightedTime);
+        double _slope = -_weightedTime / (2. + _yields[i]);
+        double _up = DirtyPrice(_yields[i] + _bp, _coupons[i], _fractions[i], _periods[i]);
+        double _down = DirtyPrice(_yields[i] - _bp, _coupons[i], _fractions[i], _periods[i]);
+        solvedMids[i] = _targets[i] - accrued[i];
+        dirtyPrices[i] = _price;
+        durations[i] = -_slope / _price;
+        convexities[i] = (_up + _down - 2. * _price) / (_price * _bp * _bp);
+        pv01s[i] = -_slope * _bp;
+    }
+    work.clear();
+}
+
+inline void BondAnalytics::Stale(size_t _index)
+{
+    double _mid = mids[_index].load(memory_order_relaxed);
+    if (std::isnan(_mid) || fabs(_mid - solvedMids[_index]) <= tolerance) return;
+    targets[_index] = _mid + accrued[_index];
+    work.push_back(_index);
+}
+
+void BondAnalytics::Refresh()
+{
+    for (size_t i = 0; i < size; ++i) Stale(i);
+    if (!work.empty()) Solve();
+}
+
+BondMetrics BondAnalytics::GetMetrics(ProductIndex _index)
+{
+    // only the bond read is solved
+    Stale(_index);
+    if (!work.empty()) Solve();
+    BondMetrics _metrics;
+    _metrics.price = solvedMids[_index];
+    _metrics.dirtyPrice = dirtyPrices[_index];
+    _metrics.yield = yields[_index];
+    _metrics.duration = durations[_index];
+    _metrics.convexity = convexities[_index];
+    _metrics.pv01 = pv01s[_index];
+    return _metrics;
+}
+
+double BondAnalytics::GetPV01(ProductIndex _index)
+{
+    if (_index >= size) return GetProductCatalog().GetPV01(_index);
+    Stale(_index);
+    if (!work.empty()) Solve();
+    return pv01s[_index];
+}
+
+// the analytics shared by all the services of the session, built from the catalog on first use
+BondAnalytics& GetBondAnalytics()
+{
+    static BondAnalytics _analytics;
+    return _analytics;
+}
+
+double GetPV01Value(string_view _cusip)
+{
+    return GetBondAnalytics().GetPV01(GetProductCatalog().GetProductIndex(_cusip));
+}
+
+/**
+ * Bond Analytics Listener subscribing the mids of the Pricing Service to the analytics.
+ */
+class BondAnalyticsToPricingListener : public ServiceListener<Price<Bond> >
+{
+private:
+    BondAnalytics* analytics;
+public:
+    BondAnalyticsToPricingListener(BondAnalytics* _analytics) { analytics = _analytics; }
+    ~BondAnalyticsToPricingListener() {} // set empty
+    void ProcessAdd(Price<Bond>& _data) { analytics->SetMid(_data.GetProduct().GetProductIndex(), _data.GetMid()); }
+    void ProcessRemove(Price<Bond>& _data) {} // set empty
+    void ProcessUpdate(Price<Bond>& _data) {} // set empty
+};
+
+#endif
@@ -0,0 +1,129 @@
+/**
+ * clock.hpp
+ * Defines the clocks of the trading system.
+ * Wall-clock time stamps are formatted from a per-thread cache of the "YYYY-MM-DD HH:MM:SS" prefix,
+ * refreshed only when the second changes, so localtime and strftime run at most once a second.
+ * Latencies are measured with a monotonic nanosecond clock read from the TSC when it is available.
+ */
+#ifndef CLOCK_HPP
+#define CLOCK_HPP
+
+#include <chrono>
+#include <ctime>
+#include <cstring>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+using namespace std;
+
+// digits printed after the seconds
+enum TimeStampPrecision { MILLISECONDS, MICROSECONDS };
+
+// size of a buffer holding any formatted time stamp
+const size_t TIME_STAMP_SIZE = 32;
+
+/**
+ * Format _time as "YYYY-MM-DD HH:MM:SS.mmm " (or ".uuuuuu " in microseconds) into _buffer,
+ * which must hold TIME_STAMP_SIZE characters. Returns the length, the result is not null terminated.
+ */
+size_t FormatTimeStamp(chrono::system_clock::time_point _time, char* _buffer, TimeStampPrecision _precision = MILLISECONDS)
+{
+    // second of the cached prefix, one cache per thread so no lock is needed
+    thread_local time_t _cachedSecond = -1;
+    thread_local char _cachedPrefix[24];
+    const size_t _prefixSize = 19;
+
+    long long _micros = chrono::duration_cast<chrono::microseconds>(_time.time_since_epoch()).count();
+    long long _seconds = _micros / 1000000;
+    long long _fraction = _micros % 1000000;
+    if (_fraction < 0)
+    {
+        _fraction += 1000000;
+        --_seconds;
+    }
+
+    time_t _second = (time_t)_seconds;
+    if (_second != _cachedSecond)
+    {
+        struct tm _localTime;
+        localtime_r(&_second, &_localTime);
+        strftime(_cachedPrefix, sizeof(_cachedPrefix), "%F %T", &_localTime);
+        _cachedSecond = _second;
+    }
+
+    memcpy(_buffer, _cachedPrefix, _prefixSize);
+    size_t _size = _prefixSize;
+    _buffer[_size++] = '.';
+    int _digits = 6;
+    if (_precision == MILLISECONDS)
+    {
+        _fraction /= 1000;
+        _digits = 3;
+    }
+    for (int i = _digits - 1; i >= 0; --i)
+    {
+        _buffer[_size + i] = (char)('0' + _fraction % 10);
+        _fraction /= 10;
+    }
+    _size += _digits;
+    _buffer[_size++] = ' ';
+    return _size;
+}
+
+/**
+ * Monotonic nanosecond clock for latency measurement.
+ * On x86 it reads the TSC, calibrated once against steady_clock, otherwise it reads steady_clock.
+ * It assumes an invariant TSC, as on every x86 processor of the last decade.
+ */
+class MonotonicClock
+{
+public:
+    // Get the nanoseconds elapsed since the clock was calibrated
+    static long long Now() { return Instance().Read(); }
+
+    // Get the number of nanoseconds per TSC tick, 0 when the TSC is not used
+    static double GetNanosPerTick() { return Instance().nanosPerTick; }
+
+private:
+    unsigned long long tscBase;
+    double nanosPerTick;
+    chrono::steady_clock::time_point steadyBase;
+
+    MonotonicClock();
+    static MonotonicClock& Instance()
+    {
+        static MonotonicClock _clock;
+        return _clock;
+    }
+    long long Read() const;
+};
+
+MonotonicClock::MonotonicClock()
+{
+    tscBase = 0;
+    nanosPerTick = 0.;
+    steadyBase = chrono::steady_clock::now();
+#if defined(__x86_64__) || defined(__i386__)
+    // count the ticks over a few milliseconds of steady_clock
+    unsigned long long _tscStart = __rdtsc();
+    auto _steadyStart = chrono::steady_clock::now();
+    auto _steadyEnd = _steadyStart;
+    while (_steadyEnd - _steadyStart < chrono::milliseconds(5)) _steadyEnd = chrono::steady_clock::now();
+    unsigned long long _tscEnd = __rdtsc();
+    double _nanos = (double)chrono::duration_cast<chrono::nanoseconds>(_steadyEnd - _steadyStart).count();
+    if (_tscEnd > _tscStart) nanosPerTick = _nanos / (double)(_tscEnd - _tscStart);
+    tscBase = _tscStart;
+    steadyBase = _steadyStart;
+#endif
+}
+
+long long MonotonicClock::Read() const
+{
+#if defined(__x86_64__) || defined(__i386__)
+    if (nanosPerTick > 0.) return (long long)((double)(__rdtsc() - tscBase) * nanosPerTick);
+#endif
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - steadyBase).count();
+}
+
+#endif
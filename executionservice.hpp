@@ -134,46 +134,119 @@ bool ExecutionOrder<T>::IsChildOrder() const
 
 */
 
+/**
+ * A fill of an execution order reported by a venue, with the quantity left on the order after it.
+ * Type T is the product type.
+ */
+template<typename T>
+class Fill
+{
+
+public:
+
+  // ctor for a fill
+  Fill() = default;
+  Fill(const T &_product, string _fillId, string _orderId, PricingSide _side, double _price, long _quantity, long _leavesQuantity);
+
+  // Get the product
+  const T& GetProduct() const { return product; }
+
+  // Get the fill ID
+  const string& GetFillId() const { return fillId; }
+
+  // Get the ID of the filled order
+  const string& GetOrderId() const { return orderId; }
+
+  // Get the pricing side of the filled order
+  PricingSide GetPricingSide() const { return side; }
+
+  // Get the price of the fill
+  double GetPrice() const { return price; }
+
+  // Get the quantity of the fill
+  long GetQuantity() const { return quantity; }
+
+  // Get the quantity left on the order
+  long GetLeavesQuantity() const { return leavesQuantity; }
+
+private:
+  T product;
+  string fillId;
+  string orderId;
+  PricingSide side;
+  double price;
+  long quantity;
+  long leavesQuantity;
+
+};
+
+template<typename T>
+Fill<T>::Fill(const T &_product, string _fillId, string _orderId, PricingSide _side, double _price, long _quantity, long _leavesQuantity) :
+  product(_product), fillId(_fillId), orderId(_orderId)
+{
+  side = _side;
+  price = _price;
+  quantity = _quantity;
+  leavesQuantity = _leavesQuantity;
+}
+
 
 // will define later
 template<typename T>
 class ExecutionToAlgoExecutionListener;
 
 // changed from pure virtual function into normal virtual function
+// the execution orders are keyed on their order ID, the children of a parent order each have their own,
+// and kept per product so the products can run in parallel
 template<typename T>
 class ExecutionService : public Service<string, ExecutionOrder<T> >
 {
 private:
-    map<string, ExecutionOrder<T> > executionOrders;
+    ProductStore<unordered_map<string, ExecutionOrder<T> > > executionOrders;
     vector<ServiceListener<ExecutionOrder<T> >* > listeners;
     ExecutionToAlgoExecutionListener<T>* listener;
 public:
     ExecutionService();
     ~ExecutionService() {} // set empty
-    ExecutionOrder<T>& GetData(string _key) { return executionOrders[_key]; }
-    void OnMessage(ExecutionOrder<T>& _data) { executionOrders[_data.GetProduct().GetProductId()] = _data;}
+    ExecutionOrder<T>& GetData(string _key);
+    ExecutionOrder<T>& GetData(ProductIndex _index, const string& _orderId) { return executionOrders[_index][_orderId]; }
+    void OnMessage(ExecutionOrder<T>& _data) { executionOrders[_data.GetProduct().GetProductIndex()][_data.GetOrderId()] = _data; }
     void AddListener(ServiceListener<ExecutionOrder<T> >* _listener) { listeners.push_back(_listener); }
     const vector<ServiceListener<ExecutionOrder<T> >* >& GetListeners() const { return listeners; }
     ExecutionToAlgoExecutionListener<T>* GetListener() { return listener; }
-    void ExecuteOrder(ExecutionOrder<T>& _executionOrder);
+    void ExecuteOrder(ExecutionOrder<T>& _executionOrder) { ExecuteOrder(_executionOrder, ListenerFanout<ExecutionOrder<T> >(listeners)); }
+    template<typename Sink>
+    void ExecuteOrder(ExecutionOrder<T>& _executionOrder, Sink&& _sink);
 };
 
 template<typename T>
 ExecutionService<T>::ExecutionService()
 {
-    executionOrders = map<string, ExecutionOrder<T> >();
+    executionOrders = ProductStore<unordered_map<string, ExecutionOrder<T> > >();
     listeners = vector<ServiceListener<ExecutionOrder<T> >*>();
     listener = new ExecutionToAlgoExecutionListener<T>(this);
 }
 
 template<typename T>
-void ExecutionService<T>::ExecuteOrder(ExecutionOrder<T>& _executionOrder)
+ExecutionOrder<T>& ExecutionService<T>::GetData(string _key)
+{
+    // the order ID does not tell the product, every product is searched
+    for (size_t i = 0; i < executionOrders.Size(); ++i)
+    {
+        auto& _orders = executionOrders[(ProductIndex)i];
+        auto o = _orders.find(_key);
+        if (o != _orders.end()) return o->second;
+    }
+    return executionOrders[NO_PRODUCT_INDEX][_key];
+}
+
+template<typename T>
+template<typename Sink>
+void ExecutionService<T>::ExecuteOrder(ExecutionOrder<T>& _executionOrder, Sink&& _sink)
 {
-    string _productId = _executionOrder.GetProduct().GetProductId();
-    executionOrders[_productId] = _executionOrder;
+    executionOrders[_executionOrder.GetProduct().GetProductIndex()][_executionOrder.GetOrderId()] = _executionOrder;
     
-    for (auto l = listeners.begin(); l != listeners.end(); ++l)
-        (*l)->ProcessAdd(_executionOrder);
+    _sink(_executionOrder);
 }
 
 /**
@@ -188,17 +261,20 @@ private:
 public:
     ExecutionToAlgoExecutionListener(ExecutionService<T>* _service) { service = _service; }
     ~ExecutionToAlgoExecutionListener() {} // set empty
-    void ProcessAdd(AlgoExecution<T>& _data);
+    void ProcessAdd(AlgoExecution<T>& _data) { ProcessAdd(_data, ListenerFanout<ExecutionOrder<T> >(service->GetListeners())); }
+    template<typename Sink>
+    void ProcessAdd(AlgoExecution<T>& _data, Sink&& _sink);
     void ProcessRemove(AlgoExecution<T>& _data) {} // set empty
     void ProcessUpdate(AlgoExecution<T>& _data) {} // set empty
 };
 
 template<typename T>
-void ExecutionToAlgoExecutionListener<T>::ProcessAdd(AlgoExecution<T>& _data)
+template<typename Sink>
+void ExecutionToAlgoExecutionListener<T>::ProcessAdd(AlgoExecution<T>& _data, Sink&& _sink)
 {
     ExecutionOrder<T>* _executionOrder = _data.GetExecutionOrder();
     service->OnMessage(*_executionOrder);
-    service->ExecuteOrder(*_executionOrder);
+    service->ExecuteOrder(*_executionOrder, _sink);
 }
 
 #endif
@@ -0,0 +1,159 @@
+/**
+ * filereader.hpp
+ * Defines a memory-mapped reader for the comma separated input files.
+ * The file is walked in place and every row is handed to the parser as
+ * string_view cells, so no heap allocation happens per line.
+ */
+#ifndef FILE_READER_HPP
+#define FILE_READER_HPP
+
+#include <string>
+#include <string_view>
+#include <charconv>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+/**
+ * A row of comma separated cells pointing into the underlying buffer.
+ * Cells are trimmed of spaces, tabs and carriage returns.
+ */
+class CsvRow
+{
+public:
+    static const int MAX_CELLS = 16;
+    CsvRow() { size = 0; }
+    int Size() const { return size; }
+    string_view operator[](int _i) const { return _i < size ? cells[_i] : string_view(); }
+    void Clear() { size = 0; }
+    void Add(string_view _cell) { if (size < MAX_CELLS) cells[size++] = _cell; }
+private:
+    string_view cells[MAX_CELLS];
+    int size;
+};
+
+// trim spaces, tabs and carriage returns on both ends of a cell
+string_view TrimCell(string_view _cell)
+{
+    size_t _begin = 0;
+    size_t _end = _cell.size();
+    while (_begin < _end && (_cell[_begin] == ' ' || _cell[_begin] == '\t' || _cell[_begin] == '\r')) ++_begin;
+    while (_end > _begin && (_cell[_end - 1] == ' ' || _cell[_end - 1] == '\t' || _cell[_end - 1] == '\r')) --_end;
+    return _cell.substr(_begin, _end - _begin);
+}
+
+// split one line into its comma separated cells
+void SplitRow(string_view _line, CsvRow& _row)
+{
+    _row.Clear();
+    size_t _start = 0;
+    while (true)
+    {
+        size_t _comma = _line.find(',', _start);
+        if (_comma == string_view::npos)
+        {
+            _row.Add(TrimCell(_line.substr(_start)));
+            break;
+        }
+        _row.Add(TrimCell(_line.substr(_start, _comma - _start)));
+        _start = _comma + 1;
+    }
+}
+
+// parse an integer cell, returns 0 on malformed input
+long ParseLong(string_view _cell)
+{
+    long _value = 0;
+    from_chars(_cell.data(), _cell.data() + _cell.size(), _value);
+    return _value;
+}
+
+/**
+ * Read-only memory mapping of a whole input file.
+ */
+class MappedFile
+{
+public:
+    MappedFile(const string& _path);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // Whether the file was opened and mapped
+    bool IsOpen() const { return isOpen; }
+
+    // Get the whole file content
+    string_view GetData() const { return string_view(data, size); }
+
+    // Walk the file line by line, calling _callback(const CsvRow&) for every non-empty line
+    template<typename F>
+    void ForEachRow(F&& _callback) const;
+private:
+    const char* data;
+    size_t size;
+    bool isOpen;
+};
+
+MappedFile::MappedFile(const string& _path)
+{
+    data = nullptr;
+    size = 0;
+    isOpen = false;
+
+    int _fd = open(_path.c_str(), O_RDONLY);
+    if (_fd < 0) return;
+    struct stat _stat;
+    if (fstat(_fd, &_stat) == 0)
+    {
+        size = _stat.st_size;
+        if (size == 0)
+        {
+            isOpen = true;
+        }
+        else
+        {
+            void* _map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, _fd, 0);
+            if (_map != MAP_FAILED)
+            {
+                madvise(_map, size, MADV_SEQUENTIAL);
+                data = static_cast<const char*>(_map);
+                isOpen = true;
+            }
+            else
+            {
+                size = 0;
+            }
+        }
+    }
+    close(_fd);
+}
+
+MappedFile::~MappedFile()
+{
+    if (data) munmap(const_cast<char*>(data), size);
+}
+
+template<typename F>
+void MappedFile::ForEachRow(F&& _callback) const
+{
+    CsvRow _row;
+    const char* _cursor = data;
+    const char* _end = data + size;
+    while (_cursor < _end)
+    {
+        const char* _newline = static_cast<const char*>(memchr(_cursor, '\n', _end - _cursor));
+        if (!_newline) _newline = _end;
+        string_view _line(_cursor, _newline - _cursor);
+        _cursor = _newline + 1;
+
+        if (TrimCell(_line).empty()) continue;
+        SplitRow(_line, _row);
+        _callback(_row);
+    }
+}
+
+#endif
@@ -0,0 +1,158 @@
+/**
+ * filewriter.hpp
+ * Defines a long-lived buffered writer for the output files.
+ * Records are appended to a user-space buffer and handed to the kernel in
+ * large writes, instead of opening, flushing and closing the file per record.
+ */
+#ifndef FILE_WRITER_HPP
+#define FILE_WRITER_HPP
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <chrono>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+using namespace std;
+
+/**
+ * Append-only writer with a user-space buffer.
+ * The buffer is flushed when it is full, when a record ends after the flush interval
+ * has elapsed, on an explicit Flush and when the writer is closed or destroyed.
+ * Bytes the kernel refuses stay in the buffer for the next flush, the first error is kept,
+ * and what no longer fits in the buffer is dropped and counted. Close reports both.
+ */
+class BufferedWriter
+{
+public:
+    // ctor for a writer appending to _path, flushing at least every _flushMillisec milliseconds while records come in
+    BufferedWriter(const string& _path, size_t _capacity = 1 << 20, long _flushMillisec = 1000);
+    ~BufferedWriter() { Close(); }
+    BufferedWriter(const BufferedWriter&) = delete;
+    BufferedWriter& operator=(const BufferedWriter&) = delete;
+
+    // Whether the file was opened
+    bool IsOpen() const { return fd >= 0; }
+
+    // Whether the file was empty when it was opened
+    bool WasEmpty() const { return wasEmpty; }
+
+    // Append raw bytes to the buffer
+    void Write(string_view _data);
+    void Write(char _c) { if (used < buffer.size()) buffer[used++] = _c; else Write(string_view(&_c, 1)); }
+
+    // Mark the end of a record, flushing if the flush interval has elapsed
+    void EndRecord() { if (chrono::steady_clock::now() - lastFlush >= flushInterval) Flush(); }
+
+    // Hand the buffer to the kernel, returns false if some bytes could not be written
+    bool Flush();
+
+    // Flush the file to the disk, the buffer must have been flushed first
+    void Sync() { if (fd >= 0) fsync(fd); }
+
+    // Flush and close the file, returns false and prints the error if a write failed or bytes were lost in the session
+    bool Close();
+
+    // Get the errno of the first failed open or write, 0 if none
+    int GetError() const { return error; }
+
+    // Get the number of bytes dropped because the buffer was full and could not be flushed
+    size_t GetDroppedBytes() const { return dropped; }
+
+    // Get the number of writes made to the file so far
+    long GetFlushCount() const { return flushCount; }
+
+private:
+    string path;
+    int fd;
+    int error;
+    size_t dropped;
+    bool closed;
+    bool wasEmpty;
+    vector<char> buffer;
+    size_t used;
+    chrono::milliseconds flushInterval;
+    chrono::steady_clock::time_point lastFlush;
+    long flushCount;
+};
+
+BufferedWriter::BufferedWriter(const string& _path, size_t _capacity, long _flushMillisec) :
+path(_path), buffer(_capacity > 0 ? _capacity : 1), flushInterval(_flushMillisec)
+{
+    fd = open(_path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+    error = fd < 0 ? errno : 0;
+    dropped = 0;
+    closed = false;
+    struct stat _stat;
+    wasEmpty = fd >= 0 && fstat(fd, &_stat) == 0 && _stat.st_size == 0;
+    used = 0;
+    lastFlush = chrono::steady_clock::now();
+    flushCount = 0;
+}
+
+void BufferedWriter::Write(string_view _data)
+{
+    while (!_data.empty())
+    {
+        if (used == buffer.size() && !Flush() && used == buffer.size())
+        {
+            // the kernel takes nothing, the rest of the record is lost
+            dropped += _data.size();
+            return;
+        }
+        size_t _size = min(_data.size(), buffer.size() - used);
+        memcpy(buffer.data() + used, _data.data(), _size);
+        used += _size;
+        _data.remove_prefix(_size);
+    }
+}
+
+bool BufferedWriter::Flush()
+{
+    lastFlush = chrono::steady_clock::now();
+    if (used == 0) return true;
+    if (fd < 0)
+    {
+        dropped += used;
+        used = 0;
+        return false;
+    }
+
+    ++flushCount;
+    size_t _written = 0;
+    while (_written < used)
+    {
+        ssize_t _count = write(fd, buffer.data() + _written, used - _written);
+        if (_count < 0)
+        {
+            if (errno == EINTR) continue;
+            if (error == 0) error = errno;
+            break;
+        }
+        _written += _count;
+    }
+    // what the kernel did not take moves to the front of the buffer, for the next flush
+    memmove(buffer.data(), buffer.data() + _written, used - _written);
+    used -= _written;
+    return used == 0;
+}
+
+bool BufferedWriter::Close()
+{
+    if (closed) return error == 0 && dropped == 0;
+    closed = true;
+    if (!Flush()) dropped += used;
+    used = 0;
+    if (fd >= 0 && close(fd) != 0 && error == 0) error = errno;
+    fd = -1;
+    bool _ok = error == 0 && dropped == 0;
+    if (!_ok) cerr << "failed to write " << path << ": " << (error != 0 ? strerror(error) : "buffer full") << ", " << dropped << " bytes lost" << endl;
+    return _ok;
+}
+
+#endif
@@ -134,6 +134,57 @@ def gen_marketdata(path):
     np.savetxt(filename, res.values, fmt='%s', delimiter=",")
 
 
+def gen_marketupdates(path):
+    num = 500  # update steps per cusip
+    depth = 5
+    tick = 1 / 256
+    spread = [1, 2, 3, 4, 3, 2]
+    spread = [x / 128 for x in spread]
+
+    start = np.random.uniform(99, 101, n)
+    start = [int_256(x) for x in start]
+    mid = list(start)
+
+    rows = []
+    tops = []
+    # initial levels, the deeper ones stay out of the range of the moving top of book
+    for i, c in enumerate(cusips):
+        bid = mid[i] - spread[0] / 2
+        offer = mid[i] + spread[0] / 2
+        tops.append([bid, offer])
+        for k in range(depth):
+            size = int((k + 1) * 1E7)
+            bid_k = bid if k == 0 else mid[i] - 1 / 16 - (k - 1) / 32
+            offer_k = offer if k == 0 else mid[i] + 1 / 16 + (k - 1) / 32
+            rows.append([c, 'ADD', transform(bid_k), size, 'BID'])
+            rows.append([c, 'ADD', transform(offer_k), size, 'OFFER'])
+
+    # every step moves the top of book of each cusip and resizes one deeper level
+    for j in range(1, num):
+        s = spread[j % len(spread)]
+        for i, c in enumerate(cusips):
+            mid[i] += np.random.choice([-1, 0, 1]) * tick
+            mid[i] = min(max(mid[i], start[i] - 8 * tick), start[i] + 8 * tick)
+            bid, offer = tops[i]
+            rows.append([c, 'CANCEL', transform(bid), 0, 'BID'])
+            rows.append([c, 'CANCEL', transform(offer), 0, 'OFFER'])
+            bid = mid[i] - s / 2
+            offer = mid[i] + s / 2
+            tops[i] = [bid, offer]
+            rows.append([c, 'ADD', transform(bid), int(1E7), 'BID'])
+            rows.append([c, 'ADD', transform(offer), int(1E7), 'OFFER'])
+
+            k = j % (depth - 1)
+            size = int((np.random.randint(1, 6)) * 1E7)
+            if j % 2 == 0:
+                rows.append([c, 'MODIFY', transform(start[i] - 1 / 16 - k / 32), size, 'BID'])
+            else:
+                rows.append([c, 'MODIFY', transform(start[i] + 1 / 16 + k / 32), size, 'OFFER'])
+
+    filename = os.path.join(path, 'marketupdates.txt')
+    np.savetxt(filename, np.array(rows, dtype=object), fmt='%s', delimiter=",")
+
+
 def gen_inquires(path):
     res = pd.DataFrame()
     num = 10  # even number
@@ -175,4 +226,5 @@ if __name__ == '__main__':
     gen_prices(path)
     gen_trades(path)
     gen_marketdata(path)
+    gen_marketupdates(path)
     gen_inquires(path)
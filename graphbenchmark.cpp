@@ -0,0 +1,182 @@
+//
+//  graphbenchmark.cpp
+//  tradingsystem
+//
+//  Replays prices.txt and marketdata.txt through the services of lanes 1 to 3, wired once through the
+//  registered listeners and once as the static graph of "--static", and measures the latency of a tick
+//  from the pricing or market data service to the end of its lane. The historical data services are left
+//  out, the ends of the lanes count what reaches them, and both graphs must end with the same positions.
+//
+//  usage: graphbenchmark [prices file] [market data file] [repeats]
+//
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+#include <stdio.h>
+#include "products.hpp"
+#include "tools.hpp"
+#include "soa.hpp"
+#include "filereader.hpp"
+#include "productcatalog.hpp"
+#include "pricingservice.hpp"
+#include "algostreamingservice.hpp"
+#include "streamingservice.hpp"
+#include "marketdataservice.hpp"
+#include "algoexecutionservice.hpp"
+#include "executionservice.hpp"
+#include "tradebookingservice.hpp"
+#include "positionservice.hpp"
+#include "riskservice.hpp"
+
+/**
+ * Listener at the end of a lane, counting what reaches it.
+ * Type V is the data type.
+ */
+template<typename V>
+class CountingListener : public ServiceListener<V>
+{
+public:
+    long count = 0;
+    void ProcessAdd(V& _data) { ++count; }
+    void ProcessRemove(V& _data) {} // set empty
+    void ProcessUpdate(V& _data) {} // set empty
+};
+
+// the services of lanes 1 to 3, as main.cpp declares them
+struct Lanes
+{
+    PricingService<Bond> pricingService;
+    AlgoStreamingService<Bond> algoStreamingService;
+    StreamingService<Bond> streamingService;
+    MarketDataService<Bond> marketDataService;
+    AlgoExecutionService<Bond> algoExecutionService;
+    ExecutionService<Bond> executionService;
+    TradeBookingService<Bond> tradeBookingService;
+    PositionService<Bond> positionService;
+    RiskService<Bond> riskService;
+    CountingListener<PriceStream<Bond> > streams;
+    CountingListener<PV01<Bond> > risks;
+};
+
+// per tick latencies in nanoseconds, sorted
+struct Latencies
+{
+    vector<long long> nanos;
+    double Mean() const { long long _sum = 0; for (auto n : nanos) _sum += n; return (double)_sum / nanos.size(); }
+    long long Percentile(double _p) const { return nanos[min(nanos.size() - 1, (size_t)(_p * nanos.size()))]; }
+};
+
+// replay _prices then _books through _price(Price<Bond>&) and _book(OrderBook<Bond>&), timing every tick
+template<typename P, typename B>
+void Replay(const vector<Price<Bond> >& _prices, const vector<OrderBook<Bond> >& _books, int _repeats, P _price, B _book, Latencies& _priceNanos, Latencies& _bookNanos)
+{
+    for (int r = 0; r < _repeats; ++r)
+    {
+        for (auto p = _prices.begin(); p != _prices.end(); ++p)
+        {
+            Price<Bond> _data = *p;
+            long long _start = MonotonicClock::Now();
+            _price(_data);
+            _priceNanos.nanos.push_back(MonotonicClock::Now() - _start);
+        }
+        for (auto b = _books.begin(); b != _books.end(); ++b)
+        {
+            OrderBook<Bond> _data = *b;
+            long long _start = MonotonicClock::Now();
+            _book(_data);
+            _bookNanos.nanos.push_back(MonotonicClock::Now() - _start);
+        }
+    }
+    sort(_priceNanos.nanos.begin(), _priceNanos.nanos.end());
+    sort(_bookNanos.nanos.begin(), _bookNanos.nanos.end());
+}
+
+void Print(const string& _graph, const Lanes& _lanes, const Latencies& _priceNanos, const Latencies& _bookNanos)
+{
+    cout << _graph << ": price to stream " << _priceNanos.Mean() << "ns mean, " << _priceNanos.Percentile(0.5) << "ns p50, "
+         << _priceNanos.Percentile(0.99) << "ns p99 (" << _lanes.streams.count << " streams), book to risk "
+         << _bookNanos.Mean() << "ns mean, " << _bookNanos.Percentile(0.5) << "ns p50, " << _bookNanos.Percentile(0.99)
+         << "ns p99 (" << _lanes.risks.count << " PV01s)" << endl;
+}
+
+int main(int argc, const char * argv[])
+{
+    string _pricesFile = argc > 1 ? argv[1] : "prices.txt";
+    string _marketDataFile = argc > 2 ? argv[2] : "marketdata.txt";
+    int _repeats = argc > 3 ? atoi(argv[3]) : 20;
+    if (!GetProductCatalog().Load("products.txt"))
+    {
+        cerr << "failed to read products.txt" << endl;
+        return 1;
+    }
+    MappedFile _priceData(_pricesFile);
+    MappedFile _marketData(_marketDataFile);
+    if (!_priceData.IsOpen() || !_marketData.IsOpen() || _repeats <= 0)
+    {
+        cerr << "usage: " << argv[0] << " [prices file] [market data file] [repeats]" << endl;
+        return 1;
+    }
+
+    // parse once, the replays only time the services
+    vector<Price<Bond> > _prices;
+    vector<OrderBook<Bond> > _books;
+    {
+        Lanes _parser;
+        _parser.pricingService.GetConnector()->Parse(_priceData, [&](Price<Bond>& _price) { _prices.push_back(_price); });
+        _parser.marketDataService.GetConnector()->Parse(_marketData, [&](OrderBook<Bond>& _orderBook) { _books.push_back(_orderBook); });
+    }
+    cout << _prices.size() << " prices, " << _books.size() << " books, " << _repeats << " repeats" << endl;
+
+    // the registered listeners, a virtual call and a loop over the listeners a hop
+    Lanes _runtime;
+    _runtime.pricingService.AddListener(_runtime.algoStreamingService.GetListener());
+    _runtime.algoStreamingService.AddListener(_runtime.streamingService.GetListener());
+    _runtime.streamingService.AddListener(&_runtime.streams);
+    _runtime.marketDataService.AddListener(_runtime.algoExecutionService.GetListener());
+    _runtime.algoExecutionService.AddListener(_runtime.executionService.GetListener());
+    _runtime.executionService.AddListener(_runtime.tradeBookingService.GetListener());
+    _runtime.tradeBookingService.AddListener(_runtime.positionService.GetListener());
+    _runtime.positionService.AddListener(_runtime.riskService.GetListener());
+    _runtime.riskService.AddListener(&_runtime.risks);
+    Latencies _runtimePrices, _runtimeBooks;
+    Replay(_prices, _books, _repeats,
+           [&](Price<Bond>& _price) { _runtime.pricingService.OnMessage(_price); },
+           [&](OrderBook<Bond>& _orderBook) { _runtime.marketDataService.OnMessage(_orderBook); },
+           _runtimePrices, _runtimeBooks);
+
+    // the static graph, every hop a call the compiler can inline
+    Lanes _static;
+    auto _risks = [&](PV01<Bond>& _pv01) { _static.risks.ProcessAdd(_pv01); };
+    auto _risk = [&](Position<Bond>& _position) { _static.riskService.GetListener()->ProcessAdd(_position, _risks); };
+    auto _position = [&](Trade<Bond>& _trade) { _static.positionService.GetListener()->ProcessAdd(_trade, _risk); };
+    auto _tradeBooking = [&](ExecutionOrder<Bond>& _order) { _static.tradeBookingService.GetListener()->ProcessAdd(_order, _position); };
+    auto _execution = [&](AlgoExecution<Bond>& _algoExecution) { _static.executionService.GetListener()->ProcessAdd(_algoExecution, _tradeBooking); };
+    auto _algoExecution = [&](OrderBook<Bond>& _orderBook) { _static.algoExecutionService.GetListener()->ProcessAdd(_orderBook, _execution); };
+    auto _streams = [&](PriceStream<Bond>& _priceStream) { _static.streams.ProcessAdd(_priceStream); };
+    auto _streaming = [&](AlgoStream<Bond>& _algoStream) { _static.streamingService.GetListener()->ProcessAdd(_algoStream, _streams); };
+    auto _algoStreaming = [&](Price<Bond>& _price) { _static.algoStreamingService.GetListener()->ProcessAdd(_price, _streaming); };
+    Latencies _staticPrices, _staticBooks;
+    Replay(_prices, _books, _repeats,
+           [&](Price<Bond>& _price) { _static.pricingService.OnMessage(_price, _algoStreaming); },
+           [&](OrderBook<Bond>& _orderBook) { _static.marketDataService.OnMessage(_orderBook, _algoExecution); },
+           _staticPrices, _staticBooks);
+
+    Print("listeners", _runtime, _runtimePrices, _runtimeBooks);
+    Print("static", _static, _staticPrices, _staticBooks);
+
+    // both graphs must have booked the same positions
+    long _mismatches = 0;
+    for (size_t i = 0; i < GetProductCatalog().Size(); ++i)
+    {
+        ProductIndex _index = (ProductIndex)i;
+        if (_runtime.positionService.GetData(_index).GetAggregatePosition() != _static.positionService.GetData(_index).GetAggregatePosition())
+            ++_mismatches;
+    }
+    bool _ok = _mismatches == 0 && _runtime.streams.count == _static.streams.count && _runtime.risks.count == _static.risks.count;
+    cout << _mismatches << " positions differ, " << (_ok ? "same" : "DIFFERENT") << " output" << endl;
+    return _ok ? 0 : 1;
+}
@@ -11,6 +11,7 @@
 
 #include <iostream>
 #include "soa.hpp"
+#include "productcatalog.hpp"
 #include "pricingservice.hpp"
 
 template<typename T>
@@ -23,7 +24,7 @@ template<typename T>
 class GUIService : Service<string, Price<T> >
 {
 private:
-    map<string, Price<T> > guis;
+    ProductStore<Price<T> > guis;
     vector<ServiceListener<Price<T> >*> listeners;
     GUIConnector<T>* connector;
     ServiceListener<Price<T> >* listener;
@@ -34,6 +35,7 @@ public:
     GUIService();
     ~GUIService() {} // set empty
     Price<T>& GetData(string _key) {return guis[_key];}
+    Price<T>& GetData(ProductIndex _index) {return guis[_index];}
     void OnMessage(Price<T>& _data);
     void AddListener(ServiceListener<Price<T> >* _listener) {listeners.push_back(_listener);}
     const vector<ServiceListener<Price<T> >*>& GetListeners() const {return listeners;}
@@ -47,7 +49,7 @@ public:
 template<typename T>
 GUIService<T>::GUIService()
 {
-    guis = map<string, Price<T> >();
+    guis = ProductStore<Price<T> >();
     listeners = vector<ServiceListener<Price<T> >*>();
     connector = new GUIConnector<T>(this);
     listener = new GUIToPricingListener<T>(this);
@@ -58,7 +60,7 @@ GUIService<T>::GUIService()
 template<typename T>
 void GUIService<T>::OnMessage(Price<T>& _data)
 {
-    guis[_data.GetProduct().GetProductId()] = _data;
+    guis[_data.GetProduct().GetProductIndex()] = _data;
     connector->Publish(_data);
 }
 
@@ -87,7 +89,9 @@ void GUIConnector<T>::Publish(Price<T>& _data_out)
         ofstream _file;
         _file.open("gui.txt", ios::app);
         
-        _file << PrintTimeStamp() << ",";
+        char _timeStamp[TIME_STAMP_SIZE];
+        _file.write(_timeStamp, FormatTimeStamp(system_clock::now(), _timeStamp));
+        _file << ",";
         vector<string> _strings = _data_out.print();
         for (auto s = _strings.begin(); s != _strings.end(); ++s)
             _file << *s << ",";
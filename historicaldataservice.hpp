@@ -10,8 +10,70 @@
 #ifndef HISTORICAL_DATA_SERVICE_HPP
 #define HISTORICAL_DATA_SERVICE_HPP
 
+#include "filewriter.hpp"
+#include "ringbuffer.hpp"
+#include "persistencethread.hpp"
+#include "journal.hpp"
+
+enum ServiceType { POSITION, RISK, EXECUTION, STREAMING, INQUIRY, BUCKETED_RISK };
+
+// How the records are persisted: text lines, or the binary journal of journal.hpp
+enum PersistFormat { TEXT_FORMAT, BINARY_FORMAT };
+
+/**
+ * What is queued to persist a V on the persistence thread, the data itself by default.
+ * Restore gives back the data to publish, on the persistence thread only.
+ * Type V is the data type to persist.
+ */
+template<typename V>
+struct PersistDelta
+{
+    typedef V Queued;
+    static const V& Capture(const V& _data) { return _data; }
+    V& Restore(V& _queued) { return _queued; }
+};
+
+/**
+ * A position is queued as its last change, a fixed size record, and rebuilt on the persistence thread
+ * from the changes of its product, instead of copying its books and quantities into the queue.
+ * Type T is the product type.
+ */
+template<typename T>
+struct PersistDelta<Position<T> >
+{
+    struct Queued
+    {
+        ProductIndex product;
+        BookIndex book;
+        long quantity;
+    };
+    static Queued Capture(const Position<T>& _data) { return Queued{_data.GetProduct().GetProductIndex(), _data.GetLastBook(), _data.GetLastQuantity()}; }
+    Position<T>& Restore(const Queued& _queued);
+
+    ProductStore<Position<T> > positions; // the positions rebuilt so far
+};
+
+template<typename T>
+Position<T>& PersistDelta<Position<T> >::Restore(const Queued& _queued)
+{
+    Position<T>& _position = positions[_queued.product];
+    if (_queued.product == NO_PRODUCT_INDEX) return _position;
+    if (_position.GetBookCount() == 0) _position = Position<T>(GetProductCatalog().GetBond(_queued.product));
+    if (_queued.book != NO_BOOK_INDEX) _position.AddPosition(_queued.book, _queued.quantity);
+    return _position;
+}
+
+/**
+ * A record waiting to be persisted, time stamped when it was queued.
+ * Type V is the data type to persist.
+ */
+template<typename V>
+struct PersistRecord
+{
+    typename PersistDelta<V>::Queued data;
+    system_clock::time_point time;
+};
 
-enum ServiceType { POSITION, RISK, EXECUTION, STREAMING, INQUIRY };
 // will define later
 template<typename V>
 class HistoricalDataConnector;
@@ -32,10 +94,13 @@ private:
     HistoricalDataConnector<V>* connector;
     ServiceListener<V>* listener;
     ServiceType type;
+    PersistFormat format;
+    MpscQueue<PersistRecord<V> >* queue; // nullptr when persisting on the caller thread
+    PersistDelta<V> delta; // used by the persistence thread only
 public:
     HistoricalDataService(); // in cast we don't know the type at initialization
-    HistoricalDataService(ServiceType _type);
-    ~HistoricalDataService() {} // set empty
+    HistoricalDataService(ServiceType _type, PersistFormat _format = TEXT_FORMAT);
+    ~HistoricalDataService(); // flushes the persisted records
     V& GetData(string _key) { return historicalDatas[_key]; }
     void OnMessage(V& _data) { historicalDatas[_data.GetProduct().GetProductId()] = _data; }
     void AddListener(ServiceListener<V>* _listener) { listeners.push_back(_listener); }
@@ -43,7 +108,12 @@ public:
     HistoricalDataConnector<V>* GetConnector() { return connector; }
     ServiceListener<V>* GetListener() { return listener; }
     ServiceType GetServiceType() const { return type; }
-    void PersistData(string _persistKey, V& _data) { connector->Publish(_data); }
+    PersistFormat GetPersistFormat() const { return format; }
+    void PersistData(string _persistKey, V& _data);
+    // Hand the records persisted so far to the file, returns false if some could not be written
+    bool Flush() { return connector->Flush(); }
+    // Persist on _thread from now on, through a queue of _capacity records, must be called before _thread starts
+    void PersistOn(PersistenceThread& _thread, size_t _capacity = 65536);
 };
 
 template<typename V>
@@ -51,19 +121,64 @@ HistoricalDataService<V>::HistoricalDataService()
 {
     historicalDatas = map<string, V>();
     listeners = vector<ServiceListener<V>*>();
+    type = INQUIRY;
+    format = TEXT_FORMAT;
     connector = new HistoricalDataConnector<V>(this);
     listener = new HistoricalDataListener<V>(this);
-    type = INQUIRY;
+    queue = nullptr;
 }
 
 template<typename V>
-HistoricalDataService<V>::HistoricalDataService(ServiceType _type)
+HistoricalDataService<V>::HistoricalDataService(ServiceType _type, PersistFormat _format)
 {
     historicalDatas = map<string, V>();
     listeners = vector<ServiceListener<V>*>();
+    type = _type; // the connector opens the file of this type and format
+    format = _format;
     connector = new HistoricalDataConnector<V>(this);
     listener = new HistoricalDataListener<V>(this);
-    type = _type;
+    queue = nullptr;
+}
+
+template<typename V>
+HistoricalDataService<V>::~HistoricalDataService()
+{
+    delete connector;
+    delete listener;
+    delete queue;
+}
+
+template<typename V>
+void HistoricalDataService<V>::PersistData(string _persistKey, V& _data)
+{
+    if (!queue)
+    {
+        connector->Publish(_data);
+        return;
+    }
+    // the time stamp is taken here, the record is formatted later on the persistence thread
+    PersistRecord<V> _record{PersistDelta<V>::Capture(_data), system_clock::now()};
+    while (!queue->TryPush(_record)) this_thread::yield();
+}
+
+template<typename V>
+void HistoricalDataService<V>::PersistOn(PersistenceThread& _thread, size_t _capacity)
+{
+    if (queue) return;
+    queue = new MpscQueue<PersistRecord<V> >(_capacity);
+    _thread.AddChannel([this](size_t _max)
+    {
+        PersistRecord<V> _record;
+        size_t _count = 0;
+        while (_count < _max && queue->TryPop(_record))
+        {
+            connector->Publish(delta.Restore(_record.data), _record.time);
+            ++_count;
+        }
+        return _count;
+    },
+    [this](bool _sync) { connector->Commit(_sync); },
+    [this]() { return queue->Size(); });
 }
 
 /**
@@ -75,42 +190,77 @@ class HistoricalDataConnector : public Connector<V>
 {
 private:
     HistoricalDataService<V>* service;
+    BufferedWriter writer; // kept open for the whole session
+    PersistFormat format;
+    JournalRecord record; // reused for every binary record
 public:
-    HistoricalDataConnector(HistoricalDataService<V>* _service) { service = _service; }
-    ~HistoricalDataConnector() {} // set empty
-    void Publish(V& _data);
+    HistoricalDataConnector(HistoricalDataService<V>* _service);
+    ~HistoricalDataConnector() {} // the writer flushes on destruction
+    void Publish(V& _data) { Publish(_data, system_clock::now()); }
+    // Publish a record time stamped at _time
+    void Publish(V& _data, system_clock::time_point _time);
     void Subscribe(ifstream& _data) {} // set empty
+    bool Flush() { return writer.Flush(); }
+    // Hand the published records to the file, and to the disk if _sync
+    void Commit(bool _sync) { writer.Flush(); if (_sync) writer.Sync(); }
+    static string GetFileName(ServiceType _type, PersistFormat _format = TEXT_FORMAT);
 };
 
 template<typename V>
-void HistoricalDataConnector<V>::Publish(V& _data)
+HistoricalDataConnector<V>::HistoricalDataConnector(HistoricalDataService<V>* _service) :
+writer(GetFileName(_service->GetServiceType(), _service->GetPersistFormat()))
 {
-    ServiceType _type = service->GetServiceType();
-    ofstream _file;
+    service = _service;
+    format = _service->GetPersistFormat();
+    // a new journal starts with its header
+    if (format == BINARY_FORMAT && writer.WasEmpty()) writer.Write(MakeJournalHeader(_service->GetServiceType()));
+}
+
+template<typename V>
+string HistoricalDataConnector<V>::GetFileName(ServiceType _type, PersistFormat _format)
+{
+    string _extension = _format == BINARY_FORMAT ? ".journal" : ".txt";
     switch (_type)
     {
         case POSITION:
-            _file.open("positions.txt", ios::app);
-            break;
+            return "positions" + _extension;
         case RISK:
-            _file.open("risk.txt", ios::app);
-            break;
+            return "risk" + _extension;
         case EXECUTION:
-            _file.open("executions.txt", ios::app);
-            break;
+            return "executions" + _extension;
         case STREAMING:
-            _file.open("streaming.txt", ios::app);
-            break;
+            return "streaming" + _extension;
         case INQUIRY:
-            _file.open("allinquiries.txt", ios::app);
-            break;
+            return "allinquiries" + _extension;
+        case BUCKETED_RISK:
+            return "bucketedrisk" + _extension;
+    }
+    return "";
+}
+
+template<typename V>
+void HistoricalDataConnector<V>::Publish(V& _data, system_clock::time_point _time)
+{
+    if (format == BINARY_FORMAT)
+    {
+        record.Start(chrono::duration_cast<chrono::nanoseconds>(_time.time_since_epoch()).count());
+        PutRecord(record, _data);
+        writer.Write(record.Finish());
+        writer.EndRecord();
+        return;
     }
     
-    _file << PrintTimeStamp() << ",";
+    char _timeStamp[TIME_STAMP_SIZE];
+    writer.Write(string_view(_timeStamp, FormatTimeStamp(_time, _timeStamp)));
+    writer.Write(',');
     vector<string> _strings = _data.ToStrings();
     for (auto s = _strings.begin(); s != _strings.end(); ++s)
-        _file << (*s) << ",";
-    _file << endl;
+    {
+        writer.Write(*s);
+        writer.Write(',');
+    }
+    writer.Write('\n');
+    writer.EndRecord();
 }
 
 /**
@@ -0,0 +1,68 @@
+//
+//  idbenchmark.cpp
+//  tradingsystem
+//
+//  Checks that GenerateId hands out distinct ids when called from many threads at once,
+//  and measures how long an id takes to generate.
+//
+//  usage: idbenchmark [threads] [ids per thread]
+//
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <algorithm>
+
+using namespace std;
+#include "tools.hpp"
+
+int main(int argc, const char * argv[])
+{
+    size_t _threadCount = argc > 1 ? stoul(argv[1]) : 8;
+    size_t _idCount = argc > 2 ? stoul(argv[2]) : 500000;
+    if (_threadCount == 0 || _idCount == 0)
+    {
+        cerr << "usage: " << argv[0] << " [threads] [ids per thread]" << endl;
+        return 1;
+    }
+
+    // every thread writes its ids into its own slice, the clock is read around the generation only
+    vector<char> _ids(_threadCount * _idCount * ID_SIZE);
+    vector<long long> _nanos(_threadCount);
+    vector<thread> _threads;
+    for (size_t t = 0; t < _threadCount; ++t)
+        _threads.emplace_back([&, t]() {
+            char* _buffer = _ids.data() + t * _idCount * ID_SIZE;
+            long long _start = MonotonicClock::Now();
+            for (size_t i = 0; i < _idCount; ++i)
+                GenerateId(_buffer + i * ID_SIZE);
+            _nanos[t] = MonotonicClock::Now() - _start;
+        });
+    for (auto& t : _threads) t.join();
+
+    // uniqueness across all the threads
+    vector<string_view> _sorted;
+    _sorted.reserve(_threadCount * _idCount);
+    for (size_t i = 0; i < _threadCount * _idCount; ++i)
+        _sorted.push_back(string_view(_ids.data() + i * ID_SIZE, ID_SIZE));
+    sort(_sorted.begin(), _sorted.end());
+    size_t _duplicates = 0;
+    for (size_t i = 1; i < _sorted.size(); ++i)
+        if (_sorted[i] == _sorted[i - 1]) ++_duplicates;
+
+    long long _totalNanos = 0;
+    for (auto n : _nanos) _totalNanos += n;
+    cout << _threadCount << " threads x " << _idCount << " ids, " << _duplicates << " duplicates, "
+         << (double)_totalNanos / (_threadCount * _idCount) << "ns per id, e.g. " << _sorted.front() << endl;
+
+    // one string per id, as the services generate them
+    long long _start = MonotonicClock::Now();
+    size_t _length = 0;
+    for (size_t i = 0; i < _idCount; ++i)
+        _length += GenerateId().size();
+    long long _stringNanos = MonotonicClock::Now() - _start;
+    cout << "string ids: " << (double)_stringNanos / _idCount << "ns per id (" << _length / _idCount << " characters)" << endl;
+
+    return _duplicates == 0 ? 0 : 1;
+}
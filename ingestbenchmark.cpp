@@ -0,0 +1,129 @@
+//
+//  ingestbenchmark.cpp
+//  tradingsystem
+//
+//  Measures the ingestion of prices.txt, marketdata.txt, trades.txt and inquiries.txt through the memory
+//  mapped reader against the ifstream path. The rows are split both ways, as the connectors used to split them
+//  (getline, a stringstream and a vector of trimmed strings per row) and in place, and the cells are checked
+//  to be the same. Then every file is fed to its service through both Subscribe overloads.
+//
+//  usage: ingestbenchmark [repeats]
+//
+
+#include <iostream>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <boost/algorithm/string/trim.hpp>
+
+using namespace std;
+#include <stdio.h>
+#include "products.hpp"
+#include "tools.hpp"
+#include "soa.hpp"
+#include "filereader.hpp"
+#include "productcatalog.hpp"
+#include "pricingservice.hpp"
+#include "algostreamingservice.hpp"
+#include "marketdataservice.hpp"
+#include "algoexecutionservice.hpp"
+#include "executionservice.hpp"
+#include "tradebookingservice.hpp"
+#include "inquiryservice.hpp"
+
+// the cells of every row split as the connectors used to, returns the rows and adds the hash of the cells
+long SplitByStream(const string& _path, size_t& _hash)
+{
+    ifstream _data_in(_path);
+    string _thisline;
+    long _rows = 0;
+    while (getline(_data_in, _thisline))
+    {
+        stringstream _lineStream(_thisline);
+        string _item;
+        vector<string> _item_parsing;
+        while (getline(_lineStream, _item, ','))
+        {
+            boost::algorithm::trim(_item);
+            _item_parsing.push_back(_item);
+        }
+        for (auto c = _item_parsing.begin(); c != _item_parsing.end(); ++c) _hash = _hash * 31 + hash<string>()(*c);
+        ++_rows;
+    }
+    return _rows;
+}
+
+// the cells of every row split in place in the mapping
+long SplitByMapping(const string& _path, size_t& _hash)
+{
+    MappedFile _data_in(_path);
+    long _rows = 0;
+    _data_in.ForEachRow([&](const CsvRow& _cells)
+    {
+        for (int c = 0; c < _cells.Size(); ++c) _hash = _hash * 31 + hash<string_view>()(_cells[c]);
+        ++_rows;
+    });
+    return _rows;
+}
+
+// split and subscribe _path _repeats times both ways, returns false if the cells differ
+template<typename S>
+bool Measure(const string& _path, int _repeats)
+{
+    MappedFile _file(_path);
+    if (!_file.IsOpen())
+    {
+        cerr << "failed to read " << _path << endl;
+        return false;
+    }
+    double _megabytes = _file.GetData().size() / 1e6 * _repeats;
+
+    size_t _streamHash = 0, _mappingHash = 0;
+    long _rows = 0;
+    long long _start = MonotonicClock::Now();
+    for (int r = 0; r < _repeats; ++r) _rows = SplitByStream(_path, _streamHash);
+    long long _streamNanos = MonotonicClock::Now() - _start;
+    _start = MonotonicClock::Now();
+    for (int r = 0; r < _repeats; ++r) SplitByMapping(_path, _mappingHash);
+    long long _mappingNanos = MonotonicClock::Now() - _start;
+
+    // the whole ingestion into a service with no listeners, opening the file included
+    S _streamService, _mappingService;
+    _start = MonotonicClock::Now();
+    for (int r = 0; r < _repeats; ++r)
+    {
+        ifstream _data_in(_path);
+        _streamService.GetConnector()->Subscribe(_data_in);
+    }
+    long long _subscribeStreamNanos = MonotonicClock::Now() - _start;
+    _start = MonotonicClock::Now();
+    for (int r = 0; r < _repeats; ++r)
+    {
+        MappedFile _data_in(_path);
+        _mappingService.GetConnector()->Subscribe(_data_in);
+    }
+    long long _subscribeMappingNanos = MonotonicClock::Now() - _start;
+
+    double _rowCount = (double)_rows * _repeats;
+    cout << _path << ", " << _rows << " rows: split " << _streamNanos / _rowCount << "ns a row by stream ("
+         << _megabytes * 1e9 / _streamNanos << "MB/s) against " << _mappingNanos / _rowCount << "ns mapped ("
+         << _megabytes * 1e9 / _mappingNanos << "MB/s), subscribed " << _subscribeStreamNanos / _rowCount
+         << "ns a row from ifstream against " << _subscribeMappingNanos / _rowCount << "ns mapped, cells "
+         << (_streamHash == _mappingHash ? "identical" : "DIFFERENT") << endl;
+    return _streamHash == _mappingHash;
+}
+
+int main(int argc, const char * argv[])
+{
+    int _repeats = argc > 1 ? atoi(argv[1]) : 50;
+    if (_repeats <= 0 || !GetProductCatalog().Load("products.txt"))
+    {
+        cerr << "usage: " << argv[0] << " [repeats], products.txt must be readable" << endl;
+        return 1;
+    }
+    bool _ok = Measure<PricingService<Bond> >("prices.txt", _repeats);
+    _ok = Measure<MarketDataService<Bond> >("marketdata.txt", _repeats) && _ok;
+    _ok = Measure<TradeBookingService<Bond> >("trades.txt", _repeats) && _ok;
+    _ok = Measure<InquiryService<Bond> >("inquiries.txt", _repeats) && _ok;
+    return _ok ? 0 : 1;
+}
@@ -8,6 +8,7 @@
 #define INQUIRY_SERVICE_HPP
 
 #include "soa.hpp"
+#include "filereader.hpp"
 #include "tradebookingservice.hpp"
 
 // Various inqyury states
@@ -170,7 +171,10 @@ public:
     InquiryService();
     ~InquiryService() {} // set empty
     Inquiry<T>& GetData(string _key) { return inquiries[_key]; }
-    void OnMessage(Inquiry<T>& _data);
+    void OnMessage(Inquiry<T>& _data) { OnMessage(_data, ListenerFanout<Inquiry<T> >(listeners)); }
+    // process the inquiry and hand the completed one to _sink instead of the registered listeners
+    template<typename Sink>
+    void OnMessage(Inquiry<T>& _data, Sink&& _sink);
     void AddListener(ServiceListener<Inquiry<T> >* _listener) { listeners.push_back(_listener); }
     const vector<ServiceListener<Inquiry<T> >*>& GetListeners() const { return listeners; }
     InquiryConnector<T>* GetConnector() { return connector; }
@@ -187,20 +191,20 @@ InquiryService<T>::InquiryService()
 }
 
 template<typename T>
-void InquiryService<T>::OnMessage(Inquiry<T>& _data)
+template<typename Sink>
+void InquiryService<T>::OnMessage(Inquiry<T>& _data, Sink&& _sink)
 {
     InquiryState _state = _data.GetState();
     switch (_state)
     {
         case RECEIVED:
             inquiries[_data.GetInquiryId()] = _data;
-            connector->Publish(_data);
+            connector->Publish(_data, _sink);
             break;
         case QUOTED:
             _data.SetState(DONE);
             inquiries[_data.GetInquiryId()] = _data;
-            for (auto l = listeners.begin(); l != listeners.end(); ++l)
-                (*l)->ProcessAdd(_data);
+            _sink(_data);
             break;
         default:
             break;
@@ -234,19 +238,32 @@ private:
 public:
     InquiryConnector(InquiryService<T>* _service) {  service = _service; }
     ~InquiryConnector() {} // set empty
-    void Publish(Inquiry<T>& _data);
+    void Publish(Inquiry<T>& _data) { Publish(_data, ListenerFanout<Inquiry<T> >(service->GetListeners())); }
+    template<typename Sink>
+    void Publish(Inquiry<T>& _data, Sink&& _sink);
     void Subscribe(ifstream& _data);
+    void Subscribe(const MappedFile& _data);
     void Subscribe(Inquiry<T>& _data) { service->OnMessage(_data); }
+    template<typename Sink>
+    void Subscribe(Inquiry<T>& _data, Sink&& _sink) { service->OnMessage(_data, _sink); }
+    // Parse the file and hand every inquiry to _handler(Inquiry<T>&) instead of the service
+    template<typename F>
+    void Parse(const MappedFile& _data, F&& _handler);
+private:
+    // Parse one row of inquiries.txt and hand the inquiry to _handler
+    template<typename F>
+    void ParseRow(const CsvRow& _cells, F& _handler);
 };
 
 template<typename T>
-void InquiryConnector<T>::Publish(Inquiry<T>& _data)
+template<typename Sink>
+void InquiryConnector<T>::Publish(Inquiry<T>& _data, Sink&& _sink)
 {
     InquiryState _state = _data.GetState();
     if (_state == RECEIVED)
     {
         _data.SetState(QUOTED);
-        this->Subscribe(_data);
+        this->Subscribe(_data, _sink);
     }
 }
 
@@ -254,34 +271,48 @@ template<typename T>
 void InquiryConnector<T>::Subscribe(ifstream& _data_in)
 {
     string _line;
+    CsvRow _cells;
+    auto _handler = [this](Inquiry<T>& _inquiry) { service->OnMessage(_inquiry); };
     while (getline(_data_in, _line))
     {
-        stringstream _lineStream(_line);
-        string _cell;
-        vector<string> _cells;
-        while (getline(_lineStream, _cell, ','))
-        {
-            _cells.push_back(_cell);
-        }
-        
-        string _inquiryId = _cells[0];
-        string _productId = _cells[1];
-        Side _side;
-        if (_cells[2] == "BUY") _side = BUY;
-        else if (_cells[2] == "SELL") _side = SELL;
-        long _quantity = stol(_cells[3]);
-        double _price = ConvertPrice(_cells[4]);
-        InquiryState _state;
-        if (_cells[5] == "RECEIVED") _state = RECEIVED;
-        else if (_cells[5] == "QUOTED") _state = QUOTED;
-        else if (_cells[5] == "DONE") _state = DONE;
-        else if (_cells[5] == "REJECTED") _state = REJECTED;
-        else if (_cells[5] == "CUSTOMER_REJECTED") _state = CUSTOMER_REJECTED;
-        T _product = GetBond(_productId);
-        Inquiry<T> _inquiry(_inquiryId, _product, _side, _quantity, _price, _state);
-        service->OnMessage(_inquiry);
+        SplitRow(_line, _cells);
+        ParseRow(_cells, _handler);
     }
 }
 
+template<typename T>
+void InquiryConnector<T>::Subscribe(const MappedFile& _data_in)
+{
+    Parse(_data_in, [this](Inquiry<T>& _inquiry) { service->OnMessage(_inquiry); });
+}
+
+template<typename T>
+template<typename F>
+void InquiryConnector<T>::Parse(const MappedFile& _data_in, F&& _handler)
+{
+    _data_in.ForEachRow([this, &_handler](const CsvRow& _cells) { ParseRow(_cells, _handler); });
+}
+
+template<typename T>
+template<typename F>
+void InquiryConnector<T>::ParseRow(const CsvRow& _cells, F& _handler)
+{
+    string _inquiryId(_cells[0]);
+    Side _side;
+    if (_cells[2] == "BUY") _side = BUY;
+    else if (_cells[2] == "SELL") _side = SELL;
+    long _quantity = ParseLong(_cells[3]);
+    double _price = ConvertPrice(_cells[4]);
+    InquiryState _state;
+    if (_cells[5] == "RECEIVED") _state = RECEIVED;
+    else if (_cells[5] == "QUOTED") _state = QUOTED;
+    else if (_cells[5] == "DONE") _state = DONE;
+    else if (_cells[5] == "REJECTED") _state = REJECTED;
+    else if (_cells[5] == "CUSTOMER_REJECTED") _state = CUSTOMER_REJECTED;
+    const T& _product = GetBond(_cells[1]);
+    Inquiry<T> _inquiry(_inquiryId, _product, _side, _quantity, _price, _state);
+    _handler(_inquiry);
+}
+
 #endif
 
@@ -0,0 +1,382 @@
+/**
+ * journal.hpp
+ * Defines the binary journal format of the historical data.
+ *
+ * A journal starts with a 12 byte header: the magic "MTHJ", a uint16 format version,
+ * a uint16 ServiceType and 4 reserved bytes.
+ * Every record follows as a uint8 kind and its fields. A data record is an int64 time stamp in nanoseconds
+ * since the epoch and the fields of the persisted type in a fixed order and layout.
+ * Products and books are written as uint16 indexes. The CUSIP of a product and the name of a book are declared
+ * by a product or book record ahead of the first data record of the session using them, so a journal
+ * appended to by several sessions reads back with the indexes of each one.
+ * IDs are ID_SIZE bytes padded with zeros, enums and flags are uint8, prices are int32 ticks floored to the
+ * 1/256 grid as the text format writes them, order quantities are int32, positions are int64 and PV01s are
+ * doubles, all in host byte order.
+ */
+#ifndef JOURNAL_HPP
+#define JOURNAL_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include "algoexecutionservice.hpp"
+#include "algostreamingservice.hpp"
+#include "riskservice.hpp"
+#include "inquiryservice.hpp"
+
+using namespace std;
+
+const char JOURNAL_MAGIC[4] = { 'M', 'T', 'H', 'J' };
+const uint16_t JOURNAL_VERSION = 3; // 2 adds the venue of the execution orders, 3 the fixed layout
+const size_t JOURNAL_HEADER_SIZE = 12;
+
+// kinds of the records
+const uint8_t JOURNAL_DATA = 0;
+const uint8_t JOURNAL_PRODUCT = 1;
+const uint8_t JOURNAL_BOOK = 2;
+
+// index written for a product or book the journal cannot hold
+const uint16_t JOURNAL_NO_INDEX = 0xFFFF;
+
+// build the header of a journal of this service type
+string MakeJournalHeader(uint16_t _serviceType)
+{
+    string _header(JOURNAL_HEADER_SIZE, '\0');
+    memcpy(&_header[0], JOURNAL_MAGIC, 4);
+    memcpy(&_header[4], &JOURNAL_VERSION, 2);
+    memcpy(&_header[6], &_serviceType, 2);
+    return _header;
+}
+
+/**
+ * One journal record being built, the buffer is reused from record to record.
+ * The products and books declared so far are those of the session, one record per journal.
+ */
+class JournalRecord
+{
+public:
+    // Start a new data record time stamped _nanos
+    void Start(int64_t _nanos) { data.clear(); Put(JOURNAL_DATA); Put(_nanos); }
+
+    // Append a fixed size field
+    template<typename I>
+    void Put(I _value) { data.append(reinterpret_cast<const char*>(&_value), sizeof(I)); }
+
+    // Append an ID as ID_SIZE bytes, padded with zeros or truncated
+    void PutId(const string& _value);
+
+    // Append a price as int32 ticks
+    void PutPrice(double _price) { Put((int32_t)floor(_price * TICKS_PER_UNIT)); }
+
+    // Append the index of a product, declaring its ID ahead of the record on first use
+    void PutProduct(ProductIndex _index, const string& _productId);
+
+    // Append the index of a book, declaring its name ahead of the record on first use
+    void PutBook(BookIndex _book);
+
+    // Get the whole record, preceded by its declarations
+    string_view Finish() { return string_view(data); }
+private:
+    string data;
+    vector<bool> products; // declared in this session
+    vector<bool> books;
+
+    // Declare a name ahead of the data record when _declared does not have _index yet
+    bool Declare(vector<bool>& _declared, size_t _index, uint8_t _kind, const string& _name);
+};
+
+void JournalRecord::PutId(const string& _value)
+{
+    size_t _size = min(_value.size(), ID_SIZE);
+    data.append(_value.data(), _size);
+    data.append(ID_SIZE - _size, '\0');
+}
+
+bool JournalRecord::Declare(vector<bool>& _declared, size_t _index, uint8_t _kind, const string& _name)
+{
+    if (_index >= JOURNAL_NO_INDEX) return false;
+    if (_index < _declared.size() && _declared[_index]) return true;
+    if (_index >= _declared.size()) _declared.resize(_index + 1, false);
+    _declared[_index] = true;
+
+    // uint8 kind, uint16 index, uint8 length and the name, names are at most 255 bytes
+    uint16_t _index16 = (uint16_t)_index;
+    uint8_t _size = (uint8_t)min(_name.size(), (size_t)255);
+    string _declaration(1, (char)_kind);
+    _declaration.append(reinterpret_cast<const char*>(&_index16), 2);
+    _declaration.append(1, (char)_size);
+    _declaration.append(_name.data(), _size);
+    data.insert(0, _declaration);
+    return true;
+}
+
+void JournalRecord::PutProduct(ProductIndex _index, const string& _productId)
+{
+    Put(Declare(products, _index, JOURNAL_PRODUCT, _productId) ? (uint16_t)_index : JOURNAL_NO_INDEX);
+}
+
+void JournalRecord::PutBook(BookIndex _book)
+{
+    Put(Declare(books, _book, JOURNAL_BOOK, GetBookCatalog().GetName(_book)) ? (uint16_t)_book : JOURNAL_NO_INDEX);
+}
+
+/**
+ * The products and books declared so far in a journal being read.
+ */
+struct JournalTables
+{
+    vector<string> products;
+    vector<string> books;
+};
+
+/**
+ * Cursor reading the fields of a journal, every Get returns false once the data runs out.
+ */
+class JournalCursor
+{
+public:
+    JournalCursor(string_view _data) : data(_data) {}
+
+    template<typename I>
+    bool Get(I& _value);
+    bool GetString(string& _value);
+
+    // Get an ID of ID_SIZE bytes, without its padding
+    bool GetId(string& _value);
+
+    // Get a price written in ticks
+    bool GetPrice(double& _price);
+
+    // Get the ID of a product or the name of a book written as an index, empty if it was never declared
+    bool GetProduct(const JournalTables& _tables, string& _productId) { return GetName(_tables.products, _productId); }
+    bool GetBook(const JournalTables& _tables, string& _book) { return GetName(_tables.books, _book); }
+
+    // Read the declaration of a record of this kind into _tables, false for a data record or malformed one
+    bool GetDeclaration(uint8_t _kind, JournalTables& _tables);
+
+    size_t Remaining() const { return data.size(); }
+private:
+    string_view data;
+
+    bool GetName(const vector<string>& _names, string& _name);
+};
+
+template<typename I>
+bool JournalCursor::Get(I& _value)
+{
+    if (data.size() < sizeof(I)) return false;
+    memcpy(&_value, data.data(), sizeof(I));
+    data.remove_prefix(sizeof(I));
+    return true;
+}
+
+bool JournalCursor::GetString(string& _value)
+{
+    uint8_t _size;
+    if (!Get(_size) || data.size() < _size) return false;
+    _value.assign(data.data(), _size);
+    data.remove_prefix(_size);
+    return true;
+}
+
+bool JournalCursor::GetId(string& _value)
+{
+    if (data.size() < ID_SIZE) return false;
+    string_view _id = data.substr(0, ID_SIZE);
+    _value.assign(_id.data(), min(_id.find('\0'), ID_SIZE));
+    data.remove_prefix(ID_SIZE);
+    return true;
+}
+
+bool JournalCursor::GetPrice(double& _price)
+{
+    int32_t _ticks;
+    if (!Get(_ticks)) return false;
+    _price = TicksToPrice(_ticks);
+    return true;
+}
+
+bool JournalCursor::GetName(const vector<string>& _names, string& _name)
+{
+    uint16_t _index;
+    if (!Get(_index)) return false;
+    if (_index < _names.size()) _name = _names[_index];
+    else _name.clear();
+    return true;
+}
+
+bool JournalCursor::GetDeclaration(uint8_t _kind, JournalTables& _tables)
+{
+    if (_kind != JOURNAL_PRODUCT && _kind != JOURNAL_BOOK) return false;
+    uint16_t _index;
+    string _name;
+    if (!(Get(_index) && GetString(_name))) return false;
+    vector<string>& _names = _kind == JOURNAL_PRODUCT ? _tables.products : _tables.books;
+    if (_index >= _names.size()) _names.resize(_index + 1);
+    _names[_index] = _name;
+    return true;
+}
+
+// encode the fields of the persisted types
+
+void PutRecord(JournalRecord& _record, const PriceStreamOrder& _order)
+{
+    _record.PutPrice(_order.GetPrice());
+    _record.Put((int32_t)_order.GetVisibleQuantity());
+    _record.Put((int32_t)_order.GetHiddenQuantity());
+    _record.Put((uint8_t)_order.GetSide());
+}
+
+template<typename T>
+void PutRecord(JournalRecord& _record, const PriceStream<T>& _data)
+{
+    _record.PutProduct(_data.GetProduct().GetProductIndex(), _data.GetProduct().GetProductId());
+    PutRecord(_record, _data.GetBidOrder());
+    PutRecord(_record, _data.GetOfferOrder());
+}
+
+template<typename T>
+void PutRecord(JournalRecord& _record, const ExecutionOrder<T>& _data)
+{
+    _record.PutProduct(_data.GetProduct().GetProductIndex(), _data.GetProduct().GetProductId());
+    _record.Put((uint8_t)_data.GetPricingSide());
+    _record.PutId(_data.GetOrderId());
+    _record.Put((uint8_t)_data.GetOrderType());
+    _record.PutPrice(_data.GetPrice());
+    _record.Put((int32_t)_data.GetVisibleQuantity());
+    _record.Put((int32_t)_data.GetHiddenQuantity());
+    _record.PutId(_data.GetParentOrderId());
+    _record.Put((uint8_t)_data.IsChildOrder());
+    _record.Put((uint8_t)_data.GetMarket());
+}
+
+template<typename T>
+void PutRecord(JournalRecord& _record, const Position<T>& _data)
+{
+    _record.PutProduct(_data.GetProduct().GetProductIndex(), _data.GetProduct().GetProductId());
+    _record.Put((uint8_t)min(_data.GetBookCount(), (size_t)255));
+    for (size_t i = 0; i < _data.GetBookCount() && i < 255; ++i)
+    {
+        BookIndex _book = _data.GetBook(i);
+        _record.PutBook(_book);
+        _record.Put((int64_t)_data.GetPosition(_book));
+    }
+}
+
+template<typename T>
+void PutRecord(JournalRecord& _record, const PV01<T>& _data)
+{
+    _record.PutProduct(_data.GetProduct().GetProductIndex(), _data.GetProduct().GetProductId());
+    _record.Put(_data.GetPV01());
+    _record.Put((int64_t)_data.GetQuantity());
+}
+
+// the sectors are written as their RiskBucket
+template<typename T>
+void PutRecord(JournalRecord& _record, const PV01<BucketedSector<T> >& _data)
+{
+    uint8_t _bucket = 0;
+    while (_bucket < RISK_BUCKET_COUNT && GetRiskBucketName((RiskBucket)_bucket) != _data.GetProduct().GetName()) ++_bucket;
+    _record.Put(_bucket);
+    _record.Put(_data.GetPV01());
+    _record.Put((int64_t)_data.GetQuantity());
+}
+
+template<typename T>
+void PutRecord(JournalRecord& _record, const Inquiry<T>& _data)
+{
+    _record.PutId(_data.GetInquiryId());
+    _record.PutProduct(_data.GetProduct().GetProductIndex(), _data.GetProduct().GetProductId());
+    _record.Put((uint8_t)_data.GetSide());
+    _record.Put((int32_t)_data.GetQuantity());
+    _record.PutPrice(_data.GetPrice());
+    _record.Put((uint8_t)_data.GetState());
+}
+
+// decode the fields of the persisted types, the products are looked up in the catalog
+
+bool GetRecord(JournalCursor& _cursor, PriceStreamOrder& _order)
+{
+    double _price;
+    int32_t _visibleQuantity, _hiddenQuantity;
+    uint8_t _side;
+    if (!(_cursor.GetPrice(_price) && _cursor.Get(_visibleQuantity) && _cursor.Get(_hiddenQuantity) && _cursor.Get(_side))) return false;
+    _order = PriceStreamOrder(_price, _visibleQuantity, _hiddenQuantity, (PricingSide)_side);
+    return true;
+}
+
+bool GetRecord(JournalCursor& _cursor, const JournalTables& _tables, PriceStream<Bond>& _data)
+{
+    string _productId;
+    PriceStreamOrder _bidOrder, _offerOrder;
+    if (!(_cursor.GetProduct(_tables, _productId) && GetRecord(_cursor, _bidOrder) && GetRecord(_cursor, _offerOrder))) return false;
+    _data = PriceStream<Bond>(GetBond(_productId), _bidOrder, _offerOrder);
+    return true;
+}
+
+bool GetRecord(JournalCursor& _cursor, const JournalTables& _tables, ExecutionOrder<Bond>& _data)
+{
+    string _productId, _orderId, _parentOrderId;
+    uint8_t _side, _orderType, _isChildOrder, _market;
+    double _price;
+    int32_t _visibleQuantity, _hiddenQuantity;
+    if (!(_cursor.GetProduct(_tables, _productId) && _cursor.Get(_side) && _cursor.GetId(_orderId) && _cursor.Get(_orderType)
+          && _cursor.GetPrice(_price) && _cursor.Get(_visibleQuantity) && _cursor.Get(_hiddenQuantity)
+          && _cursor.GetId(_parentOrderId) && _cursor.Get(_isChildOrder) && _cursor.Get(_market))) return false;
+    _data = ExecutionOrder<Bond>(GetBond(_productId), (PricingSide)_side, _orderId, (OrderType)_orderType, _price, _visibleQuantity, _hiddenQuantity, _parentOrderId, _isChildOrder != 0, (Market)_market);
+    return true;
+}
+
+bool GetRecord(JournalCursor& _cursor, const JournalTables& _tables, Position<Bond>& _data)
+{
+    string _productId;
+    uint8_t _count;
+    if (!(_cursor.GetProduct(_tables, _productId) && _cursor.Get(_count))) return false;
+    _data = Position<Bond>(GetBond(_productId));
+    for (uint8_t i = 0; i < _count; ++i)
+    {
+        string _book;
+        int64_t _position;
+        if (!(_cursor.GetBook(_tables, _book) && _cursor.Get(_position))) return false;
+        _data.AddPosition(_book, _position);
+    }
+    return true;
+}
+
+bool GetRecord(JournalCursor& _cursor, const JournalTables& _tables, PV01<Bond>& _data)
+{
+    string _productId;
+    double _pv01;
+    int64_t _quantity;
+    if (!(_cursor.GetProduct(_tables, _productId) && _cursor.Get(_pv01) && _cursor.Get(_quantity))) return false;
+    _data = PV01<Bond>(GetBond(_productId), _pv01, _quantity);
+    return true;
+}
+
+bool GetRecord(JournalCursor& _cursor, const JournalTables& _tables, PV01<BucketedSector<Bond> >& _data)
+{
+    uint8_t _bucket;
+    double _pv01;
+    int64_t _quantity;
+    if (!(_cursor.Get(_bucket) && _cursor.Get(_pv01) && _cursor.Get(_quantity))) return false;
+    string _name = _bucket < RISK_BUCKET_COUNT ? GetRiskBucketName((RiskBucket)_bucket) : "";
+    _data = PV01<BucketedSector<Bond> >(BucketedSector<Bond>(vector<Bond>(), _name), _pv01, _quantity);
+    return true;
+}
+
+bool GetRecord(JournalCursor& _cursor, const JournalTables& _tables, Inquiry<Bond>& _data)
+{
+    string _inquiryId, _productId;
+    uint8_t _side, _state;
+    int32_t _quantity;
+    double _price;
+    if (!(_cursor.GetId(_inquiryId) && _cursor.GetProduct(_tables, _productId) && _cursor.Get(_side)
+          && _cursor.Get(_quantity) && _cursor.GetPrice(_price) && _cursor.Get(_state))) return false;
+    _data = Inquiry<Bond>(_inquiryId, GetBond(_productId), (Side)_side, _quantity, _price, (InquiryState)_state);
+    return true;
+}
+
+#endif
@@ -0,0 +1,132 @@
+//
+//  journalreader.cpp
+//  tradingsystem
+//
+//  Converts a binary journal written with "--journal" back to the text format
+//  of positions.txt, risk.txt, executions.txt, streaming.txt, allinquiries.txt or bucketedrisk.txt.
+//
+//  usage: journalreader <journal> [products file]
+//
+
+#include <iostream>
+#include <string>
+#include <map>
+#include <fstream>
+
+using namespace std;
+#include <stdio.h>
+#include "products.hpp"
+#include "tools.hpp"
+#include "soa.hpp"
+#include "filereader.hpp"
+#include "productcatalog.hpp"
+#include "pricingservice.hpp"
+#include "algostreamingservice.hpp"
+#include "streamingservice.hpp"
+#include "marketdataservice.hpp"
+#include "algoexecutionservice.hpp"
+#include "executionservice.hpp"
+#include "tradebookingservice.hpp"
+#include "positionservice.hpp"
+#include "riskservice.hpp"
+#include "inquiryservice.hpp"
+#include "historicaldataservice.hpp"
+
+// print every data record of the journal as a text line, returns false if a record is malformed
+template<typename V>
+bool PrintRecords(JournalCursor& _journal)
+{
+    V _data;
+    JournalTables _tables;
+    while (_journal.Remaining() > 0)
+    {
+        uint8_t _kind;
+        if (!_journal.Get(_kind)) return false;
+        // the products and books are declared ahead of the records using them
+        if (_kind != JOURNAL_DATA)
+        {
+            if (!_journal.GetDeclaration(_kind, _tables)) return false;
+            continue;
+        }
+        int64_t _nanos;
+        if (!(_journal.Get(_nanos) && GetRecord(_journal, _tables, _data))) return false;
+
+        system_clock::time_point _time(duration_cast<system_clock::duration>(nanoseconds(_nanos)));
+        cout << PrintTimeStamp(_time) << ",";
+        vector<string> _strings = _data.ToStrings();
+        for (auto s = _strings.begin(); s != _strings.end(); ++s)
+            cout << *s << ",";
+        cout << '\n';
+    }
+    return true;
+}
+
+int main(int argc, const char * argv[])
+{
+    if (argc < 2)
+    {
+        cerr << "usage: " << argv[0] << " <journal> [products file]" << endl;
+        return 1;
+    }
+    string _products = argc > 2 ? argv[2] : "products.txt";
+    if (!GetProductCatalog().Load(_products))
+    {
+        cerr << "failed to read " << _products << endl;
+        return 1;
+    }
+
+    MappedFile _file(argv[1]);
+    if (!_file.IsOpen())
+    {
+        cerr << "failed to read " << argv[1] << endl;
+        return 1;
+    }
+
+    // check the header
+    JournalCursor _journal(_file.GetData());
+    char _magic[4];
+    uint16_t _version, _type;
+    uint32_t _reserved;
+    if (!(_journal.Get(_magic) && _journal.Get(_version) && _journal.Get(_type) && _journal.Get(_reserved))
+        || memcmp(_magic, JOURNAL_MAGIC, 4) != 0)
+    {
+        cerr << argv[1] << " is not a journal" << endl;
+        return 1;
+    }
+    // the layouts of the records change from version to version
+    if (_version != JOURNAL_VERSION)
+    {
+        cerr << argv[1] << " has format version " << _version << ", this reader knows version " << JOURNAL_VERSION << endl;
+        return 1;
+    }
+
+    bool _ok = false;
+    switch ((ServiceType)_type)
+    {
+        case POSITION:
+            _ok = PrintRecords<Position<Bond> >(_journal);
+            break;
+        case RISK:
+            _ok = PrintRecords<PV01<Bond> >(_journal);
+            break;
+        case EXECUTION:
+            _ok = PrintRecords<ExecutionOrder<Bond> >(_journal);
+            break;
+        case STREAMING:
+            _ok = PrintRecords<PriceStream<Bond> >(_journal);
+            break;
+        case INQUIRY:
+            _ok = PrintRecords<Inquiry<Bond> >(_journal);
+            break;
+        case BUCKETED_RISK:
+            _ok = PrintRecords<PV01<BucketedSector<Bond> > >(_journal);
+            break;
+    }
+    cout.flush();
+    if (!_ok)
+    {
+        cerr << argv[1] << " has a malformed record" << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -10,12 +10,19 @@
 #include <string>
 #include <map>
 #include <fstream>
+#include <memory>
 
 using namespace std;
 #include <stdio.h>
 #include "products.hpp"
 #include "tools.hpp"
 #include "soa.hpp"
+#include "filereader.hpp"
+#include "productcatalog.hpp"
+#include "pipeline.hpp"
+#include "queuedlistener.hpp"
+#include "persistencethread.hpp"
+#include "scheduler.hpp"
 
 // lane 1
 #include "pricingservice.hpp"
@@ -26,9 +33,11 @@ using namespace std;
 #include "marketdataservice.hpp"
 #include "algoexecutionservice.hpp"
 #include "executionservice.hpp"
+#include "matchingengine.hpp"
 // lane 3
 #include "tradebookingservice.hpp"
 #include "positionservice.hpp"
+#include "bondanalytics.hpp"
 #include "riskservice.hpp"
 // lane 4
 #include "inquiryservice.hpp"
@@ -38,6 +47,49 @@ using namespace std;
 
 int main(int argc, const char * argv[])
 {
+    // with "--async" every lane runs on its own threads, see pipeline.hpp for the threading contract
+    // with "--parallel" the services run on a pool of workers, the products in parallel, see pipeline.hpp for the threading contract
+    // with "--static" the lanes run in order through a graph wired at compile time
+    // with "--journal" the historical data is persisted as binary journals, see journalreader.cpp to read them back
+    // with "--conflate" in asynchronous mode the algo execution only sees the latest order book of every product
+    // with "--simulate" the execution orders are matched by a local matching engine and the trades are booked from its fills
+    // with "--updates" the order books are built from the incremental updates of marketupdates.txt instead of the snapshots of marketdata.txt
+    bool _async = false;
+    bool _static = false;
+    bool _journal = false;
+    bool _updates = false;
+    bool _conflate = false;
+    bool _simulate = false;
+    bool _parallel = false;
+    for (int i = 1; i < argc; ++i)
+    {
+        string _arg = argv[i];
+        if (_arg == "--async") _async = true;
+        else if (_arg == "--static") _static = true;
+        else if (_arg == "--journal") _journal = true;
+        else if (_arg == "--updates") _updates = true;
+        else if (_arg == "--conflate") _conflate = true;
+        else if (_arg == "--simulate") _simulate = true;
+        else if (_arg == "--parallel") _parallel = true;
+    }
+    if (_parallel)
+    {
+        _async = true; // persisted by the background thread, the workers are its producers
+        _static = _conflate = _simulate = false;
+    }
+    if (_simulate) _static = _conflate = false; // the matching engine sees every book, on the thread of lane 2
+    if (_static) _async = false; // the static graph runs the lanes in order
+    PersistFormat _format = _journal ? BINARY_FORMAT : TEXT_FORMAT;
+    
+    // load the reference data
+    cout << PrintTimeStamp() << " start to load the product catalog" << endl;
+    if (!GetProductCatalog().Load("products.txt"))
+    {
+        cout << PrintTimeStamp() << " failed to read products.txt" << endl;
+        return 1;
+    }
+    cout << PrintTimeStamp() << " finished! " << GetProductCatalog().Size() << " products" << endl;
+    
     // initialize all the services
     // lane 1
     cout << PrintTimeStamp() << " start to initialize all the services" << endl;
@@ -49,57 +101,292 @@ int main(int argc, const char * argv[])
     MarketDataService<Bond> marketDataService;
     AlgoExecutionService<Bond> algoExecutionService;
     ExecutionService<Bond> executionService;
+    MatchingEngine<Bond> matchingEngine;
     // lane 3
     TradeBookingService<Bond> tradeBookingService;
     PositionService<Bond> positionService;
     RiskService<Bond> riskService;
+    BondAnalyticsToPricingListener bondAnalyticsListener(&GetBondAnalytics()); // lane 1 sets the mids the risk of lane 3 reads
     // lane 4
     InquiryService<Bond> inquiryService;
     // lane combination
-    HistoricalDataService<PriceStream<Bond> > historicalStreamingService(STREAMING);
-    HistoricalDataService<ExecutionOrder<Bond> > historicalExecutionService(EXECUTION);
-    HistoricalDataService<Position<Bond> > historicalPositionService(POSITION);
-    HistoricalDataService<PV01<Bond> > historicalRiskService(RISK);
-    HistoricalDataService<Inquiry<Bond> > historicalInquiryService(INQUIRY);
+    HistoricalDataService<PriceStream<Bond> > historicalStreamingService(STREAMING, _format);
+    HistoricalDataService<ExecutionOrder<Bond> > historicalExecutionService(EXECUTION, _format);
+    HistoricalDataService<Position<Bond> > historicalPositionService(POSITION, _format);
+    HistoricalDataService<PV01<Bond> > historicalRiskService(RISK, _format);
+    HistoricalDataService<PV01<BucketedSector<Bond> > > historicalBucketedRiskService(BUCKETED_RISK, _format);
+    HistoricalDataService<Inquiry<Bond> > historicalInquiryService(INQUIRY, _format);
     cout << PrintTimeStamp() << " finished!" << endl;
     
     // link all the services
     cout << PrintTimeStamp() << " start to link all the services" << endl;
+    // in parallel mode the callbacks run on the workers of the scheduler, one key per product then one per serial service
+    TaskScheduler scheduler(GetProductCatalog().Size() + 3);
+    const size_t _bookingKey = GetProductCatalog().Size(); // trade booking, position and risk aggregate across products
+    const size_t _inquiryKey = _bookingKey + 1;
+    const size_t _guiKey = _bookingKey + 2; // the GUI throttles across products
     // lane 1
+    pricingService.AddListener(&bondAnalyticsListener);
+    // the risk of lane 3 is revalued on the price ticks, once the analytics have the mid
+    Pipe<Price<Bond> > riskPricePipe; // cross lane in asynchronous mode, drained by lane 3
+    PipeListener<Price<Bond> > riskPricePipeListener(&riskPricePipe);
+    ScheduledListener<Price<Bond> > scheduledRiskPriceListener(riskService.GetPricingListener(), &scheduler, _bookingKey);
+    if (_parallel) pricingService.AddListener(&scheduledRiskPriceListener);
+    else if (_async) pricingService.AddListener(&riskPricePipeListener);
+    else pricingService.AddListener(riskService.GetPricingListener()); // cross lane
     pricingService.AddListener(algoStreamingService.GetListener());
-    pricingService.AddListener(guiService.GetListener());
+    // in parallel mode the products run in any interleaving, the sizes and sides alternate per product
+    algoStreamingService.SetPerProduct(_parallel);
+    algoExecutionService.SetPerProduct(_parallel);
+    ScheduledListener<Price<Bond> > scheduledGuiListener(guiService.GetListener(), &scheduler, _guiKey);
+    // in asynchronous mode the GUI only needs the latest price of every product
+    unique_ptr<QueuedListener<Price<Bond> > > queuedGuiListener;
+    if (_parallel) pricingService.AddListener(&scheduledGuiListener);
+    else if (_async)
+    {
+        queuedGuiListener.reset(new QueuedListener<Price<Bond> >(guiService.GetListener(), 4096, CONFLATE));
+        pricingService.AddListener(queuedGuiListener.get());
+    }
+    else pricingService.AddListener(guiService.GetListener());
     algoStreamingService.AddListener(streamingService.GetListener());
     // lane 2
-    marketDataService.AddListener(algoExecutionService.GetListener());
+    // the matching engine gets every book before the algo execution trades on it
+    if (_simulate) marketDataService.AddListener(matchingEngine.GetMarketDataListener());
+    // a conflated algo execution runs on the drain thread of its queue, which replaces lane 2 as producer of the cross lane pipe
+    unique_ptr<QueuedListener<OrderBook<Bond> > > queuedMarketDataListener;
+    if (_async && _conflate)
+    {
+        queuedMarketDataListener.reset(new QueuedListener<OrderBook<Bond> >(algoExecutionService.GetListener(), 4096, CONFLATE));
+        marketDataService.AddListener(queuedMarketDataListener.get());
+    }
+    else marketDataService.AddListener(algoExecutionService.GetListener());
     algoExecutionService.AddListener(executionService.GetListener());
     // lane 3
-    executionService.AddListener(tradeBookingService.GetListener()); // cross lane
+    Pipe<ExecutionOrder<Bond> > executionPipe; // cross lane in asynchronous mode, drained by lane 3
+    PipeListener<ExecutionOrder<Bond> > executionPipeListener(&executionPipe);
+    Pipe<Fill<Bond> > fillPipe; // cross lane in asynchronous mode when simulating, drained by lane 3
+    PipeListener<Fill<Bond> > fillPipeListener(&fillPipe);
+    ScheduledListener<ExecutionOrder<Bond> > scheduledExecutionListener(tradeBookingService.GetListener(), &scheduler, _bookingKey);
+    if (_simulate)
+    {
+        // the matching engine runs in lane 2, its fills cross to lane 3
+        executionService.AddListener(matchingEngine.GetExecutionListener());
+        if (_async) matchingEngine.AddListener(&fillPipeListener);
+        else matchingEngine.AddListener(tradeBookingService.GetFillListener()); // cross lane
+    }
+    else if (_parallel) executionService.AddListener(&scheduledExecutionListener);
+    else if (_async) executionService.AddListener(&executionPipeListener);
+    else executionService.AddListener(tradeBookingService.GetListener()); // cross lane
     tradeBookingService.AddListener(positionService.GetListener());
     positionService.AddListener(riskService.GetListener());
     // lane 4
     ;
     // lane combination
+    // in asynchronous mode the records are written by a background thread, off the lanes
+    PersistenceThread persistenceThread;
+    if (_async)
+    {
+        historicalStreamingService.PersistOn(persistenceThread);
+        historicalExecutionService.PersistOn(persistenceThread);
+        historicalPositionService.PersistOn(persistenceThread);
+        historicalRiskService.PersistOn(persistenceThread);
+        historicalBucketedRiskService.PersistOn(persistenceThread);
+        historicalInquiryService.PersistOn(persistenceThread);
+        MonotonicClock::Now(); // calibrate the latency clock before the commits are timed
+        persistenceThread.Start();
+    }
     streamingService.AddListener(historicalStreamingService.GetListener());
     executionService.AddListener(historicalExecutionService.GetListener());
     positionService.AddListener(historicalPositionService.GetListener());
     riskService.AddListener(historicalRiskService.GetListener());
+    riskService.AddBucketListener(historicalBucketedRiskService.GetListener());
     inquiryService.AddListener(historicalInquiryService.GetListener());
     cout << PrintTimeStamp() << " finished!" << endl;
     
     // process data
     cout << PrintTimeStamp() << " start to process input data" << endl;
-    // lane 1
-    ifstream priceData("prices.txt");
-    pricingService.GetConnector()->Subscribe(priceData);
-    // lane 2
-    ifstream marketData("marketdata.txt");
-    marketDataService.GetConnector()->Subscribe(marketData);
-    // lane 3
-    ifstream tradeData("trades.txt");
-    tradeBookingService.GetConnector()->Subscribe(tradeData);
-    // lane 4
-    ifstream inquiryData("inquiries.txt");
-    inquiryService.GetConnector()->Subscribe(inquiryData);
+    MappedFile priceData("prices.txt");
+    MappedFile marketData(_updates ? "marketupdates.txt" : "marketdata.txt");
+    MappedFile tradeData("trades.txt");
+    MappedFile inquiryData("inquiries.txt");
+    if (_static)
+    {
+        // every sink calls the next service directly, so a whole lane inlines without virtual listener calls
+        // the fanouts keep the order in which the listeners are linked above
+        // lane 3
+        auto _persistRisk = [&](PV01<Bond>& _pv01) { historicalRiskService.PersistData(_pv01.GetProduct().GetProductId(), _pv01); };
+        auto _risk = [&](Position<Bond>& _position) { riskService.GetListener()->ProcessAdd(_position, _persistRisk); };
+        auto _riskPrice = [&](Price<Bond>& _price) { riskService.GetPricingListener()->ProcessAdd(_price, _persistRisk); };
+        auto _persistPosition = [&](Position<Bond>& _position) { historicalPositionService.PersistData(_position.GetProduct().GetProductId(), _position); };
+        auto _positionSinks = MakeFanout(_risk, _persistPosition);
+        auto _position = [&](Trade<Bond>& _trade) { positionService.GetListener()->ProcessAdd(_trade, _positionSinks); };
+        auto _tradeBooking = [&](ExecutionOrder<Bond>& _order) { tradeBookingService.GetListener()->ProcessAdd(_order, _position); };
+        // lane 2
+        auto _persistExecution = [&](ExecutionOrder<Bond>& _order) { historicalExecutionService.PersistData(_order.GetProduct().GetProductId(), _order); };
+        auto _executionSinks = MakeFanout(_tradeBooking, _persistExecution);
+        auto _execution = [&](AlgoExecution<Bond>& _algoExecution) { executionService.GetListener()->ProcessAdd(_algoExecution, _executionSinks); };
+        auto _algoExecution = [&](OrderBook<Bond>& _orderBook) { algoExecutionService.GetListener()->ProcessAdd(_orderBook, _execution); };
+        // lane 1
+        auto _persistStreaming = [&](PriceStream<Bond>& _priceStream) { historicalStreamingService.PersistData(_priceStream.GetProduct().GetProductId(), _priceStream); };
+        auto _streaming = [&](AlgoStream<Bond>& _algoStream) { streamingService.GetListener()->ProcessAdd(_algoStream, _persistStreaming); };
+        auto _algoStreaming = [&](Price<Bond>& _price) { algoStreamingService.GetListener()->ProcessAdd(_price, _streaming); };
+        auto _gui = [&](Price<Bond>& _price) { guiService.OnMessage(_price); };
+        auto _bondAnalytics = [&](Price<Bond>& _price) { bondAnalyticsListener.ProcessAdd(_price); };
+        auto _pricingSinks = MakeFanout(_bondAnalytics, _riskPrice, _algoStreaming, _gui);
+        // lane 4
+        auto _persistInquiry = [&](Inquiry<Bond>& _inquiry) { historicalInquiryService.PersistData(_inquiry.GetProduct().GetProductId(), _inquiry); };
+        
+        pricingService.GetConnector()->Parse(priceData, [&](Price<Bond>& _price) { pricingService.OnMessage(_price, _pricingSinks); });
+        if (_updates) marketDataService.GetConnector()->ParseUpdates(marketData, [&](BookUpdate<Bond>& _update) { marketDataService.OnUpdate(_update, _algoExecution); });
+        else marketDataService.GetConnector()->Parse(marketData, [&](OrderBook<Bond>& _orderBook) { marketDataService.OnMessage(_orderBook, _algoExecution); });
+        tradeBookingService.GetConnector()->Parse(tradeData, [&](Trade<Bond>& _trade) { tradeBookingService.OnMessage(_trade, _position); });
+        inquiryService.GetConnector()->Parse(inquiryData, [&](Inquiry<Bond>& _inquiry) { inquiryService.OnMessage(_inquiry, _persistInquiry); });
+    }
+    else if (!_async)
+    {
+        // lane 1
+        pricingService.GetConnector()->Subscribe(priceData);
+        // lane 2
+        if (_updates) marketDataService.GetConnector()->SubscribeUpdates(marketData);
+        else marketDataService.GetConnector()->Subscribe(marketData);
+        // lane 3
+        tradeBookingService.GetConnector()->Subscribe(tradeData);
+        // lane 4
+        inquiryService.GetConnector()->Subscribe(inquiryData);
+    }
+    else if (_parallel)
+    {
+        // one reader per input file posts every record on the key of its product, or of its serial service
+        scheduler.Start();
+        thread priceReader([&]() {
+            pricingService.GetConnector()->Parse(priceData, [&](Price<Bond>& _price) {
+                scheduler.Post(_price.GetProduct().GetProductIndex(), [&pricingService, _price]() mutable { pricingService.OnMessage(_price); });
+            });
+        });
+        thread marketDataReader([&]() {
+            if (_updates) marketDataService.GetConnector()->ParseUpdates(marketData, [&](BookUpdate<Bond>& _update) {
+                scheduler.Post(_update.GetProduct().GetProductIndex(), [&marketDataService, _update]() mutable { marketDataService.OnUpdate(_update); });
+            });
+            else marketDataService.GetConnector()->Parse(marketData, [&](OrderBook<Bond>& _orderBook) {
+                scheduler.Post(_orderBook.GetProduct().GetProductIndex(), [&marketDataService, _orderBook]() mutable { marketDataService.OnMessage(_orderBook); });
+            });
+        });
+        thread tradeReader([&]() {
+            tradeBookingService.GetConnector()->Parse(tradeData, [&](Trade<Bond>& _trade) {
+                scheduler.Post(_bookingKey, [&tradeBookingService, _trade]() mutable { tradeBookingService.OnMessage(_trade); });
+            });
+        });
+        thread inquiryReader([&]() {
+            inquiryService.GetConnector()->Parse(inquiryData, [&](Inquiry<Bond>& _inquiry) {
+                scheduler.Post(_inquiryKey, [&inquiryService, _inquiry]() mutable { inquiryService.OnMessage(_inquiry); });
+            });
+        });
+        
+        priceReader.join();
+        marketDataReader.join();
+        tradeReader.join();
+        inquiryReader.join();
+        // the tasks post the execution orders and the GUI updates, the scheduler drains them too
+        scheduler.Stop();
+        SchedulerStats _schedulerStats = scheduler.GetStats();
+        cout << PrintTimeStamp() << " ran " << _schedulerStats.tasks << " tasks on " << scheduler.GetWorkerCount() << " workers, "
+             << _schedulerStats.steals << " stolen" << endl;
+    }
+    else
+    {
+        // one worker per lane drives its services
+        Pipe<Price<Bond> > pricePipe;
+        Pipe<OrderBook<Bond> > marketDataPipe;
+        Pipe<BookUpdate<Bond> > marketUpdatePipe;
+        Pipe<Trade<Bond> > tradePipe;
+        Pipe<Inquiry<Bond> > inquiryPipe;
+        LaneWorker lane1, lane2, lane3, lane4;
+        lane1.AddSource(pricePipe, [&](Price<Bond>& _price) { pricingService.OnMessage(_price); });
+        lane2.AddSource(marketDataPipe, [&](OrderBook<Bond>& _orderBook) { marketDataService.OnMessage(_orderBook); });
+        lane2.AddSource(marketUpdatePipe, [&](BookUpdate<Bond>& _update) { marketDataService.OnUpdate(_update); });
+        lane3.AddSource(tradePipe, [&](Trade<Bond>& _trade) { tradeBookingService.OnMessage(_trade); });
+        lane3.AddSource(executionPipe, [&](ExecutionOrder<Bond>& _order) { tradeBookingService.GetListener()->ProcessAdd(_order); });
+        lane3.AddSource(fillPipe, [&](Fill<Bond>& _fill) { tradeBookingService.GetFillListener()->ProcessAdd(_fill); });
+        lane3.AddSource(riskPricePipe, [&](Price<Bond>& _price) { riskService.GetPricingListener()->ProcessAdd(_price); });
+        lane4.AddSource(inquiryPipe, [&](Inquiry<Bond>& _inquiry) { inquiryService.OnMessage(_inquiry); });
+        lane1.Start();
+        lane2.Start();
+        lane3.Start();
+        lane4.Start();
+        
+        // one reader per input file
+        thread priceReader([&]() {
+            pricingService.GetConnector()->Parse(priceData, [&](Price<Bond>& _price) { pricePipe.Push(_price); });
+            pricePipe.Close();
+        });
+        thread marketDataReader([&]() {
+            if (_updates) marketDataService.GetConnector()->ParseUpdates(marketData, [&](BookUpdate<Bond>& _update) { marketUpdatePipe.Push(_update); });
+            else marketDataService.GetConnector()->Parse(marketData, [&](OrderBook<Bond>& _orderBook) { marketDataPipe.Push(_orderBook); });
+            marketDataPipe.Close();
+            marketUpdatePipe.Close();
+        });
+        thread tradeReader([&]() {
+            tradeBookingService.GetConnector()->Parse(tradeData, [&](Trade<Bond>& _trade) { tradePipe.Push(_trade); });
+            tradePipe.Close();
+        });
+        thread inquiryReader([&]() {
+            inquiryService.GetConnector()->Parse(inquiryData, [&](Inquiry<Bond>& _inquiry) { inquiryPipe.Push(_inquiry); });
+            inquiryPipe.Close();
+        });
+        
+        priceReader.join();
+        marketDataReader.join();
+        tradeReader.join();
+        inquiryReader.join();
+        // lane 2 is the only producer of the cross lane pipes
+        lane2.Join();
+        if (queuedMarketDataListener)
+        {
+            queuedMarketDataListener->Stop();
+            cout << PrintTimeStamp() << " conflated " << queuedMarketDataListener->GetConflatedCount() << " order books" << endl;
+        }
+        executionPipe.Close();
+        fillPipe.Close();
+        lane1.Join();
+        riskPricePipe.Close(); // lane 1 is the only producer of the price pipe to lane 3
+        queuedGuiListener->Stop();
+        lane3.Join();
+        lane4.Join();
+    }
+    if (_async)
+    {
+        persistenceThread.Stop();
+        PersistenceStats _stats = persistenceThread.GetStats();
+        cout << PrintTimeStamp() << " persisted " << _stats.records << " records in " << _stats.commits << " commits, "
+             << _stats.GetRecordsPerCommit() << " records per commit (max " << _stats.maxRecordsPerCommit << "), "
+             << _stats.GetAverageCommitNanos() / 1000. << "us per commit (max " << _stats.maxCommitNanos / 1000. << "us), "
+             << "max queue depth " << _stats.maxQueueDepth << endl;
+    }
+    historicalStreamingService.Flush();
+    historicalExecutionService.Flush();
+    historicalPositionService.Flush();
+    historicalRiskService.Flush();
+    historicalBucketedRiskService.Flush();
+    historicalInquiryService.Flush();
+    if (_simulate)
+        cout << PrintTimeStamp() << " matched " << matchingEngine.GetOrderCount() << " orders into " << matchingEngine.GetFillCount() << " fills, "
+             << matchingEngine.GetRestingCount() << " orders resting" << endl;
+    // full revaluation of the final positions under the standard curve scenarios
+    vector<CurveScenario> _scenarios = MakeStandardScenarios();
+    long long _scenarioStart = MonotonicClock::Now();
+    riskService.RunScenarios(_scenarios);
+    double _scenarioMillis = (MonotonicClock::Now() - _scenarioStart) / 1e6;
+    size_t _worst = 0;
+    for (size_t s = 1; s < riskService.GetScenarioCount(); ++s)
+        if (riskService.GetScenarioPnL(s) < riskService.GetScenarioPnL(_worst)) _worst = s;
+    cout << PrintTimeStamp() << " revalued the positions under " << riskService.GetScenarioCount() << " scenarios on "
+         << riskService.GetScenarioThreadCount() << " threads in " << _scenarioMillis << "ms, worst "
+         << riskService.GetScenario(_worst).name << " " << riskService.GetScenarioPnL(_worst) << endl;
+    cout << PrintTimeStamp() << " solved the bond analytics " << GetBondAnalytics().GetSolveCount() << " times" << endl;
+    cout << PrintTimeStamp() << " bucketed PV01";
+    for (size_t b = 0; b < RISK_BUCKET_COUNT; ++b)
+        cout << " " << riskService.GetSector((RiskBucket)b).GetName() << " " << riskService.GetBucketPV01((RiskBucket)b);
+    cout << endl;
     cout << PrintTimeStamp() << " finished" << endl;
     
     // insert code here...
@@ -9,7 +9,14 @@
 
 #include <string>
 #include <vector>
+#include <array>
+#include <algorithm>
+#include <functional>
+#include <climits>
+#include <cmath>
 #include "soa.hpp"
+#include "productcatalog.hpp"
+#include "filereader.hpp"
 
 using namespace std;
 
@@ -69,8 +76,78 @@ private:
 
 };
 
+// Venue quoting an order book
+enum Market { BROKERTEC, ESPEED, CME };
+
+// Number of venues
+const int MARKET_COUNT = 3;
+
+// Parse a venue name, an empty or unknown name is BROKERTEC
+Market ParseMarket(string_view _market)
+{
+    if (_market == "ESPEED") return ESPEED;
+    if (_market == "CME") return CME;
+    return BROKERTEC;
+}
+
+// Get the name of a venue, as ParseMarket reads it
+string GetMarketName(Market _market)
+{
+    switch (_market)
+    {
+        case BROKERTEC:
+            return "BROKERTEC";
+        case ESPEED:
+            return "ESPEED";
+        case CME:
+            return "CME";
+    }
+    return "";
+}
+
+// Action of an incremental order book update
+enum BookAction { ADD_LEVEL, MODIFY_LEVEL, CANCEL_LEVEL };
+
 /**
- * Order book with a bid and offer stack.
+ * An incremental update of one price level of an order book.
+ * The product is referenced, not copied, so it must outlive the update (catalog products do).
+ * Type T is the product type.
+ */
+template<typename T>
+class BookUpdate
+{
+
+public:
+
+  // ctor for an update
+  BookUpdate() = default;
+  BookUpdate(const T &_product, BookAction _action, const Order &_order, Market _market = BROKERTEC) :
+    product(&_product), action(_action), order(_order), market(_market) {}
+
+  // Get the product
+  const T& GetProduct() const { return *product; }
+
+  // Get the action on the price level
+  BookAction GetAction() const { return action; }
+
+  // Get the price, quantity and side of the level
+  const Order& GetOrder() const { return order; }
+
+  // Get the venue of the book
+  Market GetMarket() const { return market; }
+
+private:
+  const T* product = nullptr;
+  BookAction action;
+  Order order;
+  Market market = BROKERTEC;
+
+};
+
+/**
+ * Order book with a bid and offer stack, as quoted on one venue.
+ * The stacks are kept sorted with the best level first: bids by decreasing price, offers by increasing price.
+ * The best bid/offer is cached and refreshed on every change of the stacks, so reading it is a load.
  * Type T is the product type.
  */
 template<typename T>
@@ -79,57 +156,148 @@ class OrderBook
 
 public:
 
-  // ctor for the order book
+  // ctor for the order book, the stacks are sorted keeping the file order of equal prices
     OrderBook() = default; // Robert added default constructor
-  OrderBook(const T &_product, const vector<Order> &_bidStack, const vector<Order> &_offerStack);
+  OrderBook(const T &_product, const vector<Order> &_bidStack, const vector<Order> &_offerStack, Market _market = BROKERTEC);
     ~OrderBook() {} // set empty
   // Get the product
   const T& GetProduct() const;
 
+  // Get the venue
+  Market GetMarket() const { return market; }
+
   // Get the bid stack
   const vector<Order>& GetBidStack() const;
 
   // Get the offer stack
   const vector<Order>& GetOfferStack() const;
 
-    // Robert added: Get the best bid/offer order
-    const BidOffer& GetBidOffer() const;
+    // Robert added: Get the best bid/offer order, an empty side has a zero quantity at INT_MIN (bid) or INT_MAX (offer)
+    BidOffer GetBidOffer() const { return bidOffer; }
+
+    // Add quantity at a price level, creating the level if needed
+    void AddLevel(double _price, long _quantity, PricingSide _side);
+
+    // Set the quantity of a price level, returns false if there is no such level
+    bool ModifyLevel(double _price, long _quantity, PricingSide _side);
+
+    // Remove a price level, returns false if there is no such level
+    bool CancelLevel(double _price, PricingSide _side);
+
+    // Get the quantity of a price level, returns false if there is no such level
+    bool GetLevel(double _price, PricingSide _side, long &_quantity) const;
+
+    // Apply an incremental update, returns whether the book changed
+    bool Apply(const BookUpdate<T> &_update);
+
+    // Empty the book and set its product and venue, keeping the storage of the stacks
+    void Reset(const T &_product, Market _market = BROKERTEC);
 private:
   T product;
+  Market market = BROKERTEC;
   vector<Order> bidStack;
   vector<Order> offerStack;
+    BidOffer bidOffer;
+
+    // Refresh the cached best bid/offer from the tops of the stacks
+    void UpdateBidOffer();
+
+    // Get the stack of a side
+    vector<Order>& GetStack(PricingSide _side) { return _side == BID ? bidStack : offerStack; }
+
+    // Find the first level of the stack at _price or worse
+    template<typename Stack>
+    static auto FindLevel(Stack &_stack, double _price, PricingSide _side) -> decltype(_stack.begin());
 
 };
 
 template<typename T>
-const BidOffer& OrderBook<T>::GetBidOffer() const
+template<typename Stack>
+auto OrderBook<T>::FindLevel(Stack &_stack, double _price, PricingSide _side) -> decltype(_stack.begin())
 {
-    double _bidPrice = INT_MIN;
-    Order _bidOrder;
-    for (auto b = bidStack.begin(); b != bidStack.end(); ++b)
-    {
-        double _price = b->GetPrice();
-        if (_price > _bidPrice)
-        {
-            _bidPrice = _price;
-            _bidOrder = *b;
-        }
-    }
-    
-    double _offerPrice = INT_MAX;
-    Order _offerOrder;
-    for (auto o = offerStack.begin(); o != offerStack.end(); ++o)
+    if (_side == BID)
+        return lower_bound(_stack.begin(), _stack.end(), _price, [](const Order &_order, double _p) { return _order.GetPrice() > _p; });
+    return lower_bound(_stack.begin(), _stack.end(), _price, [](const Order &_order, double _p) { return _order.GetPrice() < _p; });
+}
+
+template<typename T>
+void OrderBook<T>::AddLevel(double _price, long _quantity, PricingSide _side)
+{
+    vector<Order> &_stack = GetStack(_side);
+    auto _level = FindLevel(_stack, _price, _side);
+    if (_level != _stack.end() && _level->GetPrice() == _price)
+        *_level = Order(_price, _level->GetQuantity() + _quantity, _side);
+    else
+        _level = _stack.insert(_level, Order(_price, _quantity, _side));
+    if (_level == _stack.begin()) UpdateBidOffer();
+}
+
+template<typename T>
+bool OrderBook<T>::ModifyLevel(double _price, long _quantity, PricingSide _side)
+{
+    vector<Order> &_stack = GetStack(_side);
+    auto _level = FindLevel(_stack, _price, _side);
+    if (_level == _stack.end() || _level->GetPrice() != _price) return false;
+    *_level = Order(_price, _quantity, _side);
+    if (_level == _stack.begin()) UpdateBidOffer();
+    return true;
+}
+
+template<typename T>
+bool OrderBook<T>::CancelLevel(double _price, PricingSide _side)
+{
+    vector<Order> &_stack = GetStack(_side);
+    auto _level = FindLevel(_stack, _price, _side);
+    if (_level == _stack.end() || _level->GetPrice() != _price) return false;
+    bool _top = _level == _stack.begin();
+    _stack.erase(_level);
+    if (_top) UpdateBidOffer();
+    return true;
+}
+
+template<typename T>
+bool OrderBook<T>::GetLevel(double _price, PricingSide _side, long &_quantity) const
+{
+    const vector<Order> &_stack = _side == BID ? bidStack : offerStack;
+    auto _level = FindLevel(_stack, _price, _side);
+    if (_level == _stack.end() || _level->GetPrice() != _price) return false;
+    _quantity = _level->GetQuantity();
+    return true;
+}
+
+template<typename T>
+void OrderBook<T>::Reset(const T &_product, Market _market)
+{
+    if (product.GetProductId() != _product.GetProductId()) product = _product;
+    market = _market;
+    bidStack.clear();
+    offerStack.clear();
+    UpdateBidOffer();
+}
+
+template<typename T>
+bool OrderBook<T>::Apply(const BookUpdate<T> &_update)
+{
+    const Order &_order = _update.GetOrder();
+    switch (_update.GetAction())
     {
-        double _price = o->GetPrice();
-        if (_price < _offerPrice)
-        {
-            _offerPrice = _price;
-            _offerOrder = *o;
-        }
+        case ADD_LEVEL:
+            AddLevel(_order.GetPrice(), _order.GetQuantity(), _order.GetSide());
+            return true;
+        case MODIFY_LEVEL:
+            return ModifyLevel(_order.GetPrice(), _order.GetQuantity(), _order.GetSide());
+        case CANCEL_LEVEL:
+            return CancelLevel(_order.GetPrice(), _order.GetSide());
     }
-    
-    auto res = BidOffer(_bidOrder, _offerOrder);
-    return res;
+    return false;
+}
+
+template<typename T>
+void OrderBook<T>::UpdateBidOffer()
+{
+    Order _bidOrder = bidStack.empty() ? Order(INT_MIN, 0, BID) : bidStack.front();
+    Order _offerOrder = offerStack.empty() ? Order(INT_MAX, 0, OFFER) : offerStack.front();
+    bidOffer = BidOffer(_bidOrder, _offerOrder);
 }
 
 Order::Order(double _price, long _quantity, PricingSide _side)
@@ -170,9 +338,12 @@ const Order& BidOffer::GetOfferOrder() const
 }
 
 template<typename T>
-OrderBook<T>::OrderBook(const T &_product, const vector<Order> &_bidStack, const vector<Order> &_offerStack) :
-  product(_product), bidStack(_bidStack), offerStack(_offerStack)
+OrderBook<T>::OrderBook(const T &_product, const vector<Order> &_bidStack, const vector<Order> &_offerStack, Market _market) :
+  product(_product), market(_market), bidStack(_bidStack), offerStack(_offerStack)
 {
+    stable_sort(bidStack.begin(), bidStack.end(), [](const Order &_a, const Order &_b) { return _a.GetPrice() > _b.GetPrice(); });
+    stable_sort(offerStack.begin(), offerStack.end(), [](const Order &_a, const Order &_b) { return _a.GetPrice() < _b.GetPrice(); });
+    UpdateBidOffer();
 }
 
 template<typename T>
@@ -194,6 +365,285 @@ const vector<Order>& OrderBook<T>::GetOfferStack() const
 }
 
 
+// Number of price ticks per unit of price, prices are quoted in 1/256
+const long TICKS_PER_UNIT = 256;
+
+// Convert a price on the 1/256 grid to integer ticks
+long PriceToTicks(double _price) { return lround(_price * TICKS_PER_UNIT); }
+
+// Convert integer ticks to a price
+double TicksToPrice(long _ticks) { return (double)_ticks / TICKS_PER_UNIT; }
+
+/**
+ * One side of a book stored as a structure of arrays: the prices in integer ticks and the
+ * quantities in two contiguous arrays, best level first and one level per price.
+ * A level is found by a binary search of the sorted ticks, the depth scans are flat loops over plain
+ * integers with the side tested outside of them.
+ */
+class PriceLadder
+{
+
+public:
+
+  // ctor for an empty side
+  PriceLadder(PricingSide _side = BID) : side(_side) {}
+
+  // Get the side
+  PricingSide GetSide() const { return side; }
+
+  // Get the number of levels
+  size_t Size() const { return ticks.size(); }
+
+  // Get the prices in ticks and the quantities, best level first
+  const long* GetTicks() const { return ticks.data(); }
+  const long* GetQuantities() const { return quantities.data(); }
+
+  // Remove every level, keeping the storage
+  void Clear() { ticks.clear(); quantities.clear(); }
+
+  // Append a level worse than the last one, or merge it into the last one at the same price
+  void PushBack(long _tick, long _quantity);
+
+  // Get the number of levels better than _tick, which is where a level at _tick is or goes
+  size_t CountBetter(long _tick) const;
+
+  // Add quantity at a price level, creating the level if needed
+  void Add(long _tick, long _quantity);
+
+  // Set the quantity of a price level, returns false if there is no such level
+  bool Modify(long _tick, long _quantity);
+
+  // Remove a price level, returns false if there is no such level
+  bool Cancel(long _tick);
+
+  // Get the total quantity of the best _levels levels
+  long GetDepth(size_t _levels) const;
+
+  // Write the running total quantity of the best _levels levels to _cumulative, returns the number written
+  size_t GetCumulativeDepth(long* _cumulative, size_t _levels) const;
+
+  // Get the total quantity at _tick or better
+  long GetQuantityWithin(long _tick) const;
+
+  // Get the average price in ticks of taking _quantity from the best levels down,
+  // returns false if the side holds less than _quantity
+  bool GetSweepTicks(long _quantity, double &_averageTicks) const;
+
+private:
+  PricingSide side;
+  vector<long> ticks;
+  vector<long> quantities;
+
+};
+
+void PriceLadder::PushBack(long _tick, long _quantity)
+{
+    if (!ticks.empty() && ticks.back() == _tick)
+    {
+        quantities.back() += _quantity;
+        return;
+    }
+    ticks.push_back(_tick);
+    quantities.push_back(_quantity);
+}
+
+size_t PriceLadder::CountBetter(long _tick) const
+{
+    // the ticks are sorted best first, descending for the bids and ascending for the offers
+    if (side == BID) return lower_bound(ticks.begin(), ticks.end(), _tick, greater<long>()) - ticks.begin();
+    return lower_bound(ticks.begin(), ticks.end(), _tick) - ticks.begin();
+}
+
+void PriceLadder::Add(long _tick, long _quantity)
+{
+    size_t _level = CountBetter(_tick);
+    if (_level < ticks.size() && ticks[_level] == _tick)
+    {
+        quantities[_level] += _quantity;
+        return;
+    }
+    ticks.insert(ticks.begin() + _level, _tick);
+    quantities.insert(quantities.begin() + _level, _quantity);
+}
+
+bool PriceLadder::Modify(long _tick, long _quantity)
+{
+    size_t _level = CountBetter(_tick);
+    if (_level == ticks.size() || ticks[_level] != _tick) return false;
+    quantities[_level] = _quantity;
+    return true;
+}
+
+bool PriceLadder::Cancel(long _tick)
+{
+    size_t _level = CountBetter(_tick);
+    if (_level == ticks.size() || ticks[_level] != _tick) return false;
+    ticks.erase(ticks.begin() + _level);
+    quantities.erase(quantities.begin() + _level);
+    return true;
+}
+
+long PriceLadder::GetDepth(size_t _levels) const
+{
+    const long* _quantities = quantities.data();
+    size_t _size = min(_levels, quantities.size());
+    long _total = 0;
+    for (size_t i = 0; i < _size; ++i) _total += _quantities[i];
+    return _total;
+}
+
+size_t PriceLadder::GetCumulativeDepth(long* _cumulative, size_t _levels) const
+{
+    const long* _quantities = quantities.data();
+    size_t _size = min(_levels, quantities.size());
+    long _total = 0;
+    for (size_t i = 0; i < _size; ++i)
+    {
+        _total += _quantities[i];
+        _cumulative[i] = _total;
+    }
+    return _size;
+}
+
+long PriceLadder::GetQuantityWithin(long _tick) const
+{
+    // the levels at _tick or better are the first ones
+    size_t _levels = CountBetter(_tick);
+    if (_levels < ticks.size() && ticks[_levels] == _tick) ++_levels;
+    return GetDepth(_levels);
+}
+
+bool PriceLadder::GetSweepTicks(long _quantity, double &_averageTicks) const
+{
+    if (_quantity <= 0) return false;
+    const long* _ticks = ticks.data();
+    const long* _quantities = quantities.data();
+    size_t _size = ticks.size();
+
+    // levels taken whole, then the notional of those levels in one pass
+    size_t _full = 0;
+    long _taken = 0;
+    while (_full < _size && _taken + _quantities[_full] <= _quantity) _taken += _quantities[_full++];
+    long _notional = 0;
+    for (size_t i = 0; i < _full; ++i) _notional += _ticks[i] * _quantities[i];
+
+    long _rest = _quantity - _taken;
+    if (_rest > 0)
+    {
+        if (_full == _size) return false;
+        _notional += _ticks[_full] * _rest;
+    }
+    _averageTicks = (double)_notional / _quantity;
+    return true;
+}
+
+/**
+ * Order book stored as two PriceLadder, an alternative layout of OrderBook for depth computations.
+ * Type T is the product type.
+ */
+template<typename T>
+class TickBook
+{
+
+public:
+
+  // ctor for an empty book, or a copy of an order book
+  TickBook() : bids(BID), offers(OFFER) {}
+  TickBook(const OrderBook<T> &_orderBook) : bids(BID), offers(OFFER) { Assign(_orderBook); }
+
+  // Replace the levels by those of an order book, merging the levels at the same price
+  void Assign(const OrderBook<T> &_orderBook);
+
+  // Apply an incremental update, returns whether the book changed
+  bool Apply(const BookUpdate<T> &_update);
+
+  // Get the product
+  const T& GetProduct() const { return product; }
+
+  // Get the bid and offer sides
+  const PriceLadder& GetBids() const { return bids; }
+  const PriceLadder& GetOffers() const { return offers; }
+
+  // Convert back to an order book
+  OrderBook<T> ToOrderBook() const;
+
+  // Write the best _levels levels of each side to _orderBook, reusing its storage
+  void ToOrderBook(OrderBook<T> &_orderBook, size_t _levels) const;
+
+private:
+  T product;
+  PriceLadder bids;
+  PriceLadder offers;
+
+  PriceLadder& GetLadder(PricingSide _side) { return _side == BID ? bids : offers; }
+
+};
+
+template<typename T>
+void TickBook<T>::Assign(const OrderBook<T> &_orderBook)
+{
+    if (product.GetProductId() != _orderBook.GetProduct().GetProductId()) product = _orderBook.GetProduct();
+    bids.Clear();
+    offers.Clear();
+    // the stacks of an order book are sorted best first, so equal prices are adjacent
+    const vector<Order> &_bidStack = _orderBook.GetBidStack();
+    for (auto b = _bidStack.begin(); b != _bidStack.end(); ++b)
+        bids.PushBack(PriceToTicks(b->GetPrice()), b->GetQuantity());
+    const vector<Order> &_offerStack = _orderBook.GetOfferStack();
+    for (auto o = _offerStack.begin(); o != _offerStack.end(); ++o)
+        offers.PushBack(PriceToTicks(o->GetPrice()), o->GetQuantity());
+}
+
+template<typename T>
+bool TickBook<T>::Apply(const BookUpdate<T> &_update)
+{
+    if (product.GetProductId() != _update.GetProduct().GetProductId())
+    {
+        product = _update.GetProduct();
+        bids.Clear();
+        offers.Clear();
+    }
+    const Order &_order = _update.GetOrder();
+    PriceLadder &_ladder = GetLadder(_order.GetSide());
+    long _tick = PriceToTicks(_order.GetPrice());
+    switch (_update.GetAction())
+    {
+        case ADD_LEVEL:
+            _ladder.Add(_tick, _order.GetQuantity());
+            return true;
+        case MODIFY_LEVEL:
+            return _ladder.Modify(_tick, _order.GetQuantity());
+        case CANCEL_LEVEL:
+            return _ladder.Cancel(_tick);
+    }
+    return false;
+}
+
+template<typename T>
+OrderBook<T> TickBook<T>::ToOrderBook() const
+{
+    vector<Order> _bidStack, _offerStack;
+    _bidStack.reserve(bids.Size());
+    _offerStack.reserve(offers.Size());
+    for (size_t i = 0; i < bids.Size(); ++i)
+        _bidStack.push_back(Order(TicksToPrice(bids.GetTicks()[i]), bids.GetQuantities()[i], BID));
+    for (size_t i = 0; i < offers.Size(); ++i)
+        _offerStack.push_back(Order(TicksToPrice(offers.GetTicks()[i]), offers.GetQuantities()[i], OFFER));
+    return OrderBook<T>(product, _bidStack, _offerStack);
+}
+
+template<typename T>
+void TickBook<T>::ToOrderBook(OrderBook<T> &_orderBook, size_t _levels) const
+{
+    _orderBook.Reset(product);
+    // levels come best first, so every one is appended
+    size_t _bidLevels = min(_levels, bids.Size());
+    for (size_t i = 0; i < _bidLevels; ++i)
+        _orderBook.AddLevel(TicksToPrice(bids.GetTicks()[i]), bids.GetQuantities()[i], BID);
+    size_t _offerLevels = min(_levels, offers.Size());
+    for (size_t i = 0; i < _offerLevels; ++i)
+        _orderBook.AddLevel(TicksToPrice(offers.GetTicks()[i]), offers.GetQuantities()[i], OFFER);
+}
 
 // will define later
 template<typename T>
@@ -202,85 +652,196 @@ class MarketDataConnector;
 // Robert changed it from an abstruct class into a real one
 /**
  * Market Data Service which distributes market data
- * Keyed on product identifier.
+ * Keyed on product identifier, it keeps one book per product and venue and listeners get the book of the venue that changed.
+ * The consolidated book of a product merges the levels of every venue. A product quoted on one venue has its venue
+ * book as consolidated book. Otherwise the consolidated book is cached: an update moves its level in place,
+ * a snapshot has it rebuilt on the next read.
  * Type T is the product type.
  */
 template<typename T>
 class MarketDataService : public Service<string,OrderBook <T> >
 {
 private:
-    map<string, OrderBook<T> > orderBooks;
+    ProductStore<array<OrderBook<T>, MARKET_COUNT> > venueBooks;
+    ProductStore<OrderBook<T> > orderBooks; // consolidated books of the products quoted on several venues
+    ProductStore<unsigned char> venueMasks; // bit m set once venue m quotes the product
+    ProductStore<unsigned char> staleBooks; // 1 when the consolidated book has to be rebuilt
     vector<ServiceListener<OrderBook<T> >*> listeners;
     MarketDataConnector<T>* connector;
     int bookDepth;
+    // aggregated depth, the buffers are reused from call to call
+    vector<ServiceListener<OrderBook<T> >*> depthListeners;
+    size_t publishDepth;
+    TickBook<T> aggregatedDepth;
+    OrderBook<T> depthBook;
+
+    // Aggregate the consolidated book of a product and hand its best publishDepth levels to the depth listeners
+    void PublishDepth(ProductIndex _index);
+
+    // Record that a venue quotes a product, returns whether the product is quoted on several venues
+    bool AddVenue(ProductIndex _index, Market _market);
+
+    // Move the level of an update in the cached consolidated book, _venueQuantity is the level of the venue before the update
+    void UpdateConsolidatedBook(const BookUpdate<T>& _update, long _venueQuantity);
 public:
     MarketDataService();
     ~MarketDataService() {} // set empty
-    OrderBook<T>& GetData(string _key) { return orderBooks[_key]; }
-    void OnMessage(OrderBook<T>& _data);
+    // Get the consolidated book of a product
+    OrderBook<T>& GetData(string _key) { return GetConsolidatedBook(GetProductCatalog().GetProductIndex(_key)); }
+    OrderBook<T>& GetData(ProductIndex _index) { return GetConsolidatedBook(_index); }
+    // Get the book of a product on one venue
+    OrderBook<T>& GetVenueBook(ProductIndex _index, Market _market) { return venueBooks[_index][_market]; }
+    // Get the merged books of every venue of a product, the venue book itself when a single venue quotes it
+    OrderBook<T>& GetConsolidatedBook(ProductIndex _index);
+    void OnMessage(OrderBook<T>& _data) { OnMessage(_data, ListenerFanout<OrderBook<T> >(listeners)); }
+    // store the order book and hand it to _sink instead of the registered listeners
+    template<typename Sink>
+    void OnMessage(OrderBook<T>& _data, Sink&& _sink);
+    // apply an incremental update to the stored book of its product, listeners get ProcessUpdate with the stored book
+    void OnUpdate(BookUpdate<T>& _update) { OnUpdate(_update, ListenerUpdateFanout<OrderBook<T> >(listeners)); }
+    // apply an incremental update and hand the stored book to _sink if it changed
+    template<typename Sink>
+    void OnUpdate(BookUpdate<T>& _update, Sink&& _sink);
     void AddListener(ServiceListener<OrderBook<T> >* _listener) { listeners.push_back(_listener); }
     const vector<ServiceListener<OrderBook<T> >*>& GetListeners() const { return listeners; }
     MarketDataConnector<T>* GetConnector() { return connector; }
     int GetBookDepth() const { return bookDepth; }
-    // Get the best bid/offer order
-    const BidOffer& GetBestBidOffer(const string &productId) { return orderBooks[productId].GetBidOffer(); }
-    // Aggregate the order book
-    const OrderBook<T>& AggregateDepth(const string &productId) ;
+    // Get the best bid/offer order across venues
+    BidOffer GetBestBidOffer(const string &productId) { return GetData(productId).GetBidOffer(); }
+    // Aggregate the consolidated book of a product, merging the levels at the same price
+    // the result is kept in the service, it is valid until the next aggregation
+    const TickBook<T>& AggregateDepth(const string &productId) { return AggregateDepth(GetData(productId)); }
+    const TickBook<T>& AggregateDepth(const OrderBook<T> &_orderBook) { aggregatedDepth.Assign(_orderBook); return aggregatedDepth; }
+    // Add a listener getting the aggregated book, cut to the publish depth, on every book or update
+    void AddDepthListener(ServiceListener<OrderBook<T> >* _listener) { depthListeners.push_back(_listener); }
+    // Set the number of levels per side of the aggregated books published, bookDepth by default
+    void SetPublishDepth(size_t _levels) { publishDepth = _levels; }
+    size_t GetPublishDepth() const { return publishDepth; }
 };
 
 template<typename T>
 MarketDataService<T>::MarketDataService()
 {
-    orderBooks = map<string, OrderBook<T> >();
+    orderBooks = ProductStore<OrderBook<T> >();
+    venueMasks = ProductStore<unsigned char>();
+    staleBooks = ProductStore<unsigned char>();
+    venueBooks = ProductStore<array<OrderBook<T>, MARKET_COUNT> >();
     listeners = vector<ServiceListener<OrderBook<T> >*>();
     connector = new MarketDataConnector<T>(this);
     bookDepth = 5;
+    publishDepth = bookDepth;
 }
 
 template<typename T>
-void MarketDataService<T>::OnMessage(OrderBook<T>& _data)
+template<typename Sink>
+void MarketDataService<T>::OnMessage(OrderBook<T>& _data, Sink&& _sink)
 {
-    orderBooks[_data.GetProduct().GetProductId()] = _data;
-    for (auto l = listeners.begin(); l != listeners.end(); ++l)
-        (*l)->ProcessAdd(_data);
+    ProductIndex _index = _data.GetProduct().GetProductIndex();
+    venueBooks[_index][_data.GetMarket()] = _data;
+    if (AddVenue(_index, _data.GetMarket())) staleBooks[_index] = 1;
+    _sink(_data);
+    PublishDepth(_index);
 }
 
 template<typename T>
-const OrderBook<T>& MarketDataService<T>::AggregateDepth(const string& productId)
+template<typename Sink>
+void MarketDataService<T>::OnUpdate(BookUpdate<T>& _update, Sink&& _sink)
 {
-    T& _product = orderBooks[productId].GetProduct();
-    
-    vector<Order>& _bidStackFrom = orderBooks[productId].GetBidStack();
-    unordered_map<double, long> _bidHashTable;
-    for (auto b = _bidStackFrom.begin(); b != _bidStackFrom.end(); ++b)
+    const T& _product = _update.GetProduct();
+    ProductIndex _index = _product.GetProductIndex();
+    OrderBook<T>& _orderBook = venueBooks[_index][_update.GetMarket()];
+    // first update of this product on this venue
+    if (_orderBook.GetProduct().GetProductId() != _product.GetProductId())
+        _orderBook = OrderBook<T>(_product, vector<Order>(), vector<Order>(), _update.GetMarket());
+    bool _consolidated = AddVenue(_index, _update.GetMarket()) && !staleBooks[_index];
+    long _venueQuantity = 0;
+    if (_consolidated) _orderBook.GetLevel(_update.GetOrder().GetPrice(), _update.GetOrder().GetSide(), _venueQuantity);
+    if (!_orderBook.Apply(_update)) return;
+    if (_consolidated) UpdateConsolidatedBook(_update, _venueQuantity);
+    _sink(_orderBook);
+    PublishDepth(_index);
+}
+
+template<typename T>
+bool MarketDataService<T>::AddVenue(ProductIndex _index, Market _market)
+{
+    unsigned char& _mask = venueMasks[_index];
+    unsigned char _venue = (unsigned char)(1 << _market);
+    // the cached book misses the levels of a new venue
+    if (!(_mask & _venue)) staleBooks[_index] = 1;
+    _mask |= _venue;
+    return (_mask & (_mask - 1)) != 0;
+}
+
+template<typename T>
+void MarketDataService<T>::UpdateConsolidatedBook(const BookUpdate<T>& _update, long _venueQuantity)
+{
+    ProductIndex _index = _update.GetProduct().GetProductIndex();
+    OrderBook<T>& _consolidated = orderBooks[_index];
+    const Order& _order = _update.GetOrder();
+    double _price = _order.GetPrice();
+    PricingSide _side = _order.GetSide();
+    switch (_update.GetAction())
     {
-        double _price = b->GetPrice();
-        long _quantity = b->GetQuantity();
-        _bidHashTable[_price] += _quantity;
+        case ADD_LEVEL:
+            _consolidated.AddLevel(_price, _order.GetQuantity(), _side);
+            break;
+        case MODIFY_LEVEL:
+            _consolidated.AddLevel(_price, _order.GetQuantity() - _venueQuantity, _side);
+            break;
+        case CANCEL_LEVEL:
+        {
+            // the level stays as long as another venue quotes the price
+            long _quantity;
+            array<OrderBook<T>, MARKET_COUNT>& _books = venueBooks[_index];
+            bool _quoted = false;
+            for (int m = 0; m < MARKET_COUNT && !_quoted; ++m)
+                _quoted = _books[m].GetLevel(_price, _side, _quantity);
+            if (_quoted) _consolidated.AddLevel(_price, -_venueQuantity, _side);
+            else _consolidated.CancelLevel(_price, _side);
+            break;
+        }
     }
-    vector<Order> _bidStackTo;
-    for (auto p = _bidHashTable.begin(); p!= _bidHashTable.end(); ++p)
+}
+
+template<typename T>
+OrderBook<T>& MarketDataService<T>::GetConsolidatedBook(ProductIndex _index)
+{
+    array<OrderBook<T>, MARKET_COUNT>& _books = venueBooks[_index];
+    unsigned char _mask = venueMasks[_index];
+    // a product quoted on a single venue is its own consolidated book
+    if ((_mask & (_mask - 1)) == 0)
     {
-        Order _bidOrder = Order(p->first, p->second, BID);
-        _bidStackTo.push_back(_bidOrder);
+        int _venue = 0;
+        while (_mask > 1) { _mask >>= 1; ++_venue; }
+        return _books[_venue];
     }
     
-    vector<Order>& _offerStackFrom = orderBooks[productId].GetOfferStack();
-    unordered_map<double, long> _offerHashTable;
-    for (auto o = _offerStackFrom.begin(); o != _offerStackFrom.end(); ++o)
+    OrderBook<T>& _consolidated = orderBooks[_index];
+    if (!staleBooks[_index]) return _consolidated;
+    int _first = 0;
+    while (!(_mask & (1 << _first))) ++_first;
+    _consolidated.Reset(_books[_first].GetProduct());
+    for (int m = 0; m < MARKET_COUNT; ++m)
     {
-        double _price = o->GetPrice();
-        long _quantity = o->GetQuantity();
-        _bidHashTable[_price] += _quantity;
+        const vector<Order>& _bidStack = _books[m].GetBidStack();
+        for (auto b = _bidStack.begin(); b != _bidStack.end(); ++b)
+            _consolidated.AddLevel(b->GetPrice(), b->GetQuantity(), BID);
+        const vector<Order>& _offerStack = _books[m].GetOfferStack();
+        for (auto o = _offerStack.begin(); o != _offerStack.end(); ++o)
+            _consolidated.AddLevel(o->GetPrice(), o->GetQuantity(), OFFER);
     }
-    vector<Order> _offerStackTo;
-    for (auto p = _offerHashTable.begin(); p != _offerHashTable.end(); ++p)
-    {
-        Order _offerOrder = Order(p->first, p->second, OFFER);
-        _offerStackTo.push_back(_offerOrder);
-    }
-    
-    return OrderBook<T>(_product, _bidStackTo, _offerStackTo);
+    staleBooks[_index] = 0;
+    return _consolidated;
+}
+
+template<typename T>
+void MarketDataService<T>::PublishDepth(ProductIndex _index)
+{
+    if (depthListeners.empty()) return;
+    AggregateDepth(GetConsolidatedBook(_index)).ToOrderBook(depthBook, publishDepth);
+    ListenerFanout<OrderBook<T> > _fanout(depthListeners);
+    _fanout(depthBook);
 }
 
 
@@ -289,62 +850,125 @@ class MarketDataConnector : public Connector<OrderBook<T> >
 {
 private:
     MarketDataService<T>* service;
+    long count;
+    vector<Order> bidStack;
+    vector<Order> offerStack;
+    // Parse one row of marketdata.txt, a book is handed to _handler every 2 * bookDepth rows
+    // an optional fifth column names the venue of the book, BROKERTEC by default
+    template<typename F>
+    void ParseRow(const CsvRow& _cells, F& _handler);
+    // Parse one row of marketupdates.txt and hand the update to _handler
+    template<typename F>
+    void ParseUpdateRow(const CsvRow& _cells, F& _handler);
 public:
     // Connector and Destructor
-    MarketDataConnector(MarketDataService<T>* _service) { service = _service; }
+    MarketDataConnector(MarketDataService<T>* _service) { service = _service; count = 0; }
     ~MarketDataConnector() {} // set empty
     void Publish(OrderBook<T>& _data) {} // set empty
     void Subscribe(ifstream& _data);
+    void Subscribe(const MappedFile& _data);
+    // Parse the file and hand every book to _handler(OrderBook<T>&) instead of the service
+    template<typename F>
+    void Parse(const MappedFile& _data, F&& _handler);
+    // Subscribe to a file of incremental updates "cusip,ADD|MODIFY|CANCEL,price,quantity,BID|OFFER[,venue]"
+    void SubscribeUpdates(const MappedFile& _data);
+    // Parse a file of incremental updates and hand every update to _handler(BookUpdate<T>&) instead of the service
+    template<typename F>
+    void ParseUpdates(const MappedFile& _data, F&& _handler);
 };
 
 template<typename T>
 void MarketDataConnector<T>::Subscribe(ifstream& _data_in)
 {
-    int _bookDepth = service->GetBookDepth();
-    int _thread = _bookDepth * 2;
-    long _count = 0;
-    vector<Order> _bidStack;
-    vector<Order> _offerStack;
     string _line;
+    CsvRow _cells;
+    auto _handler = [this](OrderBook<T>& _orderBook) { service->OnMessage(_orderBook); };
     while (getline(_data_in, _line))
     {
-        string _productId;
-        
-        stringstream _lineStream(_line);
-        string _cell;
-        vector<string> _cells;
-        while (getline(_lineStream, _cell, ','))
-            _cells.push_back(_cell);
-        
-        _productId = _cells[0];
-        double _price = ConvertPrice(_cells[1]);
-        long _quantity = stol(_cells[2]);
-        PricingSide _side;
-        if (_cells[3] == "BID") _side = BID;
-        else if (_cells[3] == "OFFER") _side = OFFER;
-        Order _order(_price, _quantity, _side);
-        switch (_side)
-        {
-            case BID:
-                _bidStack.push_back(_order);
-                break;
-            case OFFER:
-                _offerStack.push_back(_order);
-                break;
-        }
-        
-        _count++;
-        if (_count % _thread == 0)
-        {
-            T _product = GetBond(_productId);
-            OrderBook<T> _orderBook(_product, _bidStack, _offerStack);
-            service->OnMessage(_orderBook);
-            
-            _bidStack = vector<Order>();
-            _offerStack = vector<Order>();
-        }
+        SplitRow(_line, _cells);
+        ParseRow(_cells, _handler);
     }
 }
 
+template<typename T>
+void MarketDataConnector<T>::Subscribe(const MappedFile& _data_in)
+{
+    Parse(_data_in, [this](OrderBook<T>& _orderBook) { service->OnMessage(_orderBook); });
+}
+
+template<typename T>
+template<typename F>
+void MarketDataConnector<T>::Parse(const MappedFile& _data_in, F&& _handler)
+{
+    _data_in.ForEachRow([this, &_handler](const CsvRow& _cells) { ParseRow(_cells, _handler); });
+}
+
+template<typename T>
+void MarketDataConnector<T>::SubscribeUpdates(const MappedFile& _data_in)
+{
+    ParseUpdates(_data_in, [this](BookUpdate<T>& _update) { service->OnUpdate(_update); });
+}
+
+template<typename T>
+template<typename F>
+void MarketDataConnector<T>::ParseUpdates(const MappedFile& _data_in, F&& _handler)
+{
+    _data_in.ForEachRow([this, &_handler](const CsvRow& _cells) { ParseUpdateRow(_cells, _handler); });
+}
+
+template<typename T>
+template<typename F>
+void MarketDataConnector<T>::ParseUpdateRow(const CsvRow& _cells, F& _handler)
+{
+    BookAction _action;
+    if (_cells[1] == "ADD") _action = ADD_LEVEL;
+    else if (_cells[1] == "MODIFY") _action = MODIFY_LEVEL;
+    else if (_cells[1] == "CANCEL") _action = CANCEL_LEVEL;
+    else return;
+    PricingSide _side;
+    if (_cells[4] == "BID") _side = BID;
+    else if (_cells[4] == "OFFER") _side = OFFER;
+    else return;
+    
+    double _price = ConvertPrice(_cells[2]);
+    long _quantity = ParseLong(_cells[3]);
+    BookUpdate<T> _update(GetBond(_cells[0]), _action, Order(_price, _quantity, _side), ParseMarket(_cells[5]));
+    _handler(_update);
+}
+
+template<typename T>
+template<typename F>
+void MarketDataConnector<T>::ParseRow(const CsvRow& _cells, F& _handler)
+{
+    int _bookDepth = service->GetBookDepth();
+    int _thread = _bookDepth * 2;
+    
+    double _price = ConvertPrice(_cells[1]);
+    long _quantity = ParseLong(_cells[2]);
+    PricingSide _side;
+    if (_cells[3] == "BID") _side = BID;
+    else if (_cells[3] == "OFFER") _side = OFFER;
+    Order _order(_price, _quantity, _side);
+    switch (_side)
+    {
+        case BID:
+            bidStack.push_back(_order);
+            break;
+        case OFFER:
+            offerStack.push_back(_order);
+            break;
+    }
+    
+    count++;
+    if (count % _thread == 0)
+    {
+        const T& _product = GetBond(_cells[0]);
+        OrderBook<T> _orderBook(_product, bidStack, offerStack, ParseMarket(_cells[4]));
+        _handler(_orderBook);
+        
+        bidStack.clear();
+        offerStack.clear();
+    }
+}
 
 #endif
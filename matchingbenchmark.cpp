@@ -0,0 +1,129 @@
+//
+//  matchingbenchmark.cpp
+//  tradingsystem
+//
+//  Measures the throughput of the MatchingEngine on the books of marketdata.txt. After every book, ten
+//  orders of the product are submitted to the venue of the book: LIMIT, IOC, FOK, MARKET and STOP orders on
+//  both sides, around the mid of the book, some with hidden quantity. A first pass checks every order: it never fills more than its
+//  quantity, and a FOK order fills completely or not at all. Then the books and orders are replayed and timed.
+//
+//  usage: matchingbenchmark [market data file] [repeats]
+//
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+#include <stdio.h>
+#include "products.hpp"
+#include "tools.hpp"
+#include "soa.hpp"
+#include "filereader.hpp"
+#include "productcatalog.hpp"
+#include "pricingservice.hpp"
+#include "algostreamingservice.hpp"
+#include "marketdataservice.hpp"
+#include "algoexecutionservice.hpp"
+#include "executionservice.hpp"
+#include "matchingengine.hpp"
+
+// orders submitted after every book
+const int ORDERS_PER_BOOK = 10;
+
+int main(int argc, const char * argv[])
+{
+    string _marketDataFile = argc > 1 ? argv[1] : "marketdata.txt";
+    int _repeats = argc > 2 ? atoi(argv[2]) : 100;
+    if (!GetProductCatalog().Load("products.txt"))
+    {
+        cerr << "failed to read products.txt" << endl;
+        return 1;
+    }
+    MappedFile _marketData(_marketDataFile);
+    if (!_marketData.IsOpen() || _repeats <= 0)
+    {
+        cerr << "usage: " << argv[0] << " [market data file] [repeats]" << endl;
+        return 1;
+    }
+
+    // parse once and draw the orders, the replays only time the engine
+    MarketDataService<Bond> _parser;
+    vector<OrderBook<Bond> > _books;
+    _parser.GetConnector()->Parse(_marketData, [&](OrderBook<Bond>& _orderBook) { _books.push_back(_orderBook); });
+    vector<double> _uniform = GenerateUniform((long)_books.size() * ORDERS_PER_BOOK * 4, 12345);
+    vector<ExecutionOrder<Bond> > _orders;
+    const OrderType _types[] = { LIMIT, LIMIT, LIMIT, LIMIT, IOC, IOC, FOK, FOK, MARKET, STOP };
+    for (size_t b = 0; b < _books.size(); ++b)
+    {
+        BidOffer _bidOffer = _books[b].GetBidOffer();
+        double _mid = (_bidOffer.GetBidOrder().GetPrice() + _bidOffer.GetOfferOrder().GetPrice()) / 2.;
+        for (int k = 0; k < ORDERS_PER_BOOK; ++k)
+        {
+            const double* _u = &_uniform[(b * ORDERS_PER_BOOK + k) * 4];
+            OrderType _type = _types[(int)(_u[0] * 10)];
+            PricingSide _side = _u[1] < 0.5 ? BID : OFFER;
+            double _price = _mid + ((int)(_u[2] * 9) - 4) / 256.;
+            long _visible = 1000000L * (1 + (long)(_u[3] * 5));
+            long _hidden = k % 3 == 0 ? _visible / 2 : 0;
+            string _orderId = "ME" + to_string(_orders.size());
+            _orders.push_back(ExecutionOrder<Bond>(_books[b].GetProduct(), _side, _orderId, _type, _price, _visible, _hidden, "", false, _books[b].GetMarket()));
+        }
+    }
+    cout << _books.size() << " books, " << _orders.size() << " orders, " << _repeats << " repeats" << endl;
+
+    // every order on its own: what the sink gets for the order submitted, against its quantity
+    long _errors = 0;
+    {
+        MatchingEngine<Bond> _engine;
+        const string* _orderId = nullptr;
+        long _filled = 0;
+        auto _check = [&](Fill<Bond>& _fill)
+        {
+            if (_fill.GetQuantity() <= 0 || _fill.GetLeavesQuantity() < 0) ++_errors;
+            if (_fill.GetOrderId() == *_orderId) _filled += _fill.GetQuantity();
+        };
+        for (size_t b = 0; b < _books.size(); ++b)
+        {
+            const string _none;
+            _orderId = &_none;
+            _engine.OnMarketData(_books[b], _check);
+            for (int k = 0; k < ORDERS_PER_BOOK; ++k)
+            {
+                const ExecutionOrder<Bond>& _order = _orders[b * ORDERS_PER_BOOK + k];
+                long _quantity = _order.GetVisibleQuantity() + _order.GetHiddenQuantity();
+                _orderId = &_order.GetOrderId();
+                _filled = 0;
+                _engine.Submit(_order, _check);
+                if (_filled > _quantity) ++_errors;
+                if (_order.GetOrderType() == FOK && _filled != 0 && _filled != _quantity) ++_errors;
+            }
+        }
+        cout << "checked " << _engine.GetOrderCount() << " orders, " << _engine.GetFillCount() << " fills, "
+             << _errors << " errors" << endl;
+    }
+
+    // the replay, books and orders timed apart
+    MatchingEngine<Bond> _engine;
+    long _fills = 0;
+    long _quantity = 0;
+    auto _count = [&](Fill<Bond>& _fill) { ++_fills; _quantity += _fill.GetQuantity(); };
+    long long _bookNanos = 0, _orderNanos = 0;
+    for (int r = 0; r < _repeats; ++r)
+        for (size_t b = 0; b < _books.size(); ++b)
+        {
+            long long _start = MonotonicClock::Now();
+            _engine.OnMarketData(_books[b], _count);
+            long long _booked = MonotonicClock::Now();
+            for (int k = 0; k < ORDERS_PER_BOOK; ++k) _engine.Submit(_orders[b * ORDERS_PER_BOOK + k], _count);
+            _orderNanos += MonotonicClock::Now() - _booked;
+            _bookNanos += _booked - _start;
+        }
+    if (_fills != _engine.GetFillCount()) ++_errors;
+
+    double _orderCount = (double)_orders.size() * _repeats;
+    cout << _orderCount / _orderNanos * 1e3 << "M orders/s (" << _orderNanos / _orderCount << "ns per order), "
+         << (double)_bookNanos / ((double)_books.size() * _repeats) << "ns per book, "
+         << _fills << " fills of " << _quantity << ", " << _engine.GetRestingCount() << " orders resting" << endl;
+    return _errors == 0 ? 0 : 1;
+}
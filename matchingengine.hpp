@@ -0,0 +1,507 @@
+/**
+ * matchingengine.hpp
+ * Defines an in-process matching engine standing in for the venues when testing executions.
+ * Every product has a price-time priority book holding the liquidity of the market data and the
+ * orders resting on the engine. Execution orders of every type are matched against it and the
+ * fills are handed to the listeners, so trades are booked from what was actually filled.
+ */
+#ifndef MATCHING_ENGINE_HPP
+#define MATCHING_ENGINE_HPP
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "soa.hpp"
+#include "tools.hpp"
+#include "productcatalog.hpp"
+#include "marketdataservice.hpp"
+#include "algoexecutionservice.hpp"
+#include "executionservice.hpp"
+
+using namespace std;
+
+// will define later
+template<typename T>
+class MatchingEngineToMarketDataListener;
+template<typename T>
+class MatchingEngineToExecutionListener;
+
+/**
+ * Matching engine with one book per product.
+ * An order on the BID side sells into the bids and rests as an offer, an order on the OFFER side
+ * buys from the offers and rests as a bid, as in the booking of the executions.
+ * At a price level the visible quantities are matched in time priority first, then the hidden ones.
+ * MARKET and IOC orders never rest, FOK orders fill completely or not at all, LIMIT orders rest
+ * what they could not fill and STOP orders turn into MARKET orders once a trade prints at their price or through it.
+ * An order only trades with the liquidity of its venue, and rests on that venue.
+ * The market data only replaces the liquidity of its venue, the resting orders keep their place and trade
+ * with any new liquidity of their venue crossing them.
+ * Listeners must not submit orders from a fill.
+ * Type T is the product type.
+ */
+template<typename T>
+class MatchingEngine
+{
+public:
+    MatchingEngine();
+    ~MatchingEngine();
+    MatchingEngine(const MatchingEngine&) = delete;
+    MatchingEngine& operator=(const MatchingEngine&) = delete;
+
+    // Replace the liquidity of the venue of _orderBook by its levels
+    void OnMarketData(const OrderBook<T>& _orderBook) { OnMarketData(_orderBook, ListenerFanout<Fill<T> >(listeners)); }
+    // Replace the liquidity of the venue and hand the fills of the resting orders it crosses to _sink
+    template<typename Sink>
+    void OnMarketData(const OrderBook<T>& _orderBook, Sink&& _sink);
+
+    // Match an execution order, the fills go to the listeners
+    void Submit(const ExecutionOrder<T>& _order) { Submit(_order, ListenerFanout<Fill<T> >(listeners)); }
+    // Match an execution order and hand the fills to _sink
+    template<typename Sink>
+    void Submit(const ExecutionOrder<T>& _order, Sink&& _sink);
+
+    void AddListener(ServiceListener<Fill<T> >* _listener) { listeners.push_back(_listener); }
+    const vector<ServiceListener<Fill<T> >*>& GetListeners() const { return listeners; }
+    MatchingEngineToMarketDataListener<T>* GetMarketDataListener() { return marketDataListener; }
+    MatchingEngineToExecutionListener<T>* GetExecutionListener() { return executionListener; }
+
+    // Get the number of orders submitted and fills made so far
+    long GetOrderCount() const { return orderCount; }
+    long GetFillCount() const { return fillCount; }
+
+    // Get the number of orders resting on the engine, market liquidity excluded
+    long GetRestingCount() const { return restingCount; }
+
+private:
+    // an order resting at a price level, market liquidity has no order ID
+    struct RestingOrder
+    {
+        string orderId;
+        PricingSide side; // side of the execution order, for its fills
+        Market market;
+        long visible;
+        long hidden;
+        int prev;
+        int next;
+    };
+
+    // a price level, its orders are linked in time priority
+    struct PriceLevel
+    {
+        long tick;
+        int head;
+        int tail;
+    };
+
+    // the levels of one side are kept worst first, so the best level is at the back
+    typedef vector<PriceLevel> BookSide;
+
+    struct StopOrder
+    {
+        ExecutionOrder<T> order;
+        long stopTick;
+    };
+
+    struct ProductBook
+    {
+        T product;
+        bool hasProduct = false;
+        BookSide bids; // resting buying interest
+        BookSide offers; // resting selling interest
+        vector<StopOrder> stops;
+        bool traded = false;
+        long lastTick = 0;
+    };
+
+    ProductStore<ProductBook> books;
+    vector<RestingOrder> orders; // pool of the resting orders
+    vector<int> freeOrders;
+    vector<ServiceListener<Fill<T> >*> listeners;
+    MatchingEngineToMarketDataListener<T>* marketDataListener;
+    MatchingEngineToExecutionListener<T>* executionListener;
+    long orderCount;
+    long fillCount;
+    long restingCount;
+
+    // Get the book of a product, setting its product on first use
+    ProductBook& GetBook(const T& _product);
+
+    // Whether _tick is a better price than _other on a side of the book
+    static bool IsBetter(long _tick, long _other, bool _isBids) { return _isBids ? _tick > _other : _tick < _other; }
+
+    // Whether the best level of a side can be taken by an order limited at _limitTick
+    static bool IsMarketable(long _levelTick, long _limitTick, bool _isBids) { return _isBids ? _levelTick >= _limitTick : _levelTick <= _limitTick; }
+
+    // Take a resting order from the pool
+    int NewOrder(const string& _orderId, PricingSide _side, Market _market, long _visible, long _hidden);
+
+    // Queue a resting order at the back of its price level
+    void Append(BookSide& _bookSide, bool _isBids, long _tick, int _order);
+
+    // Remove a resting order from its level and return it to the pool
+    void Remove(PriceLevel& _level, int _order);
+
+    // Remove the liquidity of a venue from a side
+    void RemoveMarket(BookSide& _bookSide, Market _market);
+
+    // Get the quantity an order of _market limited at _limitTick can take from a side
+    long GetAvailable(const BookSide& _bookSide, bool _isBids, Market _market, long _limitTick, bool _isMarket) const;
+
+    // Take up to _quantity from the liquidity of _market on a side for an order, returns the quantity filled
+    template<typename Sink>
+    long Match(ProductBook& _book, const string& _orderId, PricingSide _side, Market _market, long _quantity, long _limitTick, bool _isMarket, Sink& _sink);
+
+    // Match an order of any type but STOP
+    template<typename Sink>
+    void Execute(ProductBook& _book, const ExecutionOrder<T>& _order, OrderType _orderType, Sink& _sink);
+
+    // Run the stop orders triggered by the last trade as MARKET orders
+    template<typename Sink>
+    void TriggerStops(ProductBook& _book, Sink& _sink);
+
+    // Match the resting orders of the engine crossed by new market liquidity
+    template<typename Sink>
+    void Uncross(ProductBook& _book, Sink& _sink);
+
+    // Hand a fill to _sink
+    template<typename Sink>
+    void Report(ProductBook& _book, const string& _orderId, PricingSide _side, long _tick, long _quantity, long _leavesQuantity, Sink& _sink);
+};
+
+template<typename T>
+MatchingEngine<T>::MatchingEngine()
+{
+    books = ProductStore<ProductBook>();
+    listeners = vector<ServiceListener<Fill<T> >*>();
+    marketDataListener = new MatchingEngineToMarketDataListener<T>(this);
+    executionListener = new MatchingEngineToExecutionListener<T>(this);
+    orderCount = 0;
+    fillCount = 0;
+    restingCount = 0;
+}
+
+template<typename T>
+MatchingEngine<T>::~MatchingEngine()
+{
+    delete marketDataListener;
+    delete executionListener;
+}
+
+template<typename T>
+typename MatchingEngine<T>::ProductBook& MatchingEngine<T>::GetBook(const T& _product)
+{
+    ProductBook& _book = books[_product.GetProductIndex()];
+    if (!_book.hasProduct)
+    {
+        _book.product = _product;
+        _book.hasProduct = true;
+    }
+    return _book;
+}
+
+template<typename T>
+int MatchingEngine<T>::NewOrder(const string& _orderId, PricingSide _side, Market _market, long _visible, long _hidden)
+{
+    int _order;
+    if (freeOrders.empty())
+    {
+        _order = (int)orders.size();
+        orders.push_back(RestingOrder());
+    }
+    else
+    {
+        _order = freeOrders.back();
+        freeOrders.pop_back();
+    }
+    RestingOrder& _resting = orders[_order];
+    _resting.orderId = _orderId;
+    _resting.side = _side;
+    _resting.market = _market;
+    _resting.visible = _visible;
+    _resting.hidden = _hidden;
+    _resting.prev = -1;
+    _resting.next = -1;
+    if (!_orderId.empty()) ++restingCount;
+    return _order;
+}
+
+template<typename T>
+void MatchingEngine<T>::Append(BookSide& _bookSide, bool _isBids, long _tick, int _order)
+{
+    // worst first: bids by increasing price, offers by decreasing price
+    auto _level = lower_bound(_bookSide.begin(), _bookSide.end(), _tick, [_isBids](const PriceLevel& _l, long _t) { return IsBetter(_t, _l.tick, _isBids); });
+    if (_level == _bookSide.end() || _level->tick != _tick)
+        _level = _bookSide.insert(_level, PriceLevel{_tick, -1, -1});
+
+    RestingOrder& _resting = orders[_order];
+    _resting.prev = _level->tail;
+    _resting.next = -1;
+    if (_level->tail >= 0) orders[_level->tail].next = _order;
+    else _level->head = _order;
+    _level->tail = _order;
+}
+
+template<typename T>
+void MatchingEngine<T>::Remove(PriceLevel& _level, int _order)
+{
+    RestingOrder& _resting = orders[_order];
+    if (_resting.prev >= 0) orders[_resting.prev].next = _resting.next;
+    else _level.head = _resting.next;
+    if (_resting.next >= 0) orders[_resting.next].prev = _resting.prev;
+    else _level.tail = _resting.prev;
+    if (!_resting.orderId.empty()) --restingCount;
+    freeOrders.push_back(_order);
+}
+
+template<typename T>
+void MatchingEngine<T>::RemoveMarket(BookSide& _bookSide, Market _market)
+{
+    for (auto l = _bookSide.begin(); l != _bookSide.end(); ++l)
+    {
+        for (int o = l->head; o >= 0; )
+        {
+            int _next = orders[o].next;
+            if (orders[o].orderId.empty() && orders[o].market == _market) Remove(*l, o);
+            o = _next;
+        }
+    }
+    _bookSide.erase(remove_if(_bookSide.begin(), _bookSide.end(), [](const PriceLevel& _l) { return _l.head < 0; }), _bookSide.end());
+}
+
+template<typename T>
+long MatchingEngine<T>::GetAvailable(const BookSide& _bookSide, bool _isBids, Market _market, long _limitTick, bool _isMarket) const
+{
+    long _available = 0;
+    for (auto l = _bookSide.rbegin(); l != _bookSide.rend(); ++l)
+    {
+        if (!_isMarket && !IsMarketable(l->tick, _limitTick, _isBids)) break;
+        for (int o = l->head; o >= 0; o = orders[o].next)
+            if (orders[o].market == _market) _available += orders[o].visible + orders[o].hidden;
+    }
+    return _available;
+}
+
+template<typename T>
+template<typename Sink>
+void MatchingEngine<T>::Report(ProductBook& _book, const string& _orderId, PricingSide _side, long _tick, long _quantity, long _leavesQuantity, Sink& _sink)
+{
+    char _fillId[ID_SIZE];
+    GenerateId(_fillId);
+    Fill<T> _fill(_book.product, string(_fillId, ID_SIZE), _orderId, _side, TicksToPrice(_tick), _quantity, _leavesQuantity);
+    ++fillCount;
+    _sink(_fill);
+}
+
+template<typename T>
+template<typename Sink>
+long MatchingEngine<T>::Match(ProductBook& _book, const string& _orderId, PricingSide _side, Market _market, long _quantity, long _limitTick, bool _isMarket, Sink& _sink)
+{
+    // a BID order sells into the bids, an OFFER order buys from the offers
+    bool _isBids = _side == BID;
+    BookSide& _bookSide = _isBids ? _book.bids : _book.offers;
+    long _left = _quantity;
+    // best level first, the levels may hold only the liquidity of other venues
+    for (size_t l = _bookSide.size(); l-- > 0 && _left > 0; )
+    {
+        PriceLevel& _level = _bookSide[l];
+        if (!_isMarket && !IsMarketable(_level.tick, _limitTick, _isBids)) break;
+
+        // visible quantities first, then hidden ones, each in time priority
+        for (int _pass = 0; _pass < 2 && _left > 0; ++_pass)
+        {
+            for (int o = _level.head; o >= 0 && _left > 0; )
+            {
+                RestingOrder& _resting = orders[o];
+                int _next = _resting.next;
+                if (_resting.market != _market)
+                {
+                    o = _next;
+                    continue;
+                }
+                long& _restingQuantity = _pass == 0 ? _resting.visible : _resting.hidden;
+                long _taken = min(_left, _restingQuantity);
+                if (_taken > 0)
+                {
+                    _restingQuantity -= _taken;
+                    _left -= _taken;
+                    Report(_book, _orderId, _side, _level.tick, _taken, _left, _sink);
+                    if (!_resting.orderId.empty())
+                        Report(_book, _resting.orderId, _resting.side, _level.tick, _taken, _resting.visible + _resting.hidden, _sink);
+                    _book.traded = true;
+                    _book.lastTick = _level.tick;
+                }
+                if (_resting.visible == 0 && _resting.hidden == 0) Remove(_level, o);
+                o = _next;
+            }
+        }
+        if (_level.head < 0) _bookSide.erase(_bookSide.begin() + l);
+    }
+    return _quantity - _left;
+}
+
+template<typename T>
+template<typename Sink>
+void MatchingEngine<T>::Execute(ProductBook& _book, const ExecutionOrder<T>& _order, OrderType _orderType, Sink& _sink)
+{
+    PricingSide _side = _order.GetPricingSide();
+    Market _market = _order.GetMarket();
+    long _quantity = _order.GetVisibleQuantity() + _order.GetHiddenQuantity();
+    long _limitTick = PriceToTicks(_order.GetPrice());
+    bool _isBids = _side == BID;
+
+    switch (_orderType)
+    {
+        case MARKET:
+        case STOP:
+            Match(_book, _order.GetOrderId(), _side, _market, _quantity, _limitTick, true, _sink);
+            break;
+        case IOC:
+            Match(_book, _order.GetOrderId(), _side, _market, _quantity, _limitTick, false, _sink);
+            break;
+        case FOK:
+            if (GetAvailable(_isBids ? _book.bids : _book.offers, _isBids, _market, _limitTick, false) >= _quantity)
+                Match(_book, _order.GetOrderId(), _side, _market, _quantity, _limitTick, false, _sink);
+            break;
+        case LIMIT:
+        {
+            long _left = _quantity - Match(_book, _order.GetOrderId(), _side, _market, _quantity, _limitTick, false, _sink);
+            if (_left > 0)
+            {
+                // the fills come out of the visible quantity first
+                long _hidden = min(_order.GetHiddenQuantity(), _left);
+                int _resting = NewOrder(_order.GetOrderId(), _side, _market, _left - _hidden, _hidden);
+                Append(_isBids ? _book.offers : _book.bids, !_isBids, _limitTick, _resting);
+            }
+            break;
+        }
+    }
+    TriggerStops(_book, _sink);
+}
+
+template<typename T>
+template<typename Sink>
+void MatchingEngine<T>::TriggerStops(ProductBook& _book, Sink& _sink)
+{
+    bool _triggered = true;
+    while (_triggered && _book.traded)
+    {
+        _triggered = false;
+        for (size_t i = 0; i < _book.stops.size(); ++i)
+        {
+            StopOrder& _stop = _book.stops[i];
+            // a stop selling into the bids triggers on a trade at or below its price, a stop buying on a trade at or above it
+            bool _hit = _stop.order.GetPricingSide() == BID ? _book.lastTick <= _stop.stopTick : _book.lastTick >= _stop.stopTick;
+            if (!_hit) continue;
+            ExecutionOrder<T> _order = _stop.order;
+            _book.stops.erase(_book.stops.begin() + i);
+            Execute(_book, _order, MARKET, _sink);
+            _triggered = true;
+            break;
+        }
+    }
+}
+
+template<typename T>
+template<typename Sink>
+void MatchingEngine<T>::Uncross(ProductBook& _book, Sink& _sink)
+{
+    // market liquidity crossing market liquidity is left as quoted, only the resting orders of the engine trade
+    for (int s = 0; s < 2; ++s)
+    {
+        bool _isBids = s == 0;
+        BookSide& _bookSide = _isBids ? _book.bids : _book.offers;
+        const BookSide& _opposite = _isBids ? _book.offers : _book.bids;
+        for (size_t l = _bookSide.size(); l-- > 0; )
+        {
+            PriceLevel& _level = _bookSide[l];
+            if (_opposite.empty() || !IsMarketable(_opposite.back().tick, _level.tick, !_isBids)) break;
+            for (int o = _level.head; o >= 0; )
+            {
+                RestingOrder& _resting = orders[o];
+                int _next = _resting.next;
+                if (!_resting.orderId.empty())
+                {
+                    // matched again as if it had just been entered, what is left keeps its place
+                    long _filled = Match(_book, _resting.orderId, _resting.side, _resting.market, _resting.visible + _resting.hidden, _level.tick, false, _sink);
+                    long _fromVisible = min(_filled, _resting.visible);
+                    _resting.visible -= _fromVisible;
+                    _resting.hidden -= _filled - _fromVisible;
+                    if (_resting.visible == 0 && _resting.hidden == 0) Remove(_level, o);
+                }
+                o = _next;
+            }
+        }
+        _bookSide.erase(remove_if(_bookSide.begin(), _bookSide.end(), [](const PriceLevel& _l) { return _l.head < 0; }), _bookSide.end());
+    }
+}
+
+template<typename T>
+template<typename Sink>
+void MatchingEngine<T>::OnMarketData(const OrderBook<T>& _orderBook, Sink&& _sink)
+{
+    ProductBook& _book = GetBook(_orderBook.GetProduct());
+    Market _market = _orderBook.GetMarket();
+    RemoveMarket(_book.bids, _market);
+    RemoveMarket(_book.offers, _market);
+
+    const vector<Order>& _bidStack = _orderBook.GetBidStack();
+    for (auto b = _bidStack.begin(); b != _bidStack.end(); ++b)
+        Append(_book.bids, true, PriceToTicks(b->GetPrice()), NewOrder("", BID, _market, b->GetQuantity(), 0));
+    const vector<Order>& _offerStack = _orderBook.GetOfferStack();
+    for (auto o = _offerStack.begin(); o != _offerStack.end(); ++o)
+        Append(_book.offers, false, PriceToTicks(o->GetPrice()), NewOrder("", OFFER, _market, o->GetQuantity(), 0));
+
+    Uncross(_book, _sink);
+    TriggerStops(_book, _sink);
+}
+
+template<typename T>
+template<typename Sink>
+void MatchingEngine<T>::Submit(const ExecutionOrder<T>& _order, Sink&& _sink)
+{
+    ++orderCount;
+    ProductBook& _book = GetBook(_order.GetProduct());
+    if (_order.GetOrderType() == STOP)
+    {
+        _book.stops.push_back(StopOrder{_order, PriceToTicks(_order.GetPrice())});
+        TriggerStops(_book, _sink);
+        return;
+    }
+    Execute(_book, _order, _order.GetOrderType(), _sink);
+}
+
+/**
+ * Matching Engine Listener subscribing data from Market Data Service to the Matching Engine.
+ * Type T is the product type.
+ */
+template<typename T>
+class MatchingEngineToMarketDataListener : public ServiceListener<OrderBook<T> >
+{
+private:
+    MatchingEngine<T>* engine;
+public:
+    MatchingEngineToMarketDataListener(MatchingEngine<T>* _engine) { engine = _engine; }
+    ~MatchingEngineToMarketDataListener() {} // set empty
+    void ProcessAdd(OrderBook<T>& _data) { engine->OnMarketData(_data); }
+    void ProcessRemove(OrderBook<T>& _data) {} // set empty
+    void ProcessUpdate(OrderBook<T>& _data) { engine->OnMarketData(_data); }
+};
+
+/**
+ * Matching Engine Listener subscribing data from Execution Service to the Matching Engine.
+ * Type T is the product type.
+ */
+template<typename T>
+class MatchingEngineToExecutionListener : public ServiceListener<ExecutionOrder<T> >
+{
+private:
+    MatchingEngine<T>* engine;
+public:
+    MatchingEngineToExecutionListener(MatchingEngine<T>* _engine) { engine = _engine; }
+    ~MatchingEngineToExecutionListener() {} // set empty
+    void ProcessAdd(ExecutionOrder<T>& _data) { engine->Submit(_data); }
+    void ProcessRemove(ExecutionOrder<T>& _data) {} // set empty
+    void ProcessUpdate(ExecutionOrder<T>& _data) {} // set empty
+};
+
+#endif
@@ -0,0 +1,189 @@
+/**
+ * persistencethread.hpp
+ * Defines the background thread writing the persisted records of the historical data services.
+ * Services push their records into a multi-producer/single-consumer queue, the thread
+ * formats them into the files and commits them in groups, one write (and optional fsync) per batch.
+ */
+#ifndef PERSISTENCE_THREAD_HPP
+#define PERSISTENCE_THREAD_HPP
+
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <functional>
+#include <vector>
+#include "ringbuffer.hpp"
+#include "clock.hpp"
+
+using namespace std;
+
+/**
+ * Snapshot of the counters of a PersistenceThread.
+ */
+struct PersistenceStats
+{
+    long commits;
+    long records;
+    long maxRecordsPerCommit;
+    long commitNanos; // total time spent writing (and syncing) the commits
+    long maxCommitNanos;
+    long maxQueueDepth; // deepest queue seen by the thread
+
+    double GetRecordsPerCommit() const { return commits > 0 ? (double)records / commits : 0.; }
+    double GetAverageCommitNanos() const { return commits > 0 ? (double)commitNanos / commits : 0.; }
+};
+
+/**
+ * Thread draining the record queues of the historical data services.
+ * Channels are added before Start, every channel is drained and committed by this thread only.
+ * While the queues are empty, every channel is committed again once the flush interval has elapsed,
+ * so what a writer holds outside of a drain, as the header of a journal, does not stay in its buffer.
+ */
+class PersistenceThread
+{
+public:
+    // ctor for a thread committing at most _batchSize records at once, with an fsync per commit if _sync,
+    // and committing every channel at least every _flushMillisec milliseconds while idle
+    PersistenceThread(size_t _batchSize = 4096, bool _sync = false, long _flushMillisec = 1000);
+    ~PersistenceThread() { Stop(); }
+    PersistenceThread(const PersistenceThread&) = delete;
+    PersistenceThread& operator=(const PersistenceThread&) = delete;
+
+    // Add a channel: _drain(n) writes up to n queued records and returns how many it wrote,
+    // _commit(sync) hands the written records to the file, _depth() gets the number of queued records
+    void AddChannel(function<size_t(size_t)> _drain, function<void(bool)> _commit, function<size_t()> _depth);
+
+    // Start the thread
+    void Start();
+
+    // Commit everything queued so far and stop the thread, the producers must be done
+    void Stop();
+
+    // Get the counters
+    PersistenceStats GetStats() const;
+
+private:
+    struct Channel
+    {
+        function<size_t(size_t)> drain;
+        function<void(bool)> commit;
+        function<size_t()> depth;
+    };
+
+    vector<Channel> channels;
+    size_t batchSize;
+    bool sync;
+    chrono::milliseconds flushInterval;
+    atomic<bool> running;
+    thread worker;
+
+    // counters, only written by the worker
+    atomic<long> commits;
+    atomic<long> records;
+    atomic<long> maxRecordsPerCommit;
+    atomic<long> commitNanos;
+    atomic<long> maxCommitNanos;
+    atomic<long> maxQueueDepth;
+
+    void Run();
+    static void StoreMax(atomic<long>& _max, long _value);
+};
+
+PersistenceThread::PersistenceThread(size_t _batchSize, bool _sync, long _flushMillisec) :
+flushInterval(_flushMillisec), running(false), commits(0), records(0), maxRecordsPerCommit(0), commitNanos(0), maxCommitNanos(0), maxQueueDepth(0)
+{
+    batchSize = _batchSize > 0 ? _batchSize : 1;
+    sync = _sync;
+}
+
+void PersistenceThread::AddChannel(function<size_t(size_t)> _drain, function<void(bool)> _commit, function<size_t()> _depth)
+{
+    channels.push_back(Channel{_drain, _commit, _depth});
+}
+
+void PersistenceThread::Start()
+{
+    if (worker.joinable()) return;
+    running.store(true, memory_order_release);
+    worker = thread([this]() { Run(); });
+}
+
+void PersistenceThread::Stop()
+{
+    if (!worker.joinable()) return;
+    running.store(false, memory_order_release);
+    worker.join();
+}
+
+void PersistenceThread::StoreMax(atomic<long>& _max, long _value)
+{
+    if (_value > _max.load(memory_order_relaxed)) _max.store(_value, memory_order_relaxed);
+}
+
+PersistenceStats PersistenceThread::GetStats() const
+{
+    PersistenceStats _stats;
+    _stats.commits = commits.load(memory_order_relaxed);
+    _stats.records = records.load(memory_order_relaxed);
+    _stats.maxRecordsPerCommit = maxRecordsPerCommit.load(memory_order_relaxed);
+    _stats.commitNanos = commitNanos.load(memory_order_relaxed);
+    _stats.maxCommitNanos = maxCommitNanos.load(memory_order_relaxed);
+    _stats.maxQueueDepth = maxQueueDepth.load(memory_order_relaxed);
+    return _stats;
+}
+
+void PersistenceThread::Run()
+{
+    int _idle = 0;
+    chrono::steady_clock::time_point _lastFlush = chrono::steady_clock::now();
+    while (true)
+    {
+        // check before draining, so nothing queued before the stop is missed
+        bool _stopping = !running.load(memory_order_acquire);
+        size_t _handled = 0;
+        for (auto c = channels.begin(); c != channels.end(); ++c)
+        {
+            StoreMax(maxQueueDepth, (long)c->depth());
+            size_t _count = c->drain(batchSize);
+            if (_count == 0) continue;
+
+            // group commit of the whole batch
+            long long _start = MonotonicClock::Now();
+            c->commit(sync);
+            long _nanos = (long)(MonotonicClock::Now() - _start);
+
+            commits.fetch_add(1, memory_order_relaxed);
+            records.fetch_add((long)_count, memory_order_relaxed);
+            commitNanos.fetch_add(_nanos, memory_order_relaxed);
+            StoreMax(maxRecordsPerCommit, (long)_count);
+            StoreMax(maxCommitNanos, _nanos);
+            _handled += _count;
+        }
+
+        if (_handled > 0)
+        {
+            _idle = 0;
+        }
+        else if (_stopping)
+        {
+            break;
+        }
+        else if (++_idle < 64)
+        {
+            this_thread::yield();
+        }
+        else
+        {
+            chrono::steady_clock::time_point _now = chrono::steady_clock::now();
+            if (_now - _lastFlush >= flushInterval)
+            {
+                for (auto c = channels.begin(); c != channels.end(); ++c) c->commit(false);
+                _lastFlush = _now;
+            }
+            // back off once the services have gone quiet
+            this_thread::sleep_for(chrono::microseconds(100));
+        }
+    }
+}
+
+#endif
@@ -0,0 +1,154 @@
+/**
+ * pipeline.hpp
+ * Defines the pieces used to run the service lanes on their own threads.
+ *
+ * Threading contract of the asynchronous mode:
+ * - every connector parses its file on a reader thread and pushes the records into a Pipe;
+ * - every service is driven by exactly one LaneWorker thread, which drains the pipes of its lane;
+ * - a service behind a QueuedListener is driven by the drain thread of that listener instead,
+ *   along with everything downstream of it;
+ * - a link between services of different lanes goes through a PipeListener, whose pipe
+ *   is drained by the lane that owns the downstream service;
+ * - each HistoricalDataService is fed by a single lane, so the persisted files are never shared.
+ *
+ * Threading contract of the parallel mode, see scheduler.hpp:
+ * - the connectors parse on reader threads and post every record to the TaskScheduler, keyed on its product;
+ * - the tasks of a key run one at a time in the order they were posted, on any worker, and everything
+ *   downstream of a task runs in it, so the services of lanes 1 and 2 only keep state per product: the algo
+ *   streaming and the algo execution are set to alternate their sizes and sides per product;
+ * - trade booking, position and risk keep state across products (books, buckets, the reads of the bond
+ *   analytics), they run on one key of their own that the trades, the execution orders and the prices revaluing
+ *   the risk are posted to, so the books of the execution orders follow the order in which the products reach
+ *   that key;
+ * - the inquiries and the GUI run on keys of their own too;
+ * - the HistoricalDataServices persist on the PersistenceThread, whose queues take any number of producers;
+ * - the depth listeners of the MarketDataService share its scratch book, they are not run in this mode.
+ */
+#ifndef PIPELINE_HPP
+#define PIPELINE_HPP
+
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <vector>
+#include "soa.hpp"
+#include "ringbuffer.hpp"
+
+using namespace std;
+
+/**
+ * A bounded single-producer/single-consumer pipe between two threads.
+ * The producer closes the pipe once it has pushed its last element.
+ * Type V is the data type.
+ */
+template<typename V>
+class Pipe
+{
+public:
+    explicit Pipe(size_t _capacity = 4096) : queue(_capacity), closed(false) {}
+
+    // Push a copy of _data, waiting while the pipe is full
+    void Push(const V& _data)
+    {
+        while (!queue.TryPush(_data)) this_thread::yield();
+    }
+
+    // Pop the oldest element, returns false if the pipe is currently empty
+    bool TryPop(V& _data) { return queue.TryPop(_data); }
+
+    // Mark the end of the stream
+    void Close() { closed.store(true, memory_order_release); }
+
+    // Whether the producer is done and everything has been popped
+    bool IsFinished() const { return closed.load(memory_order_acquire) && queue.Size() == 0; }
+
+private:
+    SpscQueue<V> queue;
+    atomic<bool> closed;
+};
+
+/**
+ * Listener pushing every added element of an upstream service into a Pipe,
+ * so that the downstream lane can process it on its own thread.
+ * Type V is the data type.
+ */
+template<typename V>
+class PipeListener : public ServiceListener<V>
+{
+private:
+    Pipe<V>* pipe;
+public:
+    PipeListener(Pipe<V>* _pipe) { pipe = _pipe; }
+    ~PipeListener() {} // set empty
+    void ProcessAdd(V& _data) { pipe->Push(_data); }
+    void ProcessRemove(V& _data) {} // set empty
+    void ProcessUpdate(V& _data) {} // set empty
+};
+
+/**
+ * Thread draining the pipes of one lane into its services.
+ * The worker stops once every pipe it drains is finished.
+ */
+class LaneWorker
+{
+public:
+    LaneWorker() = default;
+    ~LaneWorker() { Join(); }
+
+    // Drain _pipe on this lane, calling _handler(V&) for every element
+    template<typename V, typename F>
+    void AddSource(Pipe<V>& _pipe, F _handler);
+
+    // Start the worker thread
+    void Start() { worker = thread([this]() { Run(); }); }
+
+    // Wait for the worker thread to finish
+    void Join() { if (worker.joinable()) worker.join(); }
+
+private:
+    // every source drains what is available, adds the count to its argument and returns whether its pipe is finished
+    vector<function<bool(size_t&)> > sources;
+    thread worker;
+
+    void Run();
+};
+
+template<typename V, typename F>
+void LaneWorker::AddSource(Pipe<V>& _pipe, F _handler)
+{
+    Pipe<V>* _source = &_pipe;
+    sources.push_back([_source, _handler](size_t& _handled) mutable
+    {
+        // check before draining, so nothing pushed before the close is missed
+        bool _finished = _source->IsFinished();
+        V _data;
+        while (_source->TryPop(_data))
+        {
+            _handler(_data);
+            ++_handled;
+        }
+        return _finished;
+    });
+}
+
+void LaneWorker::Run()
+{
+    vector<bool> _finished(sources.size(), false);
+    size_t _remaining = sources.size();
+    while (_remaining > 0)
+    {
+        size_t _handled = 0;
+        for (size_t i = 0; i < sources.size(); ++i)
+        {
+            if (_finished[i]) continue;
+            if (sources[i](_handled))
+            {
+                _finished[i] = true;
+                --_remaining;
+            }
+        }
+        if (_handled == 0) this_thread::yield();
+    }
+}
+
+#endif
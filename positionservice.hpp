@@ -8,14 +8,137 @@
 #define POSITION_SERVICE_HPP
 
 #include <string>
-#include <map>
+#include <vector>
+#include <algorithm>
+#include <string_view>
+#include <memory>
+#include <stdexcept>
 #include "soa.hpp"
+#include "productcatalog.hpp"
 #include "tradebookingservice.hpp"
 
 using namespace std;
 
+// Dense index of a book, handed out by the BookCatalog
+typedef unsigned int BookIndex;
+const BookIndex NO_BOOK_INDEX = (BookIndex)-1;
+
+// books of the first block of the catalog, every next block doubles the capacity
+const size_t FIRST_BOOK_BLOCK = 256;
+const size_t BOOK_BLOCK_COUNT = 24; // room for every BookIndex but NO_BOOK_INDEX
+
+/**
+ * Catalog interning the book names to dense indexes, found through an open addressing table of the indexes.
+ * Books are interned and found on the thread of the position service only. Names live in blocks that are never
+ * moved, the catalog grows by adding a block twice the size of the last one, so another thread can read the name
+ * of any book of a position handed to it without a lock.
+ */
+class BookCatalog
+{
+public:
+    BookCatalog() { count = 0; slots = vector<BookIndex>(16, NO_BOOK_INDEX); }
+
+    // Get the index of a book, interning it on first use
+    BookIndex Intern(string_view _book);
+
+    // Get the index of a book, NO_BOOK_INDEX if it is unknown
+    BookIndex Find(string_view _book) const;
+
+    // Get the name of the book at this index
+    const string& GetName(BookIndex _index) const;
+
+    // Get the number of books interned
+    size_t Size() const { return count; }
+
+private:
+    // Get the block holding this index and the offset of the index in it
+    static size_t GetBlock(size_t _index, size_t& _offset);
+    static size_t Hash(string_view _key);
+    void Insert(BookIndex _index);
+
+    unique_ptr<string[]> blocks[BOOK_BLOCK_COUNT]; // block b holds FIRST_BOOK_BLOCK << b names
+    size_t count;
+    vector<BookIndex> slots; // NO_BOOK_INDEX for an empty slot, size is a power of two
+};
+
+size_t BookCatalog::GetBlock(size_t _index, size_t& _offset)
+{
+    // block b starts at FIRST_BOOK_BLOCK * (2^b - 1)
+    size_t _scaled = _index / FIRST_BOOK_BLOCK + 1;
+    size_t _block = 0;
+    while (_scaled >> (_block + 1)) ++_block;
+    _offset = _index - FIRST_BOOK_BLOCK * ((size_t(1) << _block) - 1);
+    return _block;
+}
+
+const string& BookCatalog::GetName(BookIndex _index) const
+{
+    size_t _offset;
+    size_t _block = GetBlock(_index, _offset);
+    return blocks[_block][_offset];
+}
+
+size_t BookCatalog::Hash(string_view _key)
+{
+    // FNV-1a, as the product catalog
+    size_t _hash = 14695981039346656037ull;
+    for (char c : _key)
+    {
+        _hash ^= (unsigned char)c;
+        _hash *= 1099511628211ull;
+    }
+    return _hash;
+}
+
+void BookCatalog::Insert(BookIndex _index)
+{
+    size_t _mask = slots.size() - 1;
+    size_t s = Hash(GetName(_index)) & _mask;
+    while (slots[s] != NO_BOOK_INDEX) s = (s + 1) & _mask;
+    slots[s] = _index;
+}
+
+BookIndex BookCatalog::Find(string_view _book) const
+{
+    size_t _mask = slots.size() - 1;
+    for (size_t s = Hash(_book) & _mask; ; s = (s + 1) & _mask)
+    {
+        BookIndex _index = slots[s];
+        if (_index == NO_BOOK_INDEX || GetName(_index) == _book) return _index;
+    }
+}
+
+BookIndex BookCatalog::Intern(string_view _book)
+{
+    BookIndex _index = Find(_book);
+    if (_index != NO_BOOK_INDEX) return _index;
+    size_t _offset;
+    size_t _block = GetBlock(count, _offset);
+    // a booked trade is never dropped, running out of indexes is fatal
+    if (_block >= BOOK_BLOCK_COUNT) throw length_error("BookCatalog: too many books to intern " + string(_book));
+    if (!blocks[_block]) blocks[_block].reset(new string[FIRST_BOOK_BLOCK << _block]);
+    blocks[_block][_offset] = string(_book);
+    _index = (BookIndex)count++;
+    // keep the load factor at most one half
+    if (count * 2 > slots.size())
+    {
+        slots = vector<BookIndex>(slots.size() * 2, NO_BOOK_INDEX);
+        for (size_t i = 0; i < count; ++i) Insert((BookIndex)i);
+    }
+    else Insert(_index);
+    return _index;
+}
+
+// the catalog shared by all the services of the session
+BookCatalog& GetBookCatalog()
+{
+    static BookCatalog _catalog;
+    return _catalog;
+}
+
 /**
  * Position class in a particular book.
+ * Quantities are kept densely by BookIndex and the aggregate position is kept up to date on every change.
  * Type T is the product type.
  */
 template<typename T>
@@ -32,17 +155,30 @@ public:
   const T& GetProduct() const;
 
   // Get the position quantity
-  long GetPosition(string &book);
+  long GetPosition(string &book) const;
+    long GetPosition(BookIndex _book) const { return _book < positions.size() ? positions[_book] : 0; }
 
   // Get the aggregate position
-  long GetAggregatePosition();
-    // Robert added
-    map<string, long> GetPositions() { return positions; }
+  long GetAggregatePosition() const { return aggregatePosition; }
+
+    // Get the number of books held and the index of the i-th, in alphabetical order of the names
+    size_t GetBookCount() const { return books.size(); }
+    BookIndex GetBook(size_t _i) const { return books[_i]; }
+
+    // Get the book and quantity of the last change
+    BookIndex GetLastBook() const { return lastBook; }
+    long GetLastQuantity() const { return lastQuantity; }
+
     vector<string> ToStrings() const;
-    void AddPosition(string& _book, long _position) { positions[_book] += _position; }
+    void AddPosition(string& _book, long _position) { AddPosition(GetBookCatalog().Intern(_book), _position); }
+    void AddPosition(BookIndex _book, long _position);
 private:
   T product;
-  map<string,long> positions;
+    vector<long> positions; // by BookIndex
+    vector<BookIndex> books; // books held, in alphabetical order
+    long aggregatePosition = 0;
+    BookIndex lastBook = NO_BOOK_INDEX;
+    long lastQuantity = 0;
 
 };
 
@@ -59,36 +195,42 @@ const T& Position<T>::GetProduct() const
 }
 
 template<typename T>
-long Position<T>::GetPosition(string &book)
+long Position<T>::GetPosition(string &book) const
 {
-  return positions[book];
+  return GetPosition(GetBookCatalog().Find(book));
 }
 
 template<typename T>
-long Position<T>::GetAggregatePosition()
+void Position<T>::AddPosition(BookIndex _book, long _position)
 {
-    long aggregatePosition = 0;
-    for (auto& p : positions)
-        aggregatePosition += p.second;
-    return aggregatePosition;
+    if (_book == NO_BOOK_INDEX) throw invalid_argument("Position: no book to add the position to");
+    if (_book >= positions.size()) positions.resize(_book + 1, 0);
+    if (find(books.begin(), books.end(), _book) == books.end())
+    {
+        // first position in this book
+        const BookCatalog& _catalog = GetBookCatalog();
+        auto b = books.begin();
+        while (b != books.end() && _catalog.GetName(*b) < _catalog.GetName(_book)) ++b;
+        books.insert(b, _book);
+    }
+    positions[_book] += _position;
+    aggregatePosition += _position;
+    lastBook = _book;
+    lastQuantity = _position;
 }
 
 template<typename T>
 vector<string> Position<T>::ToStrings() const
 {
-    string _product = product.GetProductId();
-    vector<string> _positions;
-    for (auto& p : positions)
+    const BookCatalog& _catalog = GetBookCatalog();
+    vector<string> res;
+    res.reserve(1 + 2 * books.size());
+    res.push_back(product.GetProductId());
+    for (auto b = books.begin(); b != books.end(); ++b)
     {
-        string _book = p.first;
-        string _position = to_string(p.second);
-        _positions.push_back(_book);
-        _positions.push_back(_position);
+        res.push_back(_catalog.GetName(*b));
+        res.push_back(to_string(positions[*b]));
     }
-    
-    vector<string> res;
-    res.push_back(_product);
-    res.insert(res.end(), _positions.begin(), _positions.end());
     return res;
 }
 
@@ -101,60 +243,46 @@ template<typename T>
 class PositionService : public Service<string, Position<T> >
 {
 private:
-    map<string, Position<T> > positions;
+    ProductStore<Position<T> > positions;
     vector<ServiceListener<Position<T> >*> listeners;
     PositionToTradeBookingListener<T>* listener;
 public:
     PositionService();
     ~PositionService() {} // set empty
     Position<T>& GetData(string _key) { return positions[_key]; }
-    void OnMessage(Position<T>& _data) { positions[_data.GetProduct().GetProductId()] = _data; }
+    Position<T>& GetData(ProductIndex _index) { return positions[_index]; }
+    void OnMessage(Position<T>& _data) { positions[_data.GetProduct().GetProductIndex()] = _data; }
     void AddListener(ServiceListener<Position<T> >* _listener) { listeners.push_back(_listener); }
     const vector<ServiceListener<Position<T> >*>& GetListeners() const { return listeners; }
     PositionToTradeBookingListener<T>* GetListener() { return listener; }
-    virtual void AddTrade(const Trade<T>& _trade);
+    virtual void AddTrade(const Trade<T>& _trade) { AddTrade(_trade, ListenerFanout<Position<T> >(listeners)); }
+    template<typename Sink>
+    void AddTrade(const Trade<T>& _trade, Sink&& _sink);
 };
 
 template<typename T>
 PositionService<T>::PositionService()
 {
-    positions = map<string, Position<T> >();
+    positions = ProductStore<Position<T> >();
     listeners = vector<ServiceListener<Position<T> >*>();
     listener = new PositionToTradeBookingListener<T>(this);
 }
 
 template<typename T>
-void PositionService<T>::AddTrade(const Trade<T>& _trade)
+template<typename Sink>
+void PositionService<T>::AddTrade(const Trade<T>& _trade, Sink&& _sink)
 {
-    T _product = _trade.GetProduct();
-    string _productId = _product.GetProductId();
-    double _price = _trade.GetPrice();
-    string _book = _trade.GetBook();
+    const T& _product = _trade.GetProduct();
+    BookIndex _book = GetBookCatalog().Intern(_trade.GetBook());
     long _quantity = _trade.GetQuantity();
-    Side _side = _trade.GetSide();
-    Position<T> _positionTo(_product);
-    switch (_side)
-    {
-        case BUY:
-            _positionTo.AddPosition(_book, _quantity);
-            break;
-        case SELL:
-            _positionTo.AddPosition(_book, -_quantity);
-            break;
-    }
-    
-    Position<T> _positionFrom = positions[_productId];
-    map <string, long> _positionMap = _positionFrom.GetPositions();
-    for (auto p = _positionMap.begin(); p != _positionMap.end(); ++p)
-    {
-        _book = p->first;
-        _quantity = p->second;
-        _positionTo.AddPosition(_book, _quantity);
-    }
-    positions[_productId] = _positionTo;
+    if (_trade.GetSide() == SELL) _quantity = -_quantity;
+
+    // the position is updated in place, the listeners see the stored position
+    Position<T>& _position = positions[_product.GetProductIndex()];
+    if (_position.GetBookCount() == 0) _position = Position<T>(_product);
+    _position.AddPosition(_book, _quantity);
     
-    for (auto l = listeners.begin(); l != listeners.end(); ++l)
-        (*l)->ProcessAdd(_positionTo);
+    _sink(_position);
 }
 
 
@@ -167,6 +295,8 @@ public:
     PositionToTradeBookingListener(PositionService<T>* _service) { service = _service; }
     ~PositionToTradeBookingListener() {} // set empty
     void ProcessAdd(Trade<T>& _data) { service->AddTrade(_data); }
+    template<typename Sink>
+    void ProcessAdd(Trade<T>& _data, Sink&& _sink) { service->AddTrade(_data, _sink); }
     void ProcessRemove(Trade<T>& _data) {} // set empty
     void ProcessUpdate(Trade<T>& _data) {} // set empty
 };
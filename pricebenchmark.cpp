@@ -0,0 +1,156 @@
+//
+//  pricebenchmark.cpp
+//  tradingsystem
+//
+//  Checks the fractional price parsers against the formatter: every tick up to 1000-00 is written by
+//  ConvertPrice(double) and read back by ParsePrice, ConvertPrice(string_view) and ParsePrices, and every
+//  fraction made of digits, '+', '-' and a few other characters is accepted or rejected alike by the single
+//  and the batch parser. Then measures the parsers on a column of prices, against the parse by stod they replace.
+//
+//  usage: pricebenchmark [prices] [repeats]
+//
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+#include "tools.hpp"
+
+// keeps the values parsed from being optimized away
+volatile double parseSink;
+
+// the parse by stod of three temporary strings the parsers replace
+double ConvertPriceByStod(string _price)
+{
+    int count = 0;
+    string _price_int = "";
+    string _price_32 = "";
+    string _price_256 = "";
+    for (size_t i = 0; i < _price.size(); ++i)
+    {
+        if (_price[i] == '-')
+        {
+            ++count;
+            continue;
+        }
+        if (count == 0) _price_int.push_back(_price[i]);
+        else if (count == 1 || count == 2)
+        {
+            _price_32.push_back(_price[i]);
+            ++count;
+        }
+        else _price_256.push_back(_price[i] == '+' ? '4' : _price[i]);
+    }
+    return stod(_price_int) + stod(_price_32) / 32. + stod(_price_256) / 256.;
+}
+
+// whether _suffix is the fraction of a tick as FormatPrice writes it, or with the half tick written '4' instead of '+'
+bool IsPriceFraction(const char* _suffix)
+{
+    char _written[4];
+    memcpy(_written, _suffix, 4);
+    if (_written[3] == '4') _written[3] = '+';
+    for (int t = 0; t < 256; ++t)
+        if (memcmp(PRICE_FRACTIONS.suffix[t], _written, 4) == 0) return true;
+    return false;
+}
+
+int main(int argc, const char * argv[])
+{
+    size_t _count = argc > 1 ? stoul(argv[1]) : 1000000;
+    int _repeats = argc > 2 ? atoi(argv[2]) : 10;
+    if (_count == 0 || _repeats <= 0)
+    {
+        cerr << "usage: " << argv[0] << " [prices] [repeats]" << endl;
+        return 1;
+    }
+
+    // round trip of every tick up to 1000-00
+    const long _maxTicks = 1000 * 256;
+    vector<string> _formatted;
+    for (long t = 0; t <= _maxTicks; ++t)
+        _formatted.push_back(ConvertPrice(t / 256.));
+    vector<string_view> _views(_formatted.begin(), _formatted.end());
+    vector<double> _values(_views.size());
+    long _roundTripErrors = (long)ParsePrices(_views.data(), _values.data(), _views.size());
+    for (long t = 0; t <= _maxTicks; ++t)
+    {
+        double _value = NAN;
+        long _ticks = -1;
+        bool _ok = ParsePrice(_views[t], _value) == PRICE_OK && _value == t / 256.
+            && ParsePriceTicks(_views[t], _ticks) == PRICE_OK && _ticks == t
+            && ConvertPrice(_views[t]) == t / 256. && _values[t] == t / 256.;
+        if (!_ok) ++_roundTripErrors;
+    }
+    cout << _maxTicks + 1 << " ticks formatted and parsed back, " << _roundTripErrors << " errors" << endl;
+
+    // every fraction over an alphabet around the valid characters, behind integer parts valid and not
+    const char _alphabet[] = "0123456789+-./ a";
+    const size_t _letters = sizeof(_alphabet) - 1;
+    const string _integers[] = { "", "0", "99", "100", "123456789", "1234567890", "99999999999999999999999", "1-", "x1" };
+    vector<string> _inputs;
+    for (const string& _integer : _integers)
+        for (size_t c = 0; c < _letters * _letters * _letters * _letters; ++c)
+        {
+            string _input = _integer;
+            for (size_t k = 0, n = c; k < 4; ++k, n /= _letters) _input.push_back(_alphabet[n % _letters]);
+            _inputs.push_back(_input);
+        }
+    // a few shorter than a fraction
+    _inputs.push_back("");
+    _inputs.push_back("-");
+    _inputs.push_back("1-0");
+    _inputs.push_back("-00+");
+    _views.assign(_inputs.begin(), _inputs.end());
+    _values.assign(_views.size(), 0.);
+    size_t _failed = ParsePrices(_views.data(), _values.data(), _views.size());
+    long _accepted = 0, _disagreements = 0;
+    size_t _rejected = 0;
+    for (size_t i = 0; i < _inputs.size(); ++i)
+    {
+        const string& _input = _inputs[i];
+        size_t _digits = _input.size() < 4 ? 0 : _input.size() - 4;
+        bool _integerValid = _digits >= 1 && _digits <= 9 && _input.find_first_not_of("0123456789") >= _digits;
+        bool _expected = _integerValid && IsPriceFraction(_input.data() + _digits);
+        double _value = NAN;
+        bool _parsed = ParsePrice(_input, _value) == PRICE_OK;
+        bool _batchParsed = _values[i] == _values[i];
+        if (_parsed != _expected || _batchParsed != _expected || (_parsed && _value != _values[i])) ++_disagreements;
+        _accepted += _expected;
+        _rejected += !_batchParsed;
+    }
+    if (_rejected != _failed) ++_disagreements;
+    cout << _inputs.size() << " inputs, " << _accepted << " well formed, " << _disagreements << " disagreements" << endl;
+
+    // a column of prices around par, as the connectors read them
+    vector<double> _uniform = GenerateUniform((long)_count, 12345);
+    vector<string> _column;
+    for (size_t i = 0; i < _count; ++i)
+        _column.push_back(ConvertPrice(99. + 2. * _uniform[i]));
+    _views.assign(_column.begin(), _column.end());
+    _values.assign(_count, 0.);
+
+    double _sum = 0.;
+    long long _start = MonotonicClock::Now();
+    for (int r = 0; r < _repeats; ++r)
+        for (size_t i = 0; i < _count; ++i) _sum += ConvertPriceByStod(_column[i]);
+    long long _stodNanos = MonotonicClock::Now() - _start;
+    _start = MonotonicClock::Now();
+    for (int r = 0; r < _repeats; ++r)
+        for (size_t i = 0; i < _count; ++i) _sum -= ConvertPrice(_views[i]);
+    long long _singleNanos = MonotonicClock::Now() - _start;
+    _start = MonotonicClock::Now();
+    for (int r = 0; r < _repeats; ++r)
+    {
+        ParsePrices(_views.data(), _values.data(), _count);
+        _sum += _values[r % _count];
+    }
+    long long _batchNanos = MonotonicClock::Now() - _start;
+    parseSink = _sum;
+
+    double _parses = (double)_count * _repeats;
+    cout << _count << " prices x " << _repeats << " repeats: " << _stodNanos / _parses << "ns per price by stod, "
+         << _singleNanos / _parses << "ns by ConvertPrice, " << _batchNanos / _parses << "ns by ParsePrices" << endl;
+    return _roundTripErrors == 0 && _disagreements == 0 ? 0 : 1;
+}
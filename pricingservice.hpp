@@ -9,7 +9,8 @@
 
 #include <string>
 #include "soa.hpp"
-#include<boost/algorithm/string.hpp>
+#include "productcatalog.hpp"
+#include "filereader.hpp"
 
 /**
  * A price object consisting of mid and bid/offer spread.
@@ -89,13 +90,13 @@ template<typename T>
 class PricingService : public Service<string,Price <T> >
 {
 private:
-    map<string, Price<T> > prices;
+    ProductStore<Price<T> > prices;
     vector<ServiceListener<Price<T> >*> listeners;
     PricingConnector<T>* connector;
 public:
     PricingService()
     {
-        prices = map<string, Price<T> >();
+        prices = ProductStore<Price<T> >();
         listeners = vector<ServiceListener<Price<T> >*>();
         connector = new PricingConnector<T>(this);
     }
@@ -103,11 +104,20 @@ public:
     {
         return prices[_key];
     }
+    Price<T>& GetData(ProductIndex _index)
+    {
+        return prices[_index];
+    }
     void OnMessage(Price<T>& _data) // send data to other services, listener are created by other serices and registered to this pricing service
     {
-        prices[_data.GetProduct().GetProductId()] = _data;
-        for(auto l = listeners.begin(); l !=listeners.end(); ++l)
-            (*l)->ProcessAdd(_data);
+        OnMessage(_data, ListenerFanout<Price<T> >(listeners));
+    }
+    // store the price and hand it to _sink instead of the registered listeners
+    template<typename Sink>
+    void OnMessage(Price<T>& _data, Sink&& _sink)
+    {
+        prices[_data.GetProduct().GetProductIndex()] = _data;
+        _sink(_data);
     }
     void AddListener(ServiceListener<Price<T> >* _listener)
     {
@@ -142,32 +152,53 @@ public:
     void Publish(Price<T>& _data) {} // set empty
     // Subscribe data from the Connector
     void Subscribe(ifstream& _data_in);
+    void Subscribe(const MappedFile& _data_in);
+    // Parse the file and hand every price to _handler(Price<T>&) instead of the service
+    template<typename F>
+    void Parse(const MappedFile& _data_in, F&& _handler);
+private:
+    // Parse one row of prices.txt and hand the price to _handler
+    template<typename F>
+    void ParseRow(const CsvRow& _cells, F& _handler);
 };
 
 template<typename T>
 void PricingConnector<T>::Subscribe(ifstream& _data_in)
 {
     string _thisline;
+    CsvRow _cells;
+    auto _handler = [this](Price<T>& _price) { service->OnMessage(_price); };
     while (getline(_data_in, _thisline))
     {
-        stringstream _lineStream(_thisline);
-        string _item;
-        vector<string> _item_parsing;
-        while (getline(_lineStream, _item, ','))
-        {
-            boost::algorithm::trim(_item);
-            _item_parsing.push_back(_item);
-        }
-        
-        string _productId = _item_parsing[0];
-        double _bidPrice = ConvertPrice(_item_parsing[1]);
-        double _offerPrice = ConvertPrice(_item_parsing[2]);
-        double _midPrice = (_bidPrice + _offerPrice) / 2.;
-        double _spread = _offerPrice - _bidPrice;
-        T _product = GetBond(_productId);
-        Price<T> _price(_product, _midPrice, _spread);
-        service->OnMessage(_price);
+        SplitRow(_thisline, _cells);
+        ParseRow(_cells, _handler);
     }
 }
 
+template<typename T>
+void PricingConnector<T>::Subscribe(const MappedFile& _data_in)
+{
+    Parse(_data_in, [this](Price<T>& _price) { service->OnMessage(_price); });
+}
+
+template<typename T>
+template<typename F>
+void PricingConnector<T>::Parse(const MappedFile& _data_in, F&& _handler)
+{
+    _data_in.ForEachRow([this, &_handler](const CsvRow& _cells) { ParseRow(_cells, _handler); });
+}
+
+template<typename T>
+template<typename F>
+void PricingConnector<T>::ParseRow(const CsvRow& _cells, F& _handler)
+{
+    double _bidPrice = ConvertPrice(_cells[1]);
+    double _offerPrice = ConvertPrice(_cells[2]);
+    double _midPrice = (_bidPrice + _offerPrice) / 2.;
+    double _spread = _offerPrice - _bidPrice;
+    const T& _product = GetBond(_cells[0]);
+    Price<T> _price(_product, _midPrice, _spread);
+    _handler(_price);
+}
+
 #endif
@@ -0,0 +1,215 @@
+/**
+ * productcatalog.hpp
+ * Defines the catalog of bond reference data.
+ * The catalog is loaded once from a file and hands out stable references
+ * to its bonds through an open-addressing hash table keyed on CUSIP.
+ */
+#ifndef PRODUCT_CATALOG_HPP
+#define PRODUCT_CATALOG_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <deque>
+#include "products.hpp"
+#include "filereader.hpp"
+
+using namespace std;
+
+/**
+ * Catalog of bonds with their reference data.
+ * Bonds are never moved once added, so references stay valid for the whole session.
+ * Every bond gets the next dense ProductIndex when it is added.
+ */
+class ProductCatalog
+{
+public:
+    ProductCatalog();
+
+    // Load bonds from a file of rows "cusip,ticker,coupon,maturity,pv01", returns false if the file can't be read
+    bool Load(const string& _path);
+
+    // Add a bond with its PV01, replacing the reference data of a known CUSIP
+    void Add(const Bond& _bond, double _pv01);
+
+    // Get the dense index of the bond with this CUSIP, NO_PRODUCT_INDEX if it is unknown
+    ProductIndex GetProductIndex(string_view _cusip) const;
+
+    // Get the bond at this dense index
+    const Bond& GetBond(ProductIndex _index) const { return bonds[_index]; }
+
+    // Get the bond with this CUSIP, or nullptr if it is unknown
+    const Bond* Find(string_view _cusip) const;
+
+    // Get the bond with this CUSIP, or a placeholder bond if it is unknown
+    const Bond& GetBond(string_view _cusip) const;
+
+    // Get the PV01 of the bond with this CUSIP, 0 if it is unknown
+    double GetPV01(string_view _cusip) const;
+
+    // Get the PV01 of the bond at this dense index, 0 for NO_PRODUCT_INDEX
+    double GetPV01(ProductIndex _index) const { return _index < pv01s.size() ? pv01s[_index] : 0.; }
+
+    // Get the number of bonds in the catalog
+    size_t Size() const { return bonds.size(); }
+
+private:
+    deque<Bond> bonds;
+    vector<double> pv01s;
+    vector<int> slots; // indexes into bonds, -1 for an empty slot, size is a power of two
+    Bond unknown;
+
+    static size_t Hash(string_view _key);
+    int FindIndex(string_view _cusip) const;
+    void Insert(int _index);
+    void Rehash(size_t _slotCount);
+};
+
+ProductCatalog::ProductCatalog() :
+unknown("999999999", CUSIP, "US99Y", 0.02750, from_string("2047/12/15"))
+{
+    slots = vector<int>(16, -1);
+}
+
+size_t ProductCatalog::Hash(string_view _key)
+{
+    // FNV-1a
+    size_t _hash = 14695981039346656037ull;
+    for (char c : _key)
+    {
+        _hash ^= (unsigned char)c;
+        _hash *= 1099511628211ull;
+    }
+    return _hash;
+}
+
+int ProductCatalog::FindIndex(string_view _cusip) const
+{
+    size_t _mask = slots.size() - 1;
+    for (size_t s = Hash(_cusip) & _mask; ; s = (s + 1) & _mask)
+    {
+        int _index = slots[s];
+        if (_index < 0) return -1;
+        if (bonds[_index].GetProductId() == _cusip) return _index;
+    }
+}
+
+void ProductCatalog::Insert(int _index)
+{
+    size_t _mask = slots.size() - 1;
+    size_t s = Hash(bonds[_index].GetProductId()) & _mask;
+    while (slots[s] >= 0) s = (s + 1) & _mask;
+    slots[s] = _index;
+}
+
+void ProductCatalog::Rehash(size_t _slotCount)
+{
+    slots = vector<int>(_slotCount, -1);
+    for (size_t i = 0; i < bonds.size(); ++i)
+        Insert((int)i);
+}
+
+void ProductCatalog::Add(const Bond& _bond, double _pv01)
+{
+    int _index = FindIndex(_bond.GetProductId());
+    if (_index >= 0)
+    {
+        bonds[_index] = _bond;
+        bonds[_index].SetProductIndex((ProductIndex)_index);
+        pv01s[_index] = _pv01;
+        return;
+    }
+
+    bonds.push_back(_bond);
+    bonds.back().SetProductIndex((ProductIndex)(bonds.size() - 1));
+    pv01s.push_back(_pv01);
+    // keep the load factor at most one half
+    if (bonds.size() * 2 > slots.size()) Rehash(slots.size() * 2);
+    else Insert((int)bonds.size() - 1);
+}
+
+bool ProductCatalog::Load(const string& _path)
+{
+    MappedFile _file(_path);
+    if (!_file.IsOpen()) return false;
+
+    _file.ForEachRow([this](const CsvRow& _cells)
+    {
+        string _cusip(_cells[0]);
+        string _ticker(_cells[1]);
+        float _coupon = stof(string(_cells[2]));
+        date _maturity = from_string(string(_cells[3]));
+        double _pv01 = stod(string(_cells[4]));
+        Add(Bond(_cusip, CUSIP, _ticker, _coupon, _maturity), _pv01);
+    });
+    return true;
+}
+
+ProductIndex ProductCatalog::GetProductIndex(string_view _cusip) const
+{
+    int _index = FindIndex(_cusip);
+    return _index < 0 ? NO_PRODUCT_INDEX : (ProductIndex)_index;
+}
+
+const Bond* ProductCatalog::Find(string_view _cusip) const
+{
+    int _index = FindIndex(_cusip);
+    return _index < 0 ? nullptr : &bonds[_index];
+}
+
+const Bond& ProductCatalog::GetBond(string_view _cusip) const
+{
+    int _index = FindIndex(_cusip);
+    return _index < 0 ? unknown : bonds[_index];
+}
+
+double ProductCatalog::GetPV01(string_view _cusip) const
+{
+    int _index = FindIndex(_cusip);
+    return _index < 0 ? 0. : pv01s[_index];
+}
+
+// the catalog shared by all the services of the session
+ProductCatalog& GetProductCatalog()
+{
+    static ProductCatalog _catalog;
+    return _catalog;
+}
+
+/**
+ * Dense store of one value per product, indexed by ProductIndex.
+ * Values of products that are not in the catalog share a single fallback slot.
+ * Type V is the value type.
+ */
+template<typename V>
+class ProductStore
+{
+public:
+    ProductStore() { values.resize(GetProductCatalog().Size()); }
+
+    // Get the value of the product at this index
+    V& operator[](ProductIndex _index);
+
+    // Get the value of the product at this index without growing the store, the fallback slot if it is out of range
+    const V& operator[](ProductIndex _index) const { return _index < values.size() ? values[_index] : unknown; }
+
+    // Get the value of the product with this identifier, looked up in the catalog
+    V& operator[](string_view _productId) { return (*this)[GetProductCatalog().GetProductIndex(_productId)]; }
+
+    // Get the number of products in the store
+    size_t Size() const { return values.size(); }
+private:
+    vector<V> values;
+    V unknown;
+};
+
+template<typename V>
+V& ProductStore<V>::operator[](ProductIndex _index)
+{
+    if (_index == NO_PRODUCT_INDEX) return unknown;
+    // products added to the catalog after the store was built
+    if (_index >= values.size()) values.resize(_index + 1);
+    return values[_index];
+}
+
+#endif
@@ -17,6 +17,10 @@ using namespace boost::gregorian;
 
 enum ProductType { IRSWAP, BOND };
 
+// Dense index of a product, assigned by the product catalog when the product is loaded
+typedef unsigned int ProductIndex;
+const ProductIndex NO_PRODUCT_INDEX = (ProductIndex)-1;
+
 /**
  * Base class for a product.
  */
@@ -35,9 +39,16 @@ public:
   // Ge the product type
   ProductType GetProductType() const;
 
+  // Get the dense index of the product, NO_PRODUCT_INDEX if it is not in the catalog
+  ProductIndex GetProductIndex() const { return productIndex; }
+
+  // Set the dense index of the product
+  void SetProductIndex(ProductIndex _productIndex) { productIndex = _productIndex; }
+
 private:
   string productId;
   ProductType productType;
+  ProductIndex productIndex = NO_PRODUCT_INDEX;
 
 };
 
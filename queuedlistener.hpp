@@ -0,0 +1,265 @@
+/**
+ * queuedlistener.hpp
+ * Defines a listener adapter decoupling any ServiceListener from its upstream
+ * service through a single-producer/single-consumer ring and a drain thread.
+ */
+#ifndef QUEUED_LISTENER_HPP
+#define QUEUED_LISTENER_HPP
+
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <vector>
+#include "soa.hpp"
+#include "ringbuffer.hpp"
+#include "productcatalog.hpp"
+
+using namespace std;
+
+// What the producer does when the ring is full
+// BLOCK waits for the drain thread, DROP_OLDEST evicts the oldest event,
+// CONFLATE keeps only the latest event per key in a slot flagged in a dirty bitmap, so nothing ever backs up
+enum BackpressurePolicy { BLOCK, DROP_OLDEST, CONFLATE };
+
+// Kind of a queued listener callback
+enum ListenerEvent { ADD_EVENT, REMOVE_EVENT, UPDATE_EVENT };
+
+/**
+ * Listener queueing every callback and replaying it on the wrapped listener from a drain thread.
+ * Only one upstream thread may call it, the wrapped listener is only called from the drain thread.
+ * When conflating, events are keyed on the product index of V and the drain thread
+ * hands over the newest event of every dirty product, in product order.
+ * Type V is the data type.
+ */
+template<typename V>
+class QueuedListener : public ServiceListener<V>
+{
+public:
+    QueuedListener(ServiceListener<V>* _listener, size_t _capacity = 4096, BackpressurePolicy _policy = BLOCK);
+    ~QueuedListener() { Stop(); }
+    QueuedListener(const QueuedListener&) = delete;
+    QueuedListener& operator=(const QueuedListener&) = delete;
+
+    void ProcessAdd(V& _data) { Enqueue(_data, ADD_EVENT); }
+    void ProcessRemove(V& _data) { Enqueue(_data, REMOVE_EVENT); }
+    void ProcessUpdate(V& _data) { Enqueue(_data, UPDATE_EVENT); }
+
+    // Wait until every event queued so far has been handed to the wrapped listener
+    void Drain();
+
+    // Drain the queue and stop the drain thread
+    void Stop();
+
+    // Get the number of events dropped by DROP_OLDEST
+    long GetDroppedCount() const { return dropped.load(memory_order_relaxed); }
+
+    // Get the number of events replaced by a newer one of the same key under CONFLATE
+    long GetConflatedCount() const { return conflated.load(memory_order_relaxed); }
+
+    // Get the number of events of one product replaced by a newer one under CONFLATE
+    long GetConflatedCount(ProductIndex _index) const;
+
+private:
+    struct Event
+    {
+        V data;
+        ListenerEvent kind;
+    };
+
+    // latest event of one key when conflating
+    struct LatestSlot
+    {
+        atomic_flag lock = ATOMIC_FLAG_INIT;
+        bool pending = false;
+        atomic<long> conflated{0};
+        Event event;
+    };
+
+    ServiceListener<V>* listener;
+    BackpressurePolicy policy;
+    SpscQueue<Event> events;
+    vector<LatestSlot> latest;
+    vector<atomic<uint64_t> > dirty; // one bit per latest slot holding an event not handed over yet
+
+    // counters, written by the producer and the drain thread on separate cache lines
+    alignas(CACHE_LINE_SIZE) atomic<long> queued;
+    atomic<long> dropped;
+    atomic<long> conflated;
+    alignas(CACHE_LINE_SIZE) atomic<long> handled;
+    atomic<bool> running;
+    thread drain;
+
+    void Enqueue(V& _data, ListenerEvent _kind);
+    void Dispatch(Event& _event);
+    // Hand over the events of every dirty slot, returns how many
+    size_t DrainDirty(Event& _event);
+    void Run();
+};
+
+template<typename V>
+QueuedListener<V>::QueuedListener(ServiceListener<V>* _listener, size_t _capacity, BackpressurePolicy _policy) :
+events(_policy == CONFLATE ? 2 : _capacity),
+latest(_policy == CONFLATE ? GetProductCatalog().Size() + 1 : 0),
+dirty((latest.size() + 63) / 64),
+queued(0), dropped(0), conflated(0), handled(0), running(true)
+{
+    for (auto d = dirty.begin(); d != dirty.end(); ++d) d->store(0, memory_order_relaxed);
+    listener = _listener;
+    policy = _policy;
+    drain = thread([this]() { Run(); });
+}
+
+template<typename V>
+void QueuedListener<V>::Enqueue(V& _data, ListenerEvent _kind)
+{
+    queued.fetch_add(1, memory_order_relaxed);
+    switch (policy)
+    {
+        case BLOCK:
+        {
+            Event _event{_data, _kind};
+            while (!events.TryPush(_event)) this_thread::yield();
+            break;
+        }
+        case DROP_OLDEST:
+        {
+            Event _event{_data, _kind};
+            if (events.PushEvict(_event))
+            {
+                dropped.fetch_add(1, memory_order_relaxed);
+                handled.fetch_add(1, memory_order_release);
+            }
+            break;
+        }
+        case CONFLATE:
+        {
+            // products outside the catalog share the last slot
+            size_t _key = min((size_t)_data.GetProduct().GetProductIndex(), latest.size() - 1);
+            LatestSlot& _slot = latest[_key];
+            while (_slot.lock.test_and_set(memory_order_acquire)) ;
+            bool _wasPending = _slot.pending;
+            _slot.event.data = _data;
+            _slot.event.kind = _kind;
+            _slot.pending = true;
+            if (_wasPending) _slot.conflated.fetch_add(1, memory_order_relaxed);
+            _slot.lock.clear(memory_order_release);
+            if (_wasPending)
+            {
+                conflated.fetch_add(1, memory_order_relaxed);
+                handled.fetch_add(1, memory_order_release);
+            }
+            else
+            {
+                // the slot is flagged once per pending event, a newer event only replaces the data
+                dirty[_key / 64].fetch_or((uint64_t)1 << (_key % 64), memory_order_release);
+            }
+            break;
+        }
+    }
+}
+
+template<typename V>
+void QueuedListener<V>::Dispatch(Event& _event)
+{
+    switch (_event.kind)
+    {
+        case ADD_EVENT:
+            listener->ProcessAdd(_event.data);
+            break;
+        case REMOVE_EVENT:
+            listener->ProcessRemove(_event.data);
+            break;
+        case UPDATE_EVENT:
+            listener->ProcessUpdate(_event.data);
+            break;
+    }
+    handled.fetch_add(1, memory_order_release);
+}
+
+template<typename V>
+long QueuedListener<V>::GetConflatedCount(ProductIndex _index) const
+{
+    if (policy != CONFLATE) return 0;
+    const LatestSlot& _slot = latest[min((size_t)_index, latest.size() - 1)];
+    return _slot.conflated.load(memory_order_relaxed);
+}
+
+template<typename V>
+size_t QueuedListener<V>::DrainDirty(Event& _event)
+{
+    size_t _count = 0;
+    for (size_t w = 0; w < dirty.size(); ++w)
+    {
+        // take the whole word, slots flagged after this are found on the next pass
+        uint64_t _bits = dirty[w].exchange(0, memory_order_acquire);
+        while (_bits != 0)
+        {
+            size_t _key = w * 64 + __builtin_ctzll(_bits);
+            _bits &= _bits - 1;
+            LatestSlot& _slot = latest[_key];
+            while (_slot.lock.test_and_set(memory_order_acquire)) ;
+            _event = _slot.event;
+            _slot.pending = false;
+            _slot.lock.clear(memory_order_release);
+            Dispatch(_event);
+            ++_count;
+        }
+    }
+    return _count;
+}
+
+template<typename V>
+void QueuedListener<V>::Run()
+{
+    Event _event;
+    int _idle = 0;
+    while (true)
+    {
+        bool _stopping = !running.load(memory_order_acquire);
+        bool _found = false;
+        if (policy == CONFLATE)
+        {
+            _found = DrainDirty(_event) > 0;
+        }
+        else if (events.TryPop(_event))
+        {
+            Dispatch(_event);
+            _found = true;
+        }
+
+        if (_found)
+        {
+            _idle = 0;
+        }
+        else if (_stopping)
+        {
+            break;
+        }
+        else if (++_idle < 64)
+        {
+            this_thread::yield();
+        }
+        else
+        {
+            // back off once the upstream service has gone quiet
+            this_thread::sleep_for(chrono::microseconds(100));
+        }
+    }
+}
+
+template<typename V>
+void QueuedListener<V>::Drain()
+{
+    long _queued = queued.load(memory_order_relaxed);
+    while (handled.load(memory_order_acquire) < _queued) this_thread::yield();
+}
+
+template<typename V>
+void QueuedListener<V>::Stop()
+{
+    if (!drain.joinable()) return;
+    running.store(false, memory_order_release);
+    drain.join();
+}
+
+#endif
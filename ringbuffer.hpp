@@ -0,0 +1,236 @@
+/**
+ * ringbuffer.hpp
+ * Defines bounded lock-free queues used to hand data between threads.
+ */
+#ifndef RING_BUFFER_HPP
+#define RING_BUFFER_HPP
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+
+using namespace std;
+
+// size of a cache line, used to keep producer and consumer state apart
+const size_t CACHE_LINE_SIZE = 64;
+
+// round a queue capacity up to a power of two, at least 2
+size_t RoundUpCapacity(size_t _capacity)
+{
+    size_t _size = 2;
+    while (_size < _capacity) _size *= 2;
+    return _size;
+}
+
+/**
+ * Bounded single-producer/single-consumer ring buffer.
+ * Exactly one thread may push and exactly one thread may pop.
+ * Every slot carries a sequence number, so the producer can also evict the
+ * oldest element (PushEvict) while the consumer is popping.
+ * Type T is the element type, it must be default constructible and copy assignable.
+ */
+template<typename T>
+class SpscQueue
+{
+public:
+    // ctor for a queue, the capacity is rounded up to a power of two
+    explicit SpscQueue(size_t _capacity);
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    // Push a copy of _value, returns false if the queue is full (producer only)
+    bool TryPush(const T& _value);
+
+    // Push a copy of _value, dropping the oldest element if the queue is full (producer only)
+    // returns whether an element was dropped
+    bool PushEvict(const T& _value);
+
+    // Pop the oldest element into _value, returns false if the queue is empty (consumer only)
+    bool TryPop(T& _value);
+
+    // Get the number of elements in the queue, exact only when called from the producer or consumer
+    size_t Size() const;
+
+    // Get the capacity of the queue
+    size_t Capacity() const { return mask + 1; }
+
+private:
+    struct Slot
+    {
+        atomic<size_t> sequence;
+        T value;
+    };
+
+    vector<Slot> slots;
+    size_t mask;
+
+    // consumer side, also advanced by the producer when it evicts
+    alignas(CACHE_LINE_SIZE) atomic<size_t> head;
+
+    // producer side
+    alignas(CACHE_LINE_SIZE) atomic<size_t> tail;
+};
+
+template<typename T>
+SpscQueue<T>::SpscQueue(size_t _capacity) :
+slots(RoundUpCapacity(_capacity)), head(0), tail(0)
+{
+    mask = slots.size() - 1;
+    for (size_t i = 0; i < slots.size(); ++i)
+        slots[i].sequence.store(i, memory_order_relaxed);
+}
+
+template<typename T>
+size_t SpscQueue<T>::Size() const
+{
+    size_t _head = head.load(memory_order_acquire);
+    size_t _tail = tail.load(memory_order_acquire);
+    return _tail > _head ? _tail - _head : 0;
+}
+
+template<typename T>
+bool SpscQueue<T>::TryPush(const T& _value)
+{
+    size_t _tail = tail.load(memory_order_relaxed);
+    Slot& _slot = slots[_tail & mask];
+    // the slot is free once the consumer has released it for this lap
+    if (_slot.sequence.load(memory_order_acquire) != _tail) return false;
+    _slot.value = _value;
+    _slot.sequence.store(_tail + 1, memory_order_release);
+    tail.store(_tail + 1, memory_order_release);
+    return true;
+}
+
+template<typename T>
+bool SpscQueue<T>::PushEvict(const T& _value)
+{
+    bool _dropped = false;
+    while (!TryPush(_value))
+    {
+        T _oldest;
+        if (TryPop(_oldest)) _dropped = true;
+    }
+    return _dropped;
+}
+
+template<typename T>
+bool SpscQueue<T>::TryPop(T& _value)
+{
+    size_t _head = head.load(memory_order_relaxed);
+    while (true)
+    {
+        Slot& _slot = slots[_head & mask];
+        if (_slot.sequence.load(memory_order_acquire) != _head + 1) return false;
+        // claim the slot, the producer may be evicting it at the same time
+        if (head.compare_exchange_weak(_head, _head + 1, memory_order_acq_rel, memory_order_relaxed))
+        {
+            _value = _slot.value;
+            _slot.sequence.store(_head + mask + 1, memory_order_release);
+            return true;
+        }
+    }
+}
+
+/**
+ * Bounded multi-producer/single-consumer ring buffer.
+ * Any number of threads may push, exactly one thread may pop.
+ * Producers claim a slot with a CAS on the tail and publish it through the slot sequence number.
+ * Type T is the element type, it must be default constructible and copy assignable.
+ */
+template<typename T>
+class MpscQueue
+{
+public:
+    // ctor for a queue, the capacity is rounded up to a power of two
+    explicit MpscQueue(size_t _capacity);
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    // Push a copy of _value, returns false if the queue is full (any thread)
+    bool TryPush(const T& _value);
+
+    // Pop the oldest element into _value, returns false if the queue is empty (consumer only)
+    bool TryPop(T& _value);
+
+    // Get the number of elements in the queue, approximate while producers are pushing
+    size_t Size() const;
+
+    // Get the capacity of the queue
+    size_t Capacity() const { return mask + 1; }
+
+private:
+    struct Slot
+    {
+        atomic<size_t> sequence;
+        T value;
+    };
+
+    vector<Slot> slots;
+    size_t mask;
+
+    // consumer side
+    alignas(CACHE_LINE_SIZE) atomic<size_t> head;
+
+    // producer side, shared by all the producers
+    alignas(CACHE_LINE_SIZE) atomic<size_t> tail;
+};
+
+template<typename T>
+MpscQueue<T>::MpscQueue(size_t _capacity) :
+slots(RoundUpCapacity(_capacity)), head(0), tail(0)
+{
+    mask = slots.size() - 1;
+    for (size_t i = 0; i < slots.size(); ++i)
+        slots[i].sequence.store(i, memory_order_relaxed);
+}
+
+template<typename T>
+size_t MpscQueue<T>::Size() const
+{
+    size_t _head = head.load(memory_order_acquire);
+    size_t _tail = tail.load(memory_order_acquire);
+    return _tail > _head ? _tail - _head : 0;
+}
+
+template<typename T>
+bool MpscQueue<T>::TryPush(const T& _value)
+{
+    size_t _tail = tail.load(memory_order_relaxed);
+    while (true)
+    {
+        Slot& _slot = slots[_tail & mask];
+        intptr_t _lap = (intptr_t)_slot.sequence.load(memory_order_acquire) - (intptr_t)_tail;
+        if (_lap == 0)
+        {
+            // the slot is free for this lap, claim it against the other producers
+            if (tail.compare_exchange_weak(_tail, _tail + 1, memory_order_relaxed)) break;
+        }
+        else if (_lap < 0)
+        {
+            // the consumer has not released the slot yet
+            return false;
+        }
+        else
+        {
+            _tail = tail.load(memory_order_relaxed);
+        }
+    }
+    Slot& _slot = slots[_tail & mask];
+    _slot.value = _value;
+    _slot.sequence.store(_tail + 1, memory_order_release);
+    return true;
+}
+
+template<typename T>
+bool MpscQueue<T>::TryPop(T& _value)
+{
+    size_t _head = head.load(memory_order_relaxed);
+    Slot& _slot = slots[_head & mask];
+    if (_slot.sequence.load(memory_order_acquire) != _head + 1) return false;
+    _value = _slot.value;
+    _slot.sequence.store(_head + mask + 1, memory_order_release);
+    head.store(_head + 1, memory_order_release);
+    return true;
+}
+
+#endif
@@ -7,8 +7,14 @@
 #ifndef RISK_SERVICE_HPP
 #define RISK_SERVICE_HPP
 
+#include <array>
+#include <atomic>
+#include <memory>
 #include "soa.hpp"
+#include "productcatalog.hpp"
 #include "positionservice.hpp"
+#include "bondanalytics.hpp"
+#include "scenarioengine.hpp"
 
 /**
  * PV01 risk.
@@ -83,6 +89,8 @@ public:
 
   // Get the name of the bucket
   const string& GetName() const;
+    // the name stands for the product ID when the bucket is persisted
+    const string& GetProductId() const { return name; }
 
 private:
   vector<T> products;
@@ -115,64 +123,172 @@ const string& BucketedSector<T>::GetName() const
 // will define later
 template<typename T>
 class RiskToPositionListener;
+template<typename T>
+class RiskToPricingListener;
 
 
+/**
+ * Risk Service keeping the PV01 of every product and running PV01 totals of the front end, belly and long end.
+ * The PV01 of a product comes from the bond analytics at its latest mid, so the risk follows the market:
+ * a position change, or a price tick moving a held bond beyond the tolerance of the analytics, moves the
+ * total of its bucket by the change of its risk only, and the PV01 and the bucket are published.
+ * The totals can be polled from any thread.
+ * Type T is the product type.
+ */
 template<typename T>
 class RiskService : public Service<string, PV01<T> >
 {
 private:
-    map<string, PV01<T> > pv01s;
+    ProductStore<PV01<T> > pv01s;
+    ProductStore<RiskBucket> productBuckets;
+    array<BucketedSector<T>, RISK_BUCKET_COUNT> sectors;
+    array<atomic<double>, RISK_BUCKET_COUNT> bucketPV01s; // written by the thread of the service only
     vector<ServiceListener<PV01<T> >*> listeners;
+    vector<ServiceListener<PV01<BucketedSector<T> > >*> bucketListeners;
     RiskToPositionListener<T>* listener;
+    RiskToPricingListener<T>* pricingListener;
+    unique_ptr<ScenarioEngine> scenarioEngine; // built on the first run
 public:
     RiskService();
     ~RiskService() {} // set empty
     PV01<T>& GetData(string _key) { return pv01s[_key]; }
-    void OnMessage(PV01<T>& _data) { pv01s[_data.GetProduct().GetProductId()] = _data; }
+    PV01<T>& GetData(ProductIndex _index) { return pv01s[_index]; }
+    void OnMessage(PV01<T>& _data) { pv01s[_data.GetProduct().GetProductIndex()] = _data; }
     void AddListener(ServiceListener<PV01<T> >* _listener) { listeners.push_back(_listener); }
     const vector<ServiceListener<PV01<T> >*>& GetListeners() const { return listeners; }
     RiskToPositionListener<T>* GetListener() { return listener; }
-    void AddPosition(Position<T>& _position);
-    const PV01<BucketedSector<T> >& GetBucketedRisk(const BucketedSector<T>& _sector) const;
+    void AddPosition(Position<T>& _position) { AddPosition(_position, ListenerFanout<PV01<T> >(listeners)); }
+    template<typename Sink>
+    void AddPosition(Position<T>& _position, Sink&& _sink);
+
+    // Get the listener revaluing the risk of a held product on its price ticks
+    RiskToPricingListener<T>* GetPricingListener() { return pricingListener; }
+    void UpdatePrice(Price<T>& _price) { UpdatePrice(_price, ListenerFanout<PV01<T> >(listeners)); }
+    template<typename Sink>
+    void UpdatePrice(Price<T>& _price, Sink&& _sink);
+
+    // Add a listener getting the bucketed risk of a sector every time it changes
+    void AddBucketListener(ServiceListener<PV01<BucketedSector<T> > >* _listener) { bucketListeners.push_back(_listener); }
+
+    // Get the sector of a bucket
+    const BucketedSector<T>& GetSector(RiskBucket _bucket) const { return sectors[_bucket]; }
+
+    // Get the PV01 total of a bucket
+    double GetBucketPV01(RiskBucket _bucket) const { return bucketPV01s[_bucket].load(memory_order_relaxed); }
+
+    // Get the bucketed risk of a bucket, its quantity is 1
+    PV01<BucketedSector<T> > GetBucketedRisk(RiskBucket _bucket) const { return PV01<BucketedSector<T> >(sectors[_bucket], GetBucketPV01(_bucket), 1); }
+
+    // Get the bucketed risk of any sector, summed over its products
+    PV01<BucketedSector<T> > GetBucketedRisk(const BucketedSector<T>& _sector) const;
+
+    // Revalue the positions under every scenario on _threads threads, 0 for one per core, on the thread of the service
+    void RunScenarios(const vector<CurveScenario>& _scenarios, size_t _threads = 0);
+
+    // Get the scenarios of the last run, with the P&L of all the positions or of the position in one product
+    size_t GetScenarioCount() const { return scenarioEngine ? scenarioEngine->GetScenarioCount() : 0; }
+    const CurveScenario& GetScenario(size_t _scenario) const { return scenarioEngine->GetScenario(_scenario); }
+    double GetScenarioPnL(size_t _scenario) const { return scenarioEngine->GetPnL(_scenario); }
+    double GetScenarioPnL(size_t _scenario, ProductIndex _index) const { return scenarioEngine->GetPnL(_scenario, _index); }
+
+    // Get the number of threads of the last run
+    size_t GetScenarioThreadCount() const { return scenarioEngine ? scenarioEngine->GetThreadCount() : 0; }
+
+private:
+    // Store the risk of a product at a PV01 and quantity, move its bucket and publish both
+    template<typename Sink>
+    void UpdateRisk(const T& _product, double _pv01Value, long _quantity, Sink&& _sink);
 };
 
 template<typename T>
 RiskService<T>::RiskService()
 {
-    pv01s = map<string, PV01<T> >();
+    pv01s = ProductStore<PV01<T> >();
     listeners = vector<ServiceListener<PV01<T> >*>();
     listener = new RiskToPositionListener<T>(this);
+    pricingListener = new RiskToPricingListener<T>(this);
+
+    // every product of the catalog falls in one bucket
+    const ProductCatalog& _catalog = GetProductCatalog();
+    array<vector<T>, RISK_BUCKET_COUNT> _products;
+    for (ProductIndex i = 0; i < _catalog.Size(); ++i)
+    {
+        RiskBucket _bucket = GetRiskBucket(_catalog.GetBond(i));
+        productBuckets[i] = _bucket;
+        _products[_bucket].push_back(_catalog.GetBond(i));
+    }
+    for (size_t b = 0; b < RISK_BUCKET_COUNT; ++b)
+    {
+        sectors[b] = BucketedSector<T>(_products[b], GetRiskBucketName((RiskBucket)b));
+        bucketPV01s[b].store(0., memory_order_relaxed);
+    }
+}
+
+template<typename T>
+template<typename Sink>
+void RiskService<T>::AddPosition(Position<T>& _position, Sink&& _sink)
+{
+    const T& _product = _position.GetProduct();
+    UpdateRisk(_product, GetBondAnalytics().GetPV01(_product.GetProductIndex()), _position.GetAggregatePosition(), _sink);
+}
+
+template<typename T>
+template<typename Sink>
+void RiskService<T>::UpdatePrice(Price<T>& _price, Sink&& _sink)
+{
+    // the mid is set in the analytics by the pricing listener, reading the PV01 solves it if it moved beyond the tolerance
+    ProductIndex _index = _price.GetProduct().GetProductIndex();
+    const PV01<T>& _pv01 = pv01s[_index];
+    if (_pv01.GetQuantity() == 0) return;
+    double _pv01Value = GetBondAnalytics().GetPV01(_index);
+    if (_pv01Value == _pv01.GetPV01()) return;
+    UpdateRisk(_pv01.GetProduct(), _pv01Value, _pv01.GetQuantity(), _sink);
 }
 
 template<typename T>
-void RiskService<T>::AddPosition(Position<T>& _position)
+template<typename Sink>
+void RiskService<T>::UpdateRisk(const T& _product, double _pv01Value, long _quantity, Sink&& _sink)
 {
-    T _product = _position.GetProduct();
-    string _productId = _product.GetProductId();
-    double _pv01Value = GetPV01Value(_productId);
-    long _quantity = _position.GetAggregatePosition();
-    PV01<T> _pv01(_product, _pv01Value, _quantity);
-    pv01s[_productId] = _pv01;
+    ProductIndex _index = _product.GetProductIndex();
+    PV01<T>& _pv01 = pv01s[_index];
+    double _change = _pv01Value * _quantity - _pv01.GetPV01() * _pv01.GetQuantity();
+    _pv01 = PV01<T>(_product, _pv01Value, _quantity);
     
-    for (auto l = listeners.begin(); l != listeners.end(); ++l)
-        (*l)->ProcessAdd(_pv01);
+    _sink(_pv01);
+
+    // only the bucket of the product moves, by the change of its risk
+    if (_index >= productBuckets.Size()) return;
+    RiskBucket _bucket = productBuckets[_index];
+    bucketPV01s[_bucket].store(bucketPV01s[_bucket].load(memory_order_relaxed) + _change, memory_order_relaxed);
+    if (bucketListeners.empty()) return;
+    PV01<BucketedSector<T> > _bucketedRisk = GetBucketedRisk(_bucket);
+    for (auto l = bucketListeners.begin(); l != bucketListeners.end(); ++l)
+        (*l)->ProcessAdd(_bucketedRisk);
 }
 
 template<typename T>
-const PV01<BucketedSector<T> >& RiskService<T>::GetBucketedRisk(const BucketedSector<T>& _sector) const
+PV01<BucketedSector<T> > RiskService<T>::GetBucketedRisk(const BucketedSector<T>& _sector) const
 {
-    BucketedSector<T> _product = _sector;
     double _pv01 = 0;
-    long _quantity = 1;
-    
-    vector<T>& _products = _sector.GetProducts();
+    const vector<T>& _products = _sector.GetProducts();
     for (auto p = _products.begin(); p != _products.end(); ++p)
     {
-        string _pId = p->GetProductId();
-        _pv01 += pv01s[_pId].GetPV01() * pv01s[_pId].GetQuantity();
+        const PV01<T>& _productPV01 = pv01s[p->GetProductIndex()];
+        _pv01 += _productPV01.GetPV01() * _productPV01.GetQuantity();
     }
     
-    return PV01<BucketedSector<T> >(_product, _pv01, _quantity);
+    return PV01<BucketedSector<T> >(_sector, _pv01, 1);
+}
+
+template<typename T>
+void RiskService<T>::RunScenarios(const vector<CurveScenario>& _scenarios, size_t _threads)
+{
+    if (!scenarioEngine) scenarioEngine.reset(new ScenarioEngine(GetBondAnalytics()));
+    // the aggregate positions as the service last saw them
+    vector<long> _quantities(GetProductCatalog().Size(), 0);
+    for (size_t i = 0; i < _quantities.size(); ++i)
+        _quantities[i] = pv01s[(ProductIndex)i].GetQuantity();
+    scenarioEngine->Run(_scenarios, _quantities, _threads);
 }
 
 /**
@@ -188,8 +304,30 @@ public:
     RiskToPositionListener(RiskService<T>* _service) { service = _service; }
     ~RiskToPositionListener() {} // set empty
     void ProcessAdd(Position<T>& _data) { service->AddPosition(_data); }
+    template<typename Sink>
+    void ProcessAdd(Position<T>& _data, Sink&& _sink) { service->AddPosition(_data, _sink); }
     void ProcessRemove(Position<T>& _data)  {} // set empty
     void ProcessUpdate(Position<T>& _data) {} // set empty
 };
 
+/**
+ * Risk Service Listener subscribing the prices of the Pricing Service to Risk Service.
+ * It has to run after the listener setting the mids of the bond analytics, on the thread of the Risk Service.
+ * Type T is the product type.
+ */
+template<typename T>
+class RiskToPricingListener : public ServiceListener<Price<T> >
+{
+private:
+    RiskService<T>* service;
+public:
+    RiskToPricingListener(RiskService<T>* _service) { service = _service; }
+    ~RiskToPricingListener() {} // set empty
+    void ProcessAdd(Price<T>& _data) { service->UpdatePrice(_data); }
+    template<typename Sink>
+    void ProcessAdd(Price<T>& _data, Sink&& _sink) { service->UpdatePrice(_data, _sink); }
+    void ProcessRemove(Price<T>& _data) {} // set empty
+    void ProcessUpdate(Price<T>& _data) {} // set empty
+};
+
 #endif
@@ -0,0 +1,202 @@
+//
+//  routingbenchmark.cpp
+//  tradingsystem
+//
+//  Replays marketdata.txt and marketupdates.txt as if every book were quoted on 1 to 3 venues, each venue a few
+//  ticks away from the previous one, and measures the consolidated book reads and the routing decisions.
+//  The consolidated books cached by the MarketDataService are checked against a merge of the venue books.
+//
+//  usage: routingbenchmark [market data file] [market updates file] [repeats]
+//
+
+#include <iostream>
+#include <string>
+#include <map>
+#include <fstream>
+
+using namespace std;
+#include <stdio.h>
+#include "products.hpp"
+#include "tools.hpp"
+#include "soa.hpp"
+#include "filereader.hpp"
+#include "productcatalog.hpp"
+#include "pricingservice.hpp"
+#include "algostreamingservice.hpp"
+#include "marketdataservice.hpp"
+#include "algoexecutionservice.hpp"
+#include "executionservice.hpp"
+
+// keeps the values read from being optimized away
+volatile double readSink;
+
+// ticks between the prices of two consecutive venues
+const double VENUE_SHIFT = 1. / 256.;
+
+// the same book with its prices shifted and its quantities scaled for venue _market
+OrderBook<Bond> ToVenue(const OrderBook<Bond>& _orderBook, Market _market)
+{
+    vector<Order> _bidStack, _offerStack;
+    for (auto b = _orderBook.GetBidStack().begin(); b != _orderBook.GetBidStack().end(); ++b)
+        _bidStack.push_back(Order(b->GetPrice() - _market * VENUE_SHIFT, b->GetQuantity() * (_market + 1), BID));
+    for (auto o = _orderBook.GetOfferStack().begin(); o != _orderBook.GetOfferStack().end(); ++o)
+        _offerStack.push_back(Order(o->GetPrice() + _market * VENUE_SHIFT, o->GetQuantity() * (_market + 1), OFFER));
+    return OrderBook<Bond>(_orderBook.GetProduct(), _bidStack, _offerStack, _market);
+}
+
+BookUpdate<Bond> ToVenue(const BookUpdate<Bond>& _update, Market _market)
+{
+    const Order& _order = _update.GetOrder();
+    double _shift = _order.GetSide() == BID ? -_market * VENUE_SHIFT : _market * VENUE_SHIFT;
+    return BookUpdate<Bond>(_update.GetProduct(), _update.GetAction(), Order(_order.GetPrice() + _shift, _order.GetQuantity() * (_market + 1), _order.GetSide()), _market);
+}
+
+// merge the venue books of a product level by level, as the consolidated book was built on every read
+void MergeVenues(MarketDataService<Bond>& _service, ProductIndex _index, int _venues, OrderBook<Bond>& _merged)
+{
+    _merged.Reset(_service.GetVenueBook(_index, BROKERTEC).GetProduct());
+    for (int m = 0; m < _venues; ++m)
+    {
+        const OrderBook<Bond>& _book = _service.GetVenueBook(_index, (Market)m);
+        for (auto b = _book.GetBidStack().begin(); b != _book.GetBidStack().end(); ++b)
+            _merged.AddLevel(b->GetPrice(), b->GetQuantity(), BID);
+        for (auto o = _book.GetOfferStack().begin(); o != _book.GetOfferStack().end(); ++o)
+            _merged.AddLevel(o->GetPrice(), o->GetQuantity(), OFFER);
+    }
+}
+
+bool SameStack(const vector<Order>& _a, const vector<Order>& _b)
+{
+    if (_a.size() != _b.size()) return false;
+    for (size_t i = 0; i < _a.size(); ++i)
+        if (_a[i].GetPrice() != _b[i].GetPrice() || _a[i].GetQuantity() != _b[i].GetQuantity()) return false;
+    return true;
+}
+
+int main(int argc, const char * argv[])
+{
+    string _marketDataFile = argc > 1 ? argv[1] : "marketdata.txt";
+    string _updatesFile = argc > 2 ? argv[2] : "marketupdates.txt";
+    int _repeats = argc > 3 ? atoi(argv[3]) : 20;
+    if (!GetProductCatalog().Load("products.txt"))
+    {
+        cerr << "failed to read products.txt" << endl;
+        return 1;
+    }
+    MappedFile _marketData(_marketDataFile);
+    MappedFile _updatesData(_updatesFile);
+    if (!_marketData.IsOpen() || !_updatesData.IsOpen() || _repeats <= 0)
+    {
+        cerr << "usage: " << argv[0] << " [market data file] [market updates file] [repeats]" << endl;
+        return 1;
+    }
+
+    // parse once, the replays only time the services
+    MarketDataService<Bond> _parser;
+    vector<OrderBook<Bond> > _books;
+    vector<BookUpdate<Bond> > _updates;
+    _parser.GetConnector()->Parse(_marketData, [&](OrderBook<Bond>& _orderBook) { _books.push_back(_orderBook); });
+    _parser.GetConnector()->ParseUpdates(_updatesData, [&](BookUpdate<Bond>& _update) { _updates.push_back(_update); });
+    cout << _books.size() << " books, " << _updates.size() << " updates, " << _repeats << " repeats" << endl;
+
+    bool _ok = true;
+    OrderBook<Bond> _merged;
+    for (int _venues = 1; _venues <= MARKET_COUNT; ++_venues)
+    {
+        // snapshots: every venue quotes its copy of the book, then the algo execution trades on it
+        MarketDataService<Bond> _service;
+        AlgoExecutionService<Bond> _algoExecution;
+        SmartOrderRouter _router;
+        long _orders = 0, _slices = 0;
+        auto _countOrders = [&](AlgoExecution<Bond>&) { ++_orders; };
+        auto _trade = [&](OrderBook<Bond>& _orderBook) { _algoExecution.GetListener()->ProcessAdd(_orderBook, _countOrders); };
+        vector<OrderBook<Bond> > _venueBooks;
+        for (auto b = _books.begin(); b != _books.end(); ++b)
+            for (int m = 0; m < _venues; ++m) _venueBooks.push_back(ToVenue(*b, (Market)m));
+
+        long long _start = MonotonicClock::Now();
+        for (int r = 0; r < _repeats; ++r)
+            for (auto b = _venueBooks.begin(); b != _venueBooks.end(); ++b) _service.OnMessage(*b, _trade);
+        long long _bookNanos = MonotonicClock::Now() - _start;
+
+        // the routing decision alone, from the cached tops of book
+        RouteSlice _route[MARKET_COUNT];
+        _start = MonotonicClock::Now();
+        for (int r = 0; r < _repeats; ++r)
+            for (auto b = _venueBooks.begin(); b != _venueBooks.end(); ++b)
+            {
+                ProductIndex _index = b->GetProduct().GetProductIndex();
+                _router.Update(_index, b->GetMarket(), b->GetBidOffer());
+                _slices += _router.Route(_index, r % 2 == 0 ? BID : OFFER, 0, _route);
+            }
+        long long _routeNanos = MonotonicClock::Now() - _start;
+
+        // consolidated reads right after a venue changed, the first read after a snapshot rebuilds the cache
+        double _sum = 0.;
+        _start = MonotonicClock::Now();
+        for (int r = 0; r < _repeats; ++r)
+            for (auto b = _venueBooks.begin(); b != _venueBooks.end(); ++b)
+            {
+                _service.OnMessage(*b, [](OrderBook<Bond>&) {});
+                ProductIndex _index = b->GetProduct().GetProductIndex();
+                for (int k = 0; k < 4; ++k) _sum += _service.GetData(_index).GetBidOffer().GetBidOrder().GetPrice();
+            }
+        long long _readNanos = MonotonicClock::Now() - _start;
+        _start = MonotonicClock::Now();
+        for (int r = 0; r < _repeats; ++r)
+            for (auto b = _venueBooks.begin(); b != _venueBooks.end(); ++b)
+            {
+                _service.OnMessage(*b, [](OrderBook<Bond>&) {});
+                ProductIndex _index = b->GetProduct().GetProductIndex();
+                for (int k = 0; k < 4; ++k)
+                {
+                    MergeVenues(_service, _index, _venues, _merged);
+                    _sum -= _merged.GetBidOffer().GetBidOrder().GetPrice();
+                }
+            }
+        long long _mergeNanos = MonotonicClock::Now() - _start;
+
+        // updates: every venue applies its copy, the consolidated book is read and checked after each
+        MarketDataService<Bond> _updateService;
+        vector<BookUpdate<Bond> > _venueUpdates;
+        for (auto u = _updates.begin(); u != _updates.end(); ++u)
+            for (int m = 0; m < _venues; ++m) _venueUpdates.push_back(ToVenue(*u, (Market)m));
+        long _mismatches = 0;
+        long long _updateNanos = 0;
+        for (int r = 0; r < _repeats; ++r)
+        {
+            _start = MonotonicClock::Now();
+            for (auto u = _venueUpdates.begin(); u != _venueUpdates.end(); ++u)
+            {
+                _updateService.OnUpdate(*u, [](OrderBook<Bond>&) {});
+                _sum += _updateService.GetData(u->GetProduct().GetProductIndex()).GetBidOffer().GetOfferOrder().GetPrice();
+            }
+            _updateNanos += MonotonicClock::Now() - _start;
+            if (r > 0) continue;
+            // check once, outside of the timing
+            MarketDataService<Bond> _checkService;
+            for (auto u = _venueUpdates.begin(); u != _venueUpdates.end(); ++u)
+            {
+                _checkService.OnUpdate(*u, [](OrderBook<Bond>&) {});
+                ProductIndex _index = u->GetProduct().GetProductIndex();
+                const OrderBook<Bond>& _consolidated = _checkService.GetData(_index);
+                MergeVenues(_checkService, _index, _venues, _merged);
+                if (!SameStack(_consolidated.GetBidStack(), _merged.GetBidStack()) || !SameStack(_consolidated.GetOfferStack(), _merged.GetOfferStack()))
+                    ++_mismatches;
+            }
+        }
+        _ok = _ok && _mismatches == 0;
+
+        double _bookCount = (double)_venueBooks.size() * _repeats;
+        double _updateCount = (double)_venueUpdates.size() * _repeats;
+        cout << _venues << " venue(s): "
+             << _bookNanos / _bookCount << "ns per book stored and traded (" << _orders << " orders), "
+             << _routeNanos / _bookCount << "ns per routing decision (" << _slices << " slices), "
+             << _readNanos / _bookCount << "ns per snapshot and 4 consolidated reads against "
+             << _mergeNanos / _bookCount << "ns merging on every read, "
+             << _updateNanos / _updateCount << "ns per update and read, "
+             << _mismatches << " mismatches" << endl;
+        readSink = _sum;
+    }
+    return _ok ? 0 : 1;
+}
@@ -0,0 +1,161 @@
+//
+//  scenariobenchmark.cpp
+//  tradingsystem
+//
+//  Revalues positions in 6 to 5000 bonds under the standard curve scenarios on 1 to N threads, and measures
+//  the runs and the discounting kernel. The bonds past those of products.txt are made up, with the tenors
+//  and coupons of the real ones and maturities spread a month apart.
+//  The kernel is checked against a discounting by exp, and the P&L against the run on one thread.
+//
+//  usage: scenariobenchmark [max threads] [repeats]
+//
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+
+using namespace std;
+#include <stdio.h>
+#include "products.hpp"
+#include "tools.hpp"
+#include "soa.hpp"
+#include "productcatalog.hpp"
+#include "bondanalytics.hpp"
+#include "scenarioengine.hpp"
+
+// keeps the values discounted from being optimized away
+volatile double discountSink;
+
+// the discounting the kernel replaces, one exp per flow
+double DiscountFlowsByExp(BondAnalytics& _analytics, ProductIndex _index, double _yield)
+{
+    double _logDiscount = -log1p(_yield / 2.);
+    int _periods = (int)_analytics.GetPeriods(_index);
+    double _value = 0.;
+    for (int k = 0; k < _periods; ++k)
+    {
+        double _amount = _analytics.GetCoupon(_index) + (k == _periods - 1 ? 100. : 0.);
+        _value += _amount * exp(_logDiscount * (_analytics.GetFraction(_index) + k));
+    }
+    return _value;
+}
+
+// add made up bonds to the catalog until it holds _count
+void AddBonds(size_t _count)
+{
+    ProductCatalog& _catalog = GetProductCatalog();
+    const int _tenors[] = { 2, 3, 5, 7, 10, 30 };
+    const float _coupons[] = { 0.0175f, 0.01875f, 0.02f, 0.02125f, 0.0225f, 0.0275f };
+    while (_catalog.Size() < _count)
+    {
+        size_t i = _catalog.Size();
+        int _tenor = _tenors[i % 6];
+        char _cusip[32];
+        snprintf(_cusip, sizeof(_cusip), "SYN%06zu", i);
+        date _maturity = VALUATION_DATE + months(12 * (_tenor - 1) + (int)(i / 6) % (12 * _tenor) + 1);
+        _catalog.Add(Bond(_cusip, CUSIP, "US" + to_string(_tenor) + "Y", _coupons[i % 6], _maturity), 0.);
+    }
+}
+
+int main(int argc, const char * argv[])
+{
+    size_t _maxThreads = argc > 1 ? stoul(argv[1]) : max(1u, thread::hardware_concurrency());
+    int _repeats = argc > 2 ? atoi(argv[2]) : 3;
+    if (!GetProductCatalog().Load("products.txt") || _maxThreads == 0 || _repeats <= 0)
+    {
+        cerr << "usage: " << argv[0] << " [max threads] [repeats], products.txt must be readable" << endl;
+        return 1;
+    }
+
+    vector<CurveScenario> _scenarios = MakeStandardScenarios();
+    const size_t _sizes[] = { 6, 50, 500, 5000 };
+    bool _ok = true;
+    for (size_t _size : _sizes)
+    {
+        // the analytics and the engine take the bonds of the catalog when they are built
+        AddBonds(_size);
+        unique_ptr<BondAnalytics> _analytics(new BondAnalytics());
+        vector<long> _quantities(_size);
+        for (size_t i = 0; i < _size; ++i)
+        {
+            _analytics->SetMid((ProductIndex)i, 99. + (i % 17) / 8.);
+            _quantities[i] = (i % 2 == 0 ? 1 : -1) * 1000000L * (long)(i % 5 + 1);
+        }
+        ScenarioEngine _engine(*_analytics);
+
+        // the flows of every bond back to back, as the engine lays them out
+        vector<double> _amounts;
+        vector<size_t> _starts;
+        for (size_t i = 0; i < _size; ++i)
+        {
+            _starts.push_back(_amounts.size());
+            int _periods = (int)_analytics->GetPeriods((ProductIndex)i);
+            for (int k = 0; k < _periods; ++k)
+                _amounts.push_back(_analytics->GetCoupon((ProductIndex)i) + (k == _periods - 1 ? 100. : 0.));
+        }
+        _starts.push_back(_amounts.size());
+        long _flows = (long)_amounts.size();
+
+        // the kernel alone against exp, over every bond at a yield moving by a basis point a repeat
+        long long _expNanos = 0, _kernelNanos = 0;
+        double _sum = 0., _maxError = 0.;
+        vector<double> _values(_size);
+        for (int r = 0; r < _repeats; ++r)
+        {
+            double _yield = 0.03 + r * 0.0001;
+            long long _start = MonotonicClock::Now();
+            for (size_t i = 0; i < _size; ++i)
+                _sum += DiscountFlowsByExp(*_analytics, (ProductIndex)i, _yield);
+            _expNanos += MonotonicClock::Now() - _start;
+            _start = MonotonicClock::Now();
+            for (size_t i = 0; i < _size; ++i)
+                _values[i] = ScenarioEngine::DiscountFlows(&_amounts[_starts[i]], _starts[i + 1] - _starts[i], 1. / (1. + _yield / 2.), _analytics->GetFraction((ProductIndex)i));
+            _kernelNanos += MonotonicClock::Now() - _start;
+            for (size_t i = 0; i < _size; ++i)
+            {
+                double _expected = DiscountFlowsByExp(*_analytics, (ProductIndex)i, _yield);
+                _maxError = max(_maxError, fabs(_values[i] - _expected) / _expected);
+                _sum -= _values[i];
+            }
+        }
+        discountSink = _sum;
+
+        // full runs on 1 to _maxThreads threads, the P&L must not depend on the split
+        vector<double> _reference;
+        long long _oneThreadNanos = 0;
+        cout << _size << " bonds, " << _flows << " flows, " << _scenarios.size() << " scenarios: kernel "
+             << (double)_kernelNanos / ((double)_flows * _repeats) << "ns per flow against "
+             << (double)_expNanos / ((double)_flows * _repeats) << "ns by exp, max relative error " << _maxError << endl;
+        _ok = _ok && _maxError < 1e-12;
+        for (size_t t = 1; t <= _maxThreads; t = t < _maxThreads && t * 2 > _maxThreads ? _maxThreads : t * 2)
+        {
+            long long _best = 0;
+            for (int r = 0; r < _repeats; ++r)
+            {
+                long long _start = MonotonicClock::Now();
+                _engine.Run(_scenarios, _quantities, t);
+                long long _nanos = MonotonicClock::Now() - _start;
+                if (r == 0 || _nanos < _best) _best = _nanos;
+            }
+            long _mismatches = 0;
+            if (t == 1)
+            {
+                _oneThreadNanos = _best;
+                for (size_t s = 0; s < _scenarios.size(); ++s) _reference.push_back(_engine.GetPnL(s));
+            }
+            else
+            {
+                for (size_t s = 0; s < _scenarios.size(); ++s)
+                    if (_engine.GetPnL(s) != _reference[s]) ++_mismatches;
+            }
+            _ok = _ok && _mismatches == 0;
+            cout << "  " << t << " thread(s): " << _best / 1e6 << "ms per run, "
+                 << (double)_best / ((double)_flows * _scenarios.size()) << "ns per flow, speedup "
+                 << (double)_oneThreadNanos / _best << ", " << _mismatches << " mismatches" << endl;
+            if (t == _maxThreads) break;
+        }
+    }
+    return _ok ? 0 : 1;
+}
@@ -0,0 +1,272 @@
+/**
+ * scenarioengine.hpp
+ * Defines the yield curve scenarios and the engine revaluing the positions under them.
+ * Every bond is revalued in full from its cash flows, at its yield shifted by the scenario, and the grid of
+ * scenarios by products is split between threads by rows of scenarios.
+ * The flows of a bond are one period apart, so their discount factors are powers of the discount of a period:
+ * the kernel steps them by multiplication in SIMD lanes, AVX2 when it is enabled and SSE2 otherwise on x86.
+ */
+#ifndef SCENARIO_ENGINE_HPP
+#define SCENARIO_ENGINE_HPP
+
+#include <string>
+#include <vector>
+#include <array>
+#include <thread>
+#include <cmath>
+#include <algorithm>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+#include "productcatalog.hpp"
+#include "bondanalytics.hpp"
+
+using namespace std;
+
+/**
+ * A shock of the yield curve, the shifts are in yield (0.0001 is one basis point).
+ * The yield of a bond moves by the parallel shift, plus the twist times its years to maturity past the pivot,
+ * plus the key rate shift of its bucket.
+ */
+struct CurveScenario
+{
+    string name;
+    double parallel = 0.;
+    double twist = 0.; // per year of maturity
+    double pivot = 0.; // in years
+    array<double, RISK_BUCKET_COUNT> keyRates = {};
+
+    // Get the shift of the yield of a bond maturing in _years, in _bucket
+    double GetShift(double _years, RiskBucket _bucket) const { return parallel + twist * (_years - pivot) + keyRates[_bucket]; }
+};
+
+// Get the name of a shift, as "+25bp"
+string GetShiftName(double _shift)
+{
+    char _name[32];
+    snprintf(_name, sizeof(_name), "%+gbp", _shift * 10000.);
+    return _name;
+}
+
+// Get a parallel shift of the curve
+CurveScenario ParallelScenario(double _shift)
+{
+    CurveScenario _scenario;
+    _scenario.name = "parallel " + GetShiftName(_shift);
+    _scenario.parallel = _shift;
+    return _scenario;
+}
+
+// Get a twist of the curve around _pivot years, _twist per year of maturity
+CurveScenario TwistScenario(double _twist, double _pivot)
+{
+    CurveScenario _scenario;
+    _scenario.name = "twist " + GetShiftName(_twist) + "/y";
+    _scenario.twist = _twist;
+    _scenario.pivot = _pivot;
+    return _scenario;
+}
+
+// Get a shift of the yields of one bucket
+CurveScenario KeyRateScenario(RiskBucket _bucket, double _shift)
+{
+    CurveScenario _scenario;
+    _scenario.name = GetRiskBucketName(_bucket) + " " + GetShiftName(_shift);
+    _scenario.keyRates[_bucket] = _shift;
+    return _scenario;
+}
+
+// Get the standard set: parallel shifts up to 200bp by 2bp, twists around 5 years up to 10bp a year by 0.5bp
+// and key rate shifts of every bucket up to 100bp by 5bp
+vector<CurveScenario> MakeStandardScenarios()
+{
+    const double _bp = 0.0001;
+    vector<CurveScenario> _scenarios;
+    for (int i = -100; i <= 100; ++i)
+        _scenarios.push_back(ParallelScenario(2. * i * _bp));
+    for (int i = 1; i <= 20; ++i)
+    {
+        _scenarios.push_back(TwistScenario(0.5 * i * _bp, 5.));
+        _scenarios.push_back(TwistScenario(-0.5 * i * _bp, 5.));
+    }
+    for (size_t b = 0; b < RISK_BUCKET_COUNT; ++b)
+    {
+        for (int i = 1; i <= 20; ++i)
+        {
+            _scenarios.push_back(KeyRateScenario((RiskBucket)b, 5. * i * _bp));
+            _scenarios.push_back(KeyRateScenario((RiskBucket)b, -5. * i * _bp));
+        }
+    }
+    return _scenarios;
+}
+
+/**
+ * Engine revaluing positions in the bonds of the catalog under curve scenarios.
+ * The cash flows of every bond are laid out back to back, the yields come from the bond analytics at the
+ * latest mids, so a run is made on the thread reading the analytics.
+ * The P&L of a position under a scenario is its value at the shifted yield less its value at the yield.
+ */
+class ScenarioEngine
+{
+public:
+    // ctor for the bonds of _analytics
+    ScenarioEngine(BondAnalytics& _analytics);
+
+    // Revalue the positions, quantities by ProductIndex, under every scenario on _threads threads, 0 for one per core
+    void Run(const vector<CurveScenario>& _scenarios, const vector<long>& _quantities, size_t _threads = 0);
+
+    // Get the scenarios of the last run
+    size_t GetScenarioCount() const { return scenarios.size(); }
+    const CurveScenario& GetScenario(size_t _scenario) const { return scenarios[_scenario]; }
+
+    // Get the P&L of every position under a scenario of the last run
+    double GetPnL(size_t _scenario) const { return totals[_scenario]; }
+
+    // Get the P&L of the position in a product under a scenario of the last run
+    double GetPnL(size_t _scenario, ProductIndex _index) const { return grid[_scenario * productCount + _index]; }
+
+    // Get the number of threads of the last run
+    size_t GetThreadCount() const { return threadCount; }
+
+    // Get the present value of _count flows one period apart, the first one _fraction of a period away,
+    // discounted by _discount a period
+    static double DiscountFlows(const double* _amounts, size_t _count, double _discount, double _fraction);
+
+private:
+    BondAnalytics& analytics;
+    size_t productCount;
+
+    // flows of every bond, those of product i are in [flowStarts[i], flowStarts[i + 1])
+    vector<double> flowAmounts;
+    vector<double> fractions; // of a period up to the first flow
+    vector<size_t> flowStarts;
+    vector<double> maturities; // in years
+    vector<RiskBucket> buckets;
+
+    // the last run
+    vector<CurveScenario> scenarios;
+    vector<double> yields;
+    vector<double> basePrices;
+    vector<double> notionals; // quantities per 100 face
+    vector<double> grid; // P&L by scenario then product
+    vector<double> totals;
+    size_t threadCount;
+
+    // Fill the rows of the scenarios in [_first, _last)
+    void RunRows(size_t _first, size_t _last);
+};
+
+ScenarioEngine::ScenarioEngine(BondAnalytics& _analytics) :
+analytics(_analytics)
+{
+    productCount = _analytics.Size();
+    threadCount = 0;
+    const ProductCatalog& _catalog = GetProductCatalog();
+    for (size_t i = 0; i < productCount; ++i)
+    {
+        flowStarts.push_back(flowAmounts.size());
+        double _fraction = _analytics.GetFraction((ProductIndex)i);
+        int _periods = (int)_analytics.GetPeriods((ProductIndex)i);
+        for (int k = 0; k < _periods; ++k)
+            flowAmounts.push_back(_analytics.GetCoupon((ProductIndex)i) + (k == _periods - 1 ? 100. : 0.));
+        fractions.push_back(_fraction);
+        maturities.push_back((_fraction + _periods - 1.) / 2.);
+        buckets.push_back(GetRiskBucket(_catalog.GetBond((ProductIndex)i)));
+    }
+    flowStarts.push_back(flowAmounts.size());
+}
+
+double ScenarioEngine::DiscountFlows(const double* _amounts, size_t _count, double _discount, double _fraction)
+{
+    // lane j sums the flows k = j mod lanes, its factor starts at _discount^j and steps by _discount^lanes
+    size_t k = 0;
+    double _factor = 1.;
+    double _sum = 0.;
+#if defined(__AVX2__)
+    __m256d _factors = _mm256_set_pd(_discount * _discount * _discount, _discount * _discount, _discount, 1.);
+    double _discount2 = _discount * _discount;
+    __m256d _step = _mm256_set1_pd(_discount2 * _discount2);
+    __m256d _sums = _mm256_setzero_pd();
+    for (; k + 4 <= _count; k += 4)
+    {
+        _sums = _mm256_add_pd(_sums, _mm256_mul_pd(_mm256_loadu_pd(_amounts + k), _factors));
+        _factors = _mm256_mul_pd(_factors, _step);
+    }
+    __m128d _pairs = _mm_add_pd(_mm256_castpd256_pd128(_sums), _mm256_extractf128_pd(_sums, 1));
+    _sum = _mm_cvtsd_f64(_mm_add_sd(_pairs, _mm_unpackhi_pd(_pairs, _pairs)));
+    _factor = _mm256_cvtsd_f64(_factors);
+#elif defined(__SSE2__)
+    __m128d _factors = _mm_set_pd(_discount, 1.);
+    __m128d _step = _mm_set1_pd(_discount * _discount);
+    __m128d _sums = _mm_setzero_pd();
+    for (; k + 2 <= _count; k += 2)
+    {
+        _sums = _mm_add_pd(_sums, _mm_mul_pd(_mm_loadu_pd(_amounts + k), _factors));
+        _factors = _mm_mul_pd(_factors, _step);
+    }
+    _sum = _mm_cvtsd_f64(_mm_add_sd(_sums, _mm_unpackhi_pd(_sums, _sums)));
+    _factor = _mm_cvtsd_f64(_factors);
+#endif
+    // the flows left over, or all of them without SIMD
+    for (; k < _count; ++k)
+    {
+        _sum += _amounts[k] * _factor;
+        _factor *= _discount;
+    }
+    return pow(_discount, _fraction) * _sum;
+}
+
+void ScenarioEngine::Run(const vector<CurveScenario>& _scenarios, const vector<long>& _quantities, size_t _threads)
+{
+    scenarios = _scenarios;
+    yields.assign(productCount, 0.);
+    basePrices.assign(productCount, 0.);
+    notionals.assign(productCount, 0.);
+    // the bonds whose mid moved are solved in one pass before their yields are read
+    analytics.Refresh();
+    for (size_t i = 0; i < productCount; ++i)
+    {
+        yields[i] = analytics.GetMetrics((ProductIndex)i).yield;
+        size_t _first = flowStarts[i];
+        basePrices[i] = DiscountFlows(&flowAmounts[_first], flowStarts[i + 1] - _first, 1. / (1. + yields[i] / 2.), fractions[i]);
+        if (i < _quantities.size()) notionals[i] = _quantities[i] / 100.;
+    }
+    grid.assign(scenarios.size() * productCount, 0.);
+    totals.assign(scenarios.size(), 0.);
+
+    // contiguous rows of scenarios per thread, the calling thread takes the first ones
+    threadCount = _threads > 0 ? _threads : max(1u, thread::hardware_concurrency());
+    threadCount = max((size_t)1, min(threadCount, scenarios.size()));
+    vector<thread> _workers;
+    for (size_t t = 1; t < threadCount; ++t)
+    {
+        size_t _first = scenarios.size() * t / threadCount;
+        size_t _last = scenarios.size() * (t + 1) / threadCount;
+        _workers.push_back(thread([this, _first, _last]() { RunRows(_first, _last); }));
+    }
+    RunRows(0, scenarios.size() / threadCount);
+    for (auto w = _workers.begin(); w != _workers.end(); ++w)
+        w->join();
+}
+
+void ScenarioEngine::RunRows(size_t _first, size_t _last)
+{
+    for (size_t s = _first; s < _last; ++s)
+    {
+        const CurveScenario& _scenario = scenarios[s];
+        double* _row = &grid[s * productCount];
+        double _total = 0.;
+        for (size_t i = 0; i < productCount; ++i)
+        {
+            if (notionals[i] == 0.) continue;
+            double _yield = yields[i] + _scenario.GetShift(maturities[i], buckets[i]);
+            size_t _flow = flowStarts[i];
+            double _value = DiscountFlows(&flowAmounts[_flow], flowStarts[i + 1] - _flow, 1. / (1. + _yield / 2.), fractions[i]);
+            _row[i] = notionals[i] * (_value - basePrices[i]);
+            _total += _row[i];
+        }
+        totals[s] = _total;
+    }
+}
+
+#endif
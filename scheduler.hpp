@@ -0,0 +1,280 @@
+/**
+ * scheduler.hpp
+ * Defines the work-stealing task scheduler the services can post their callbacks to.
+ * Every task is posted on a key: the tasks of one key run one at a time in the order they were posted,
+ * the tasks of different keys run in parallel on the workers.
+ */
+#ifndef SCHEDULER_HPP
+#define SCHEDULER_HPP
+
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <functional>
+#include "soa.hpp"
+#include "productcatalog.hpp"
+
+using namespace std;
+
+/**
+ * Snapshot of the counters of a TaskScheduler.
+ */
+struct SchedulerStats
+{
+    long tasks; // tasks run
+    long steals; // strands taken from the queue of another worker
+};
+
+/**
+ * Work-stealing scheduler with one strand per key.
+ * A strand holds the pending tasks of its key and sits on at most one worker queue at a time, so the tasks
+ * of a key never run concurrently. A strand is queued on its home worker, the key modulo the number of workers,
+ * and goes back there after a batch of tasks, so a key stays on one worker unless that worker is behind:
+ * an idle worker steals the strands at the back of the other queues.
+ * Keys are dense, from 0 to the key count, larger keys wrap around.
+ */
+class TaskScheduler
+{
+public:
+    // ctor for _keyCount keys run by _workerCount workers, 0 for one per core, a strand runs up to _batchSize tasks at once
+    TaskScheduler(size_t _keyCount, size_t _workerCount = 0, size_t _batchSize = 64);
+    ~TaskScheduler() { Stop(); }
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    // Post a task on a key, from any thread, a task can post other tasks
+    void Post(size_t _key, function<void()> _task);
+
+    // Start the workers
+    void Start();
+
+    // Wait until every task posted so far has run, along with the tasks they posted, the workers must be started
+    void Drain();
+
+    // Drain the tasks and stop the workers
+    void Stop();
+
+    // Get the number of workers and keys
+    size_t GetWorkerCount() const { return workers.size(); }
+    size_t GetKeyCount() const { return strands.size(); }
+
+    // Get the counters
+    SchedulerStats GetStats() const;
+
+private:
+    struct Strand
+    {
+        mutex lock;
+        deque<function<void()> > tasks;
+        bool queued = false; // on a worker queue or running, guarded by lock
+        size_t home;
+    };
+
+    struct Worker
+    {
+        mutex lock;
+        deque<Strand*> strands;
+        thread worker;
+    };
+
+    vector<unique_ptr<Strand> > strands;
+    vector<unique_ptr<Worker> > workers;
+    size_t batchSize;
+    atomic<bool> running;
+    atomic<long> pending; // tasks posted and not run yet
+    atomic<long> tasks;
+    atomic<long> steals;
+
+    // Queue a strand at the back of a worker
+    void Enqueue(size_t _worker, Strand* _strand);
+
+    // Take the next strand of a worker, or steal one, nullptr if there is none
+    Strand* Take(size_t _worker);
+
+    // Run a batch of the tasks of a strand, then queue it again if it has more
+    void RunStrand(Strand* _strand);
+
+    void Run(size_t _worker);
+};
+
+TaskScheduler::TaskScheduler(size_t _keyCount, size_t _workerCount, size_t _batchSize) :
+running(false), pending(0), tasks(0), steals(0)
+{
+    size_t _workers = _workerCount > 0 ? _workerCount : max(1u, thread::hardware_concurrency());
+    batchSize = _batchSize > 0 ? _batchSize : 1;
+    for (size_t w = 0; w < _workers; ++w)
+        workers.push_back(unique_ptr<Worker>(new Worker()));
+    for (size_t k = 0; k < max((size_t)1, _keyCount); ++k)
+    {
+        strands.push_back(unique_ptr<Strand>(new Strand()));
+        strands.back()->home = k % _workers;
+    }
+}
+
+void TaskScheduler::Post(size_t _key, function<void()> _task)
+{
+    // counted before it is visible, so a drain never misses it
+    pending.fetch_add(1, memory_order_acq_rel);
+    Strand* _strand = strands[_key % strands.size()].get();
+    bool _schedule;
+    {
+        lock_guard<mutex> _guard(_strand->lock);
+        _strand->tasks.push_back(move(_task));
+        _schedule = !_strand->queued;
+        _strand->queued = true;
+    }
+    if (_schedule) Enqueue(_strand->home, _strand);
+}
+
+void TaskScheduler::Enqueue(size_t _worker, Strand* _strand)
+{
+    Worker& _target = *workers[_worker];
+    lock_guard<mutex> _guard(_target.lock);
+    _target.strands.push_back(_strand);
+}
+
+TaskScheduler::Strand* TaskScheduler::Take(size_t _worker)
+{
+    {
+        Worker& _own = *workers[_worker];
+        lock_guard<mutex> _guard(_own.lock);
+        if (!_own.strands.empty())
+        {
+            Strand* _strand = _own.strands.front();
+            _own.strands.pop_front();
+            return _strand;
+        }
+    }
+    // steal the strand queued last, the owner gets to its oldest ones first
+    for (size_t i = 1; i < workers.size(); ++i)
+    {
+        Worker& _victim = *workers[(_worker + i) % workers.size()];
+        lock_guard<mutex> _guard(_victim.lock);
+        if (_victim.strands.empty()) continue;
+        Strand* _strand = _victim.strands.back();
+        _victim.strands.pop_back();
+        steals.fetch_add(1, memory_order_relaxed);
+        return _strand;
+    }
+    return nullptr;
+}
+
+void TaskScheduler::RunStrand(Strand* _strand)
+{
+    for (size_t n = 0; n < batchSize; ++n)
+    {
+        function<void()> _task;
+        {
+            lock_guard<mutex> _guard(_strand->lock);
+            if (_strand->tasks.empty())
+            {
+                _strand->queued = false;
+                return;
+            }
+            _task = move(_strand->tasks.front());
+            _strand->tasks.pop_front();
+        }
+        _task();
+        tasks.fetch_add(1, memory_order_relaxed);
+        pending.fetch_sub(1, memory_order_acq_rel);
+    }
+    {
+        lock_guard<mutex> _guard(_strand->lock);
+        if (_strand->tasks.empty())
+        {
+            _strand->queued = false;
+            return;
+        }
+    }
+    // back to the end of its home queue, behind the other keys
+    Enqueue(_strand->home, _strand);
+}
+
+void TaskScheduler::Run(size_t _worker)
+{
+    int _idle = 0;
+    while (true)
+    {
+        Strand* _strand = Take(_worker);
+        if (_strand)
+        {
+            RunStrand(_strand);
+            _idle = 0;
+        }
+        else if (!running.load(memory_order_acquire))
+        {
+            break;
+        }
+        else if (++_idle < 64)
+        {
+            this_thread::yield();
+        }
+        else
+        {
+            // back off once nothing is posted
+            this_thread::sleep_for(chrono::microseconds(50));
+        }
+    }
+}
+
+void TaskScheduler::Start()
+{
+    if (running.load(memory_order_acquire)) return;
+    running.store(true, memory_order_release);
+    for (size_t w = 0; w < workers.size(); ++w)
+        workers[w]->worker = thread([this, w]() { Run(w); });
+}
+
+void TaskScheduler::Drain()
+{
+    while (pending.load(memory_order_acquire) > 0) this_thread::yield();
+}
+
+void TaskScheduler::Stop()
+{
+    if (!running.load(memory_order_acquire)) return;
+    Drain();
+    running.store(false, memory_order_release);
+    for (size_t w = 0; w < workers.size(); ++w)
+        if (workers[w]->worker.joinable()) workers[w]->worker.join();
+}
+
+SchedulerStats TaskScheduler::GetStats() const
+{
+    SchedulerStats _stats;
+    _stats.tasks = tasks.load(memory_order_relaxed);
+    _stats.steals = steals.load(memory_order_relaxed);
+    return _stats;
+}
+
+// key a ScheduledListener on the product of its data
+const size_t PRODUCT_KEY = (size_t)-1;
+
+/**
+ * Listener posting every callback of the wrapped listener to a TaskScheduler, with a copy of the data.
+ * The callbacks are keyed on the product index of V, so the updates of one product stay in order,
+ * or pinned to one key for a listener whose service keeps state across products.
+ * Type V is the data type.
+ */
+template<typename V>
+class ScheduledListener : public ServiceListener<V>
+{
+private:
+    ServiceListener<V>* listener;
+    TaskScheduler* scheduler;
+    size_t key;
+
+    size_t GetKey(const V& _data) const { return key == PRODUCT_KEY ? (size_t)_data.GetProduct().GetProductIndex() : key; }
+public:
+    ScheduledListener(ServiceListener<V>* _listener, TaskScheduler* _scheduler, size_t _key = PRODUCT_KEY) { listener = _listener; scheduler = _scheduler; key = _key; }
+    ~ScheduledListener() {} // set empty
+    void ProcessAdd(V& _data) { ServiceListener<V>* _listener = listener; scheduler->Post(GetKey(_data), [_listener, _data]() mutable { _listener->ProcessAdd(_data); }); }
+    void ProcessRemove(V& _data) { ServiceListener<V>* _listener = listener; scheduler->Post(GetKey(_data), [_listener, _data]() mutable { _listener->ProcessRemove(_data); }); }
+    void ProcessUpdate(V& _data) { ServiceListener<V>* _listener = listener; scheduler->Post(GetKey(_data), [_listener, _data]() mutable { _listener->ProcessUpdate(_data); }); }
+};
+
+#endif
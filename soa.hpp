@@ -15,6 +15,7 @@
 #include <vector>
 #include <map>
 #include <unordered_map>
+#include <tuple>
 
 using namespace std;
 
@@ -29,6 +30,8 @@ class ServiceListener
 
 public:
 
+  virtual ~ServiceListener() {}
+
   // Listener callback to process an add event to the Service
   virtual void ProcessAdd(V &data) = 0;
 
@@ -79,9 +82,83 @@ class Connector
 
 public:
 
+  virtual ~Connector() {}
+
   // Publish data to the Connector
   virtual void Publish(V &data) = 0;
 
 };
 
+/**
+ * Sinks are what a service hands its output to.
+ * The runtime sink forwards to the registered listeners through virtual calls,
+ * a compile-time graph passes its own sinks so the whole lane can be inlined.
+ */
+
+// Sink calling ProcessAdd on every listener registered on a Service
+template<typename V>
+class ListenerFanout
+{
+
+public:
+
+  ListenerFanout(const vector< ServiceListener<V>* > &_listeners) : listeners(_listeners) {}
+
+  void operator()(V &data) const
+  {
+    for (auto l = listeners.begin(); l != listeners.end(); ++l)
+      (*l)->ProcessAdd(data);
+  }
+
+private:
+  const vector< ServiceListener<V>* > &listeners;
+
+};
+
+// Sink calling ProcessUpdate on every listener registered on a Service
+template<typename V>
+class ListenerUpdateFanout
+{
+
+public:
+
+  ListenerUpdateFanout(const vector< ServiceListener<V>* > &_listeners) : listeners(_listeners) {}
+
+  void operator()(V &data) const
+  {
+    for (auto l = listeners.begin(); l != listeners.end(); ++l)
+      (*l)->ProcessUpdate(data);
+  }
+
+private:
+  const vector< ServiceListener<V>* > &listeners;
+
+};
+
+// Sink calling several sinks known at compile time, in order
+template<typename... Sinks>
+class StaticFanout
+{
+
+public:
+
+  StaticFanout(Sinks&... _sinks) : sinks(_sinks...) {}
+
+  template<typename V>
+  void operator()(V &data)
+  {
+    apply([&data](Sinks&... _sinks) { (_sinks(data), ...); }, sinks);
+  }
+
+private:
+  tuple<Sinks&...> sinks;
+
+};
+
+template<typename... Sinks>
+StaticFanout<Sinks...> MakeFanout(Sinks&... _sinks)
+{
+  return StaticFanout<Sinks...>(_sinks...);
+}
+
 #endif
@@ -8,6 +8,7 @@
 #define STREAMING_SERVICE_HPP
 
 #include "soa.hpp"
+#include "productcatalog.hpp"
 // #include "marketdataservice.hpp"
 #include "algostreamingservice.hpp"
 
@@ -22,35 +23,31 @@ template<typename T>
 class StreamingService : public Service<string, PriceStream<T> >
 {
 private:
-    map<string, PriceStream<T> > priceStreams;
+    ProductStore<PriceStream<T> > priceStreams;
     vector<ServiceListener<PriceStream<T> >*> listeners;
-    ServiceListener<AlgoStream<T> >* listener;
+    StreamingToAlgoStreamingListener<T>* listener;
 public:
     StreamingService();
     ~StreamingService() {} // set empty
     PriceStream<T>& GetData(string _key) { return priceStreams[_key]; }
-    void OnMessage(PriceStream<T>& _data) { priceStreams[_data.GetProduct().GetProductId()] = _data; }
+    PriceStream<T>& GetData(ProductIndex _index) { return priceStreams[_index]; }
+    void OnMessage(PriceStream<T>& _data) { priceStreams[_data.GetProduct().GetProductIndex()] = _data; }
     void AddListener(ServiceListener<PriceStream<T> >* _listener) { listeners.push_back(_listener); }
     const vector<ServiceListener<PriceStream<T> >*>& GetListeners() const { return listeners; }
-    ServiceListener<AlgoStream<T> >* GetListener() { return listener; }
-    void PublishPrice(PriceStream<T>& _priceStream);
+    StreamingToAlgoStreamingListener<T>* GetListener() { return listener; }
+    void PublishPrice(PriceStream<T>& _priceStream) { PublishPrice(_priceStream, ListenerFanout<PriceStream<T> >(listeners)); }
+    template<typename Sink>
+    void PublishPrice(PriceStream<T>& _priceStream, Sink&& _sink) { _sink(_priceStream); }
 };
 
 template<typename T>
 StreamingService<T>::StreamingService()
 {
-    priceStreams = map<string, PriceStream<T> >();
+    priceStreams = ProductStore<PriceStream<T> >();
     listeners = vector<ServiceListener<PriceStream<T> >*>();
     listener = new StreamingToAlgoStreamingListener<T>(this);
 }
 
-template<typename T>
-void StreamingService<T>::PublishPrice(PriceStream<T>& _priceStream)
-{
-    for (auto l = listeners.begin(); l != listeners.end(); ++l)
-        (*l)->ProcessAdd(_priceStream);
-}
-
 
 template<typename T>
 class StreamingToAlgoStreamingListener : public ServiceListener<AlgoStream<T> >
@@ -60,18 +57,21 @@ private:
 public:
     StreamingToAlgoStreamingListener(StreamingService<T>* _service) { service = _service; }
     ~StreamingToAlgoStreamingListener() {} // set empty
-    void ProcessAdd(AlgoStream<T>& _data);
+    void ProcessAdd(AlgoStream<T>& _data) { ProcessAdd(_data, ListenerFanout<PriceStream<T> >(service->GetListeners())); }
+    template<typename Sink>
+    void ProcessAdd(AlgoStream<T>& _data, Sink&& _sink);
     void ProcessRemove(AlgoStream<T>& _data) {} // set empty
     void ProcessUpdate(AlgoStream<T>& _data) {} // set empty
 };
 
 
 template<typename T>
-void StreamingToAlgoStreamingListener<T>::ProcessAdd(AlgoStream<T>& _data)
+template<typename Sink>
+void StreamingToAlgoStreamingListener<T>::ProcessAdd(AlgoStream<T>& _data, Sink&& _sink)
 {
     PriceStream<T>* _priceStream = _data.GetPriceStream();
     service->OnMessage(*_priceStream);
-    service->PublishPrice(*_priceStream);
+    service->PublishPrice(*_priceStream, _sink);
 }
 
 #endif
@@ -0,0 +1,176 @@
+//
+//  tickbookbenchmark.cpp
+//  tradingsystem
+//
+//  Measures the depth computations of a TickBook, prices in ticks and quantities in arrays of their own,
+//  against the same computations over the vectors of Order of an OrderBook, on books 5, 50 and 500 levels
+//  deep: the depth of the best half of the levels, the cumulative depth, the quantity within a price, the
+//  average price of a sweep, the search of a level and random updates. Both layouts must give the same results.
+//
+//  usage: tickbookbenchmark [queries]
+//
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+#include <stdio.h>
+#include "products.hpp"
+#include "tools.hpp"
+#include "soa.hpp"
+#include "productcatalog.hpp"
+#include "pricingservice.hpp"
+#include "algostreamingservice.hpp"
+#include "marketdataservice.hpp"
+
+// keeps the results from being optimized away
+volatile long resultSink;
+
+// the computations over a stack of Order, best level first
+long GetDepth(const vector<Order>& _stack, size_t _levels)
+{
+    long _total = 0;
+    for (size_t i = 0; i < _levels && i < _stack.size(); ++i) _total += _stack[i].GetQuantity();
+    return _total;
+}
+
+size_t GetCumulativeDepth(const vector<Order>& _stack, long* _cumulative, size_t _levels)
+{
+    long _total = 0;
+    size_t i = 0;
+    for (; i < _levels && i < _stack.size(); ++i)
+    {
+        _total += _stack[i].GetQuantity();
+        _cumulative[i] = _total;
+    }
+    return i;
+}
+
+long GetQuantityWithin(const vector<Order>& _stack, double _price, PricingSide _side)
+{
+    long _total = 0;
+    for (auto l = _stack.begin(); l != _stack.end(); ++l)
+        if (_side == BID ? l->GetPrice() >= _price : l->GetPrice() <= _price) _total += l->GetQuantity();
+    return _total;
+}
+
+bool GetSweepPrice(const vector<Order>& _stack, long _quantity, double& _averagePrice)
+{
+    long _left = _quantity;
+    double _notional = 0.;
+    for (auto l = _stack.begin(); l != _stack.end() && _left > 0; ++l)
+    {
+        long _taken = min(_left, l->GetQuantity());
+        _notional += l->GetPrice() * _taken;
+        _left -= _taken;
+    }
+    if (_left > 0) return false;
+    _averagePrice = _notional / _quantity;
+    return true;
+}
+
+// the time of _f() in nanoseconds
+template<typename F>
+long long Time(F _f)
+{
+    long long _start = MonotonicClock::Now();
+    _f();
+    return MonotonicClock::Now() - _start;
+}
+
+int main(int argc, const char * argv[])
+{
+    long _queries = argc > 1 ? stol(argv[1]) : 100000;
+    if (_queries <= 0 || !GetProductCatalog().Load("products.txt"))
+    {
+        cerr << "usage: " << argv[0] << " [queries], products.txt must be readable" << endl;
+        return 1;
+    }
+    const Bond& _bond = GetProductCatalog().GetBond((ProductIndex)0);
+    vector<double> _uniform = GenerateUniform(_queries * 3, 12345);
+
+    bool _ok = true;
+    const int _depths[] = { 5, 50, 500 };
+    for (int _depth : _depths)
+    {
+        // the levels of a side are a tick apart, away from a mid of 100
+        vector<Order> _bidStack, _offerStack;
+        for (int k = 0; k < _depth; ++k)
+        {
+            _bidStack.push_back(Order(100. - (k + 1) / 256., 1000000L * (k % 7 + 1), BID));
+            _offerStack.push_back(Order(100. + (k + 1) / 256., 1000000L * (k % 5 + 1), OFFER));
+        }
+        OrderBook<Bond> _orderBook(_bond, _bidStack, _offerStack);
+        TickBook<Bond> _tickBook(_orderBook);
+        const vector<Order>& _offers = _orderBook.GetOfferStack();
+        const PriceLadder& _ladder = _tickBook.GetOffers();
+        long _total = GetDepth(_offers, _depth);
+
+        // the query of every iteration, a level and a size
+        vector<int> _levels(_queries);
+        vector<long> _sizes(_queries);
+        for (long q = 0; q < _queries; ++q)
+        {
+            _levels[q] = (int)(_uniform[q] * _depth);
+            _sizes[q] = 1 + (long)(_uniform[_queries + q] * _total);
+        }
+        vector<long> _orderResults(_queries), _tickResults(_queries);
+        vector<long> _cumulative(_depth);
+        long _mismatches = 0;
+        auto _check = [&]() { for (long q = 0; q < _queries; ++q) _mismatches += _orderResults[q] != _tickResults[q]; };
+
+        cout << _depth << " levels, ns per query with Order against ticks:";
+        long long _orderNanos = Time([&]() { for (long q = 0; q < _queries; ++q) _orderResults[q] = GetDepth(_offers, _depth / 2 + 1); });
+        long long _tickNanos = Time([&]() { for (long q = 0; q < _queries; ++q) _tickResults[q] = _ladder.GetDepth(_depth / 2 + 1); });
+        _check();
+        cout << " depth " << (double)_orderNanos / _queries << "/" << (double)_tickNanos / _queries;
+
+        _orderNanos = Time([&]() { for (long q = 0; q < _queries; ++q) _orderResults[q] = _cumulative[GetCumulativeDepth(_offers, _cumulative.data(), _levels[q] + 1) - 1]; });
+        _tickNanos = Time([&]() { for (long q = 0; q < _queries; ++q) _tickResults[q] = _cumulative[_ladder.GetCumulativeDepth(_cumulative.data(), _levels[q] + 1) - 1]; });
+        _check();
+        cout << ", cumulative depth " << (double)_orderNanos / _queries << "/" << (double)_tickNanos / _queries;
+
+        _orderNanos = Time([&]() { for (long q = 0; q < _queries; ++q) _orderResults[q] = GetQuantityWithin(_offers, _offers[_levels[q]].GetPrice(), OFFER); });
+        _tickNanos = Time([&]() { for (long q = 0; q < _queries; ++q) _tickResults[q] = _ladder.GetQuantityWithin(_ladder.GetTicks()[_levels[q]]); });
+        _check();
+        cout << ", quantity within " << (double)_orderNanos / _queries << "/" << (double)_tickNanos / _queries;
+
+        // the average prices compared in ticks, rounded to a millionth of a tick
+        _orderNanos = Time([&]() { for (long q = 0; q < _queries; ++q) { double _price = 0.; GetSweepPrice(_offers, _sizes[q], _price); _orderResults[q] = llround(_price * TICKS_PER_UNIT * 1e6); } });
+        _tickNanos = Time([&]() { for (long q = 0; q < _queries; ++q) { double _ticks = 0.; _ladder.GetSweepTicks(_sizes[q], _ticks); _tickResults[q] = llround(_ticks * 1e6); } });
+        _check();
+        cout << ", sweep " << (double)_orderNanos / _queries << "/" << (double)_tickNanos / _queries;
+
+        _orderNanos = Time([&]() { for (long q = 0; q < _queries; ++q) { long _quantity = 0; _orderBook.GetLevel(_offers[_levels[q]].GetPrice(), OFFER, _quantity); _orderResults[q] = _quantity; } });
+        _tickNanos = Time([&]() { for (long q = 0; q < _queries; ++q) _tickResults[q] = _ladder.GetQuantities()[_ladder.CountBetter(_ladder.GetTicks()[_levels[q]])]; });
+        _check();
+        cout << ", level search " << (double)_orderNanos / _queries << "/" << (double)_tickNanos / _queries;
+
+        // the same random updates on both layouts, the books must convert back to the same one
+        vector<BookUpdate<Bond> > _updates;
+        for (long q = 0; q < _queries; ++q)
+        {
+            PricingSide _side = _uniform[2 * _queries + q] < 0.5 ? BID : OFFER;
+            double _price = _side == BID ? 100. - (_levels[q] + 1) / 256. : 100. + (_levels[q] + 1) / 256.;
+            BookAction _action = q % 5 < 3 ? MODIFY_LEVEL : (q % 5 == 3 ? CANCEL_LEVEL : ADD_LEVEL);
+            _updates.push_back(BookUpdate<Bond>(_bond, _action, Order(_price, 1000000L * (q % 9 + 1), _side)));
+        }
+        _orderNanos = Time([&]() { for (auto u = _updates.begin(); u != _updates.end(); ++u) _orderBook.Apply(*u); });
+        _tickNanos = Time([&]() { for (auto u = _updates.begin(); u != _updates.end(); ++u) _tickBook.Apply(*u); });
+        OrderBook<Bond> _converted = _tickBook.ToOrderBook();
+        for (int s = 0; s < 2; ++s)
+        {
+            const vector<Order>& _a = s == 0 ? _orderBook.GetBidStack() : _orderBook.GetOfferStack();
+            const vector<Order>& _b = s == 0 ? _converted.GetBidStack() : _converted.GetOfferStack();
+            _mismatches += _a.size() != _b.size();
+            for (size_t i = 0; i < _a.size() && i < _b.size(); ++i)
+                _mismatches += _a[i].GetPrice() != _b[i].GetPrice() || _a[i].GetQuantity() != _b[i].GetQuantity();
+        }
+        cout << ", update " << (double)_orderNanos / _queries << "/" << (double)_tickNanos / _queries
+             << ", " << _mismatches << " mismatches" << endl;
+        resultSink = _orderResults[0] + _tickResults[0];
+        _ok = _ok && _mismatches == 0;
+    }
+    return _ok ? 0 : 1;
+}
@@ -11,116 +11,187 @@
 
 #include <iostream>
 #include <string>
+#include <string_view>
+#include <stdexcept>
+#include <cmath>
+#include <cstring>
+#include <charconv>
 #include <chrono>
+#include <atomic>
+#include <ctime>
+#include <unistd.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
-// #include "products.hpp"
+#include "productcatalog.hpp"
+#include "clock.hpp"
 
 using namespace std;
 using namespace chrono;
 
 
-// print the time stamp in specific format
-string PrintTimeStamp()
+// print the time stamp in specific format, see clock.hpp
+string PrintTimeStamp(system_clock::time_point now)
 {
-    auto now = system_clock::now();
-    auto _sec = chrono::time_point_cast<chrono::seconds>(now);
-    auto _millisec = chrono::duration_cast<chrono::milliseconds>(now - _sec);
-    
-    auto _millisecCount = _millisec.count();
-    string _milliString = to_string(_millisecCount);
-    if (_millisecCount < 10) _milliString = "00" + _milliString;
-    else if (_millisecCount < 100) _milliString = "0" + _milliString;
-    
-    time_t _timeT = system_clock::to_time_t(now);
-    char _timeChar[24];
-    strftime(_timeChar, 24, "%F %T", localtime(&_timeT));
-    string _timeString = string(_timeChar) + "." + _milliString + " ";
-    
-    return _timeString;
+    char _timeChar[TIME_STAMP_SIZE];
+    return string(_timeChar, FormatTimeStamp(now, _timeChar));
 }
 
+// print the current time stamp
+string PrintTimeStamp() { return PrintTimeStamp(system_clock::now()); }
 
-// search online for these cusips
-Bond GetBond(string _cusip)
+
+// look up a bond in the product catalog, see products.txt for the reference data
+const Bond& GetBond(string_view _cusip)
 {
-    if (_cusip == "9128283H1")
-    {
-        Bond _bond("9128283H1", CUSIP, "US2Y", 0.01750, from_string("2019/11/30"));
-        return _bond;
-    }
-    if (_cusip == "9128283L2")
-    {
-        Bond _bond("9128283L2", CUSIP, "US3Y", 0.01875, from_string("2020/12/15"));
-        return _bond;
-    }
-    if (_cusip == "912828M80")
-    {
-        Bond _bond("912828M80", CUSIP, "US5Y", 0.02000, from_string("2022/11/30"));
-        return _bond;
-    }
-    if (_cusip == "9128283J7")
-    {
-        Bond _bond("9128283J7", CUSIP, "US7Y", 0.02125, from_string("2024/11/30"));
-        return _bond;
-    }
-    if (_cusip == "9128283F5")
-    {
-        Bond _bond("9128283F5", CUSIP, "US10Y", 0.02250, from_string("2027/12/15"));
-        return _bond;
-    }
-    if (_cusip == "912810RZ3")
-    {
-        Bond _bond("912810RZ3", CUSIP, "US30Y", 0.02750, from_string("2047/12/15"));
-        return _bond;
-    }
-    else // in case that there is no such cusip thus no return value
+    return GetProductCatalog().GetBond(_cusip);
+}
+
+
+// error codes of the fractional price parser
+enum PriceParseError { PRICE_OK, PRICE_EMPTY, PRICE_BAD_INTEGER, PRICE_BAD_FRACTION };
+
+// parse a fractional price like "100-16+" into ticks of 1/256
+// the integer part is followed by a fixed width fraction: two digits of 32nds and one digit (or '+') of 256ths
+PriceParseError ParsePriceTicks(const char* _price, size_t _size, long& _ticks)
+{
+    if (_size == 0) return PRICE_EMPTY;
+    
+    // integer part, 1 to 9 digits up to the dash, stopped before a tenth digit can overflow
+    long _integer = 0;
+    size_t i = 0;
+    while (i < _size && _price[i] != '-')
     {
-        Bond _bond("999999999", CUSIP, "US99Y", 0.02750, from_string("2047/12/15"));
-        return _bond;
+        unsigned _digit = (unsigned)(_price[i] - '0');
+        if (_digit > 9 || i == 9) return PRICE_BAD_INTEGER;
+        _integer = _integer * 10 + _digit;
+        ++i;
     }
+    if (i == 0) return PRICE_BAD_INTEGER;
+    if (_size - i != 4) return PRICE_BAD_FRACTION;
+    
+    // fixed width fraction, validated without branching
+    const char* _fraction = _price + i + 1;
+    unsigned _tens = (unsigned)(_fraction[0] - '0');
+    unsigned _units = (unsigned)(_fraction[1] - '0');
+    unsigned _plus = (_fraction[2] == '+');
+    unsigned _eighth = (unsigned)(_fraction[2] - '0');
+    _eighth = (_eighth & (_plus - 1)) | (4u & (0u - _plus));
+    unsigned _32nds = _tens * 10 + _units;
+    unsigned _valid = (_tens <= 3) & (_units <= 9) & (_32nds <= 31) & (_eighth <= 7);
+    if (!_valid) return PRICE_BAD_FRACTION;
+    
+    _ticks = _integer * 256 + _32nds * 8 + _eighth;
+    return PRICE_OK;
 }
 
+PriceParseError ParsePriceTicks(string_view _price, long& _ticks)
+{
+    return ParsePriceTicks(_price.data(), _price.size(), _ticks);
+}
 
-double ConvertPrice(string _price)
+// parse a fractional price into a double, _price is left untouched on error
+PriceParseError ParsePrice(string_view _price, double& _value)
 {
-    int count = 0;
-    string _price_int = "";
-    string _price_32 = "";
-    string _price_256 = "";
-    for(int i = 0; i < _price.size(); ++i)
+    long _ticks;
+    PriceParseError _error = ParsePriceTicks(_price, _ticks);
+    if (_error == PRICE_OK) _value = _ticks / 256.;
+    return _error;
+}
+
+// parse a column of fractional prices in one call
+// with SSE2 the fixed width fractions of four prices are decoded and validated in one register, the integer
+// parts are read one by one, and the prices are built two per register
+// returns the number of malformed prices, which are set to NaN in _values
+size_t ParsePrices(const string_view* _prices, double* _values, size_t _count)
+{
+    size_t _failed = 0;
+    size_t i = 0;
+#if defined(__SSE2__)
+    // the bytes of a fraction "-XXY" in a 32-bit lane, the dash in the lowest byte
+    const __m128i _zeros = _mm_set1_epi8('0');
+    const __m128i _limits = _mm_set1_epi32((int)0x070903FF); // Y <= 7, X <= 9, first X <= 3, any dash
+    const __m128i _dashes = _mm_set1_epi32('-');
+    const __m128i _notDashByte = _mm_set1_epi32((int)0xFFFFFF00);
+    const __m128i _pluses = _mm_set1_epi32((int)((unsigned)'+' << 24));
+    const __m128i _plusByte = _mm_set1_epi32((int)0xFF000000);
+    const __m128i _lowByte = _mm_set1_epi32(0xFF);
+    const __m128i _maxFraction = _mm_set1_epi32(31 * 8 + 7 + 1);
+    const __m128d _scale = _mm_set1_pd(1. / 256.);
+    for (; i + 4 <= _count; i += 4)
     {
-        if (_price[i] == '-')
-        {
-            ++count;
-            continue;
-        }
-        if(count == 0)
-        {
-            _price_int.push_back(_price[i]);
-        }
-        else if (count == 1 || count == 2)
+        // integer parts, 1 to 9 digits before the fraction, a short price gets an invalid fraction
+        int _tails[4];
+        double _integers[4];
+        int _integerValid[4];
+        for (int j = 0; j < 4; ++j)
         {
-            _price_32.push_back(_price[i]);
-            ++count;
-        }
-        else
-        {
-            if(_price[i] == '+')
-            {
-                _price_256.push_back('4');
-            }
-            else
+            const string_view& _price = _prices[i + j];
+            size_t _digits = _price.size() < 4 ? 0 : _price.size() - 4;
+            _tails[j] = 0;
+            if (_digits > 0) memcpy(&_tails[j], _price.data() + _digits, 4);
+            long _integer = 0;
+            unsigned _bad = (_digits == 0) | (_digits > 9);
+            for (size_t k = 0; k < _digits && k < 9; ++k)
             {
-                _price_256.push_back(_price[i]);
+                unsigned _digit = (unsigned)(_price[k] - '0');
+                _bad |= (_digit > 9);
+                _integer = _integer * 10 + _digit;
             }
+            _integers[j] = (double)_integer;
+            _integerValid[j] = _bad ? 0 : -1;
         }
+        __m128i _fractions = _mm_loadu_si128((const __m128i*)_tails);
+        __m128i _valid = _mm_loadu_si128((const __m128i*)_integerValid);
+
+        // every byte checked at once: the dash, the digits in range, '+' allowed in place of the last digit
+        __m128i _digits = _mm_sub_epi8(_fractions, _zeros);
+        __m128i _inRange = _mm_cmpeq_epi8(_mm_min_epu8(_digits, _limits), _digits);
+        __m128i _plus = _mm_and_si128(_mm_cmpeq_epi8(_fractions, _pluses), _plusByte);
+        __m128i _dash = _mm_or_si128(_mm_cmpeq_epi8(_fractions, _dashes), _notDashByte);
+        __m128i _bytesValid = _mm_and_si128(_dash, _mm_or_si128(_inRange, _plus));
+        _valid = _mm_and_si128(_valid, _mm_cmpeq_epi32(_bytesValid, _mm_set1_epi32(-1)));
+
+        // ticks of the fraction: tens * 80 + units * 8 + eighth, '+' is 4 eighths
+        __m128i _tens = _mm_and_si128(_mm_srli_epi32(_digits, 8), _lowByte);
+        __m128i _units = _mm_and_si128(_mm_srli_epi32(_digits, 16), _lowByte);
+        __m128i _plusLane = _mm_srai_epi32(_plus, 31);
+        __m128i _eighth = _mm_srli_epi32(_digits, 24);
+        _eighth = _mm_or_si128(_mm_andnot_si128(_plusLane, _eighth), _mm_and_si128(_plusLane, _mm_set1_epi32(4)));
+        __m128i _ticks = _mm_add_epi32(_mm_add_epi32(_mm_slli_epi32(_tens, 6), _mm_slli_epi32(_tens, 4)), _mm_slli_epi32(_units, 3));
+        _ticks = _mm_add_epi32(_ticks, _eighth);
+        _valid = _mm_and_si128(_valid, _mm_cmpgt_epi32(_maxFraction, _ticks));
+        _failed += 4 - __builtin_popcount(_mm_movemask_ps(_mm_castsi128_ps(_valid)));
+
+        // integer + ticks / 256 is exact, the malformed prices are set to NaN
+        const __m128d _nan = _mm_set1_pd(NAN);
+        __m128i _ticksHigh = _mm_unpackhi_epi64(_ticks, _ticks);
+        __m128d _low = _mm_add_pd(_mm_loadu_pd(_integers), _mm_mul_pd(_mm_cvtepi32_pd(_ticks), _scale));
+        __m128d _high = _mm_add_pd(_mm_loadu_pd(_integers + 2), _mm_mul_pd(_mm_cvtepi32_pd(_ticksHigh), _scale));
+        __m128d _validLow = _mm_castsi128_pd(_mm_unpacklo_epi32(_valid, _valid));
+        __m128d _validHigh = _mm_castsi128_pd(_mm_unpackhi_epi32(_valid, _valid));
+        _mm_storeu_pd(_values + i, _mm_or_pd(_mm_and_pd(_validLow, _low), _mm_andnot_pd(_validLow, _nan)));
+        _mm_storeu_pd(_values + i + 2, _mm_or_pd(_mm_and_pd(_validHigh, _high), _mm_andnot_pd(_validHigh, _nan)));
     }
-    
-    double res = 0.;
-    res += stod(_price_int);
-    res += stod(_price_32) / 32.;
-    res += stod(_price_256) / 256.;
-    return res;
+#endif
+    // the prices left over, or all of them without SSE2
+    for (; i < _count; ++i)
+    {
+        double _value = NAN;
+        _failed += (ParsePrice(_prices[i], _value) != PRICE_OK);
+        _values[i] = _value;
+    }
+    return _failed;
+}
+
+// parse a fractional price, throws invalid_argument on malformed input
+double ConvertPrice(string_view _price)
+{
+    double _value = 0.;
+    if (ParsePrice(_price, _value) != PRICE_OK)
+        throw invalid_argument("ConvertPrice: malformed price " + string(_price));
+    return _value;
 }
 
 long GetMillisecond()
@@ -132,22 +203,48 @@ long GetMillisecond()
     return _millisecCount;
 }
 
-string ConvertPrice(double _doublePrice)
+// fractional suffixes "-XXY" of every 1/256 tick, built at compile time
+struct PriceFractionTable
 {
-    int _doublePrice100 = floor(_doublePrice);
-    int _doublePrice256 = floor((_doublePrice - _doublePrice100) * 256.0);
-    int _doublePrice32 = floor(_doublePrice256 / 8.0);
-    _doublePrice256 %= 8;
-    
-    string _stringPrice100 = to_string(_doublePrice100);
-    string _stringPrice32 = to_string(_doublePrice32);
-    string _stringPrice256 = to_string(_doublePrice256);
-    
-    if (_doublePrice32 < 10) _stringPrice32 = "0" + _stringPrice32;
-    if (_doublePrice256 == 4) _stringPrice256 = "+";
+    char suffix[256][4];
+    constexpr PriceFractionTable() : suffix()
+    {
+        for (int i = 0; i < 256; ++i)
+        {
+            int _32nds = i / 8;
+            int _eighth = i % 8;
+            suffix[i][0] = '-';
+            suffix[i][1] = (char)('0' + _32nds / 10);
+            suffix[i][2] = (char)('0' + _32nds % 10);
+            suffix[i][3] = _eighth == 4 ? '+' : (char)('0' + _eighth);
+        }
+    }
+};
+constexpr PriceFractionTable PRICE_FRACTIONS;
+
+// large enough for any price written by FormatPrice, including the terminator
+const size_t PRICE_BUFFER_SIZE = 32;
+
+// write a price in fractional format like "100-16+" into _buffer, the price is floored to the 1/256 grid
+// returns the number of characters written, _buffer is null terminated and needs PRICE_BUFFER_SIZE bytes
+size_t FormatPrice(double _price, char* _buffer)
+{
+    long _ticks = (long)floor(_price * 256.0);
+    long _integer = _ticks >> 8;
+    int _fraction = (int)(_ticks & 255);
     
-    string res = _stringPrice100 + "-" + _stringPrice32 + _stringPrice256;
-    return res;
+    char* _end = to_chars(_buffer, _buffer + PRICE_BUFFER_SIZE - 5, _integer).ptr;
+    memcpy(_end, PRICE_FRACTIONS.suffix[_fraction], 4);
+    _end += 4;
+    *_end = '\0';
+    return _end - _buffer;
+}
+
+string ConvertPrice(double _doublePrice)
+{
+    char _buffer[PRICE_BUFFER_SIZE];
+    size_t _size = FormatPrice(_doublePrice, _buffer);
+    return string(_buffer, _size);
 }
 
 vector<double> GenerateUniform(long N, long seed = 0)
@@ -170,29 +267,52 @@ vector<double> GenerateUniform(long N, long seed = 0)
     return result;
 }
 
-string GenerateId()
+// length of a generated id: 5 base-36 digits of session, 3 of thread and 7 of per-thread sequence
+const size_t ID_SIZE = 15;
+const unsigned long long ID_SESSIONS = 36ull * 36 * 36 * 36 * 36;
+const unsigned ID_THREADS = 36 * 36 * 36;
+const unsigned long long ID_SEQUENCES = 36ull * 36 * 36 * 36 * 36 * 36 * 36;
+
+// write the last _size base-36 digits of _value
+void EncodeIdDigits(unsigned long long _value, char* _buffer, int _size)
 {
-    string _base = "1234567890QWERTYUIOPASDFGHJKLZXCVBNM";
-    vector<double> _randoms = GenerateUniform(12, GetMillisecond());
-    string _id = "";
-    for (auto& r : _randoms)
+    static const char _digits[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    for (int i = _size - 1; i >= 0; --i)
     {
-        int i = r * 36;
-        _id.push_back(_base[i]);
+        _buffer[i] = _digits[_value % 36];
+        _value /= 36;
     }
-    return _id;
 }
 
-double GetPV01Value(string _cusip)
+// fill _buffer with ID_SIZE characters of the next id, no lock and no allocation
+// ids are unique within a session for up to ID_THREADS threads and ID_SEQUENCES ids per thread,
+// past that GenerateId throws overflow_error rather than repeat an id
+// the session prefix is a hash of the start time in nanoseconds and the process id
+void GenerateId(char* _buffer)
+{
+    static const unsigned long long _session = []() {
+        unsigned long long _seed = (unsigned long long)system_clock::now().time_since_epoch().count() ^ ((unsigned long long)getpid() << 32);
+        // splitmix64 finalizer, every bit of the seed moves the prefix
+        _seed = (_seed ^ (_seed >> 30)) * 0xbf58476d1ce4e5b9ull;
+        _seed = (_seed ^ (_seed >> 27)) * 0x94d049bb133111ebull;
+        return (_seed ^ (_seed >> 31)) % ID_SESSIONS;
+    }();
+    static atomic<unsigned> _nextThread(0);
+    thread_local const unsigned _thread = _nextThread.fetch_add(1, memory_order_relaxed);
+    thread_local unsigned long long _sequence = 0;
+
+    if (_thread >= ID_THREADS) throw overflow_error("GenerateId: more than " + to_string(ID_THREADS) + " threads generated ids");
+    if (_sequence >= ID_SEQUENCES) throw overflow_error("GenerateId: a thread generated more than " + to_string(ID_SEQUENCES) + " ids");
+    EncodeIdDigits(_session, _buffer, 5);
+    EncodeIdDigits(_thread, _buffer + 5, 3);
+    EncodeIdDigits(_sequence++, _buffer + 8, 7);
+}
+
+string GenerateId()
 {
-    double _pv01 = 0;
-    if (_cusip == "9128283H1") _pv01 = 0.01948992;
-    if (_cusip == "9128283L2") _pv01 = 0.02865304;
-    if (_cusip == "912828M80") _pv01 = 0.04581119;
-    if (_cusip == "9128283J7") _pv01 = 0.06127718;
-    if (_cusip == "9128283F5") _pv01 = 0.08161449;
-    if (_cusip == "912810RZ3") _pv01 = 0.15013155;
-    return _pv01;
+    char _id[ID_SIZE];
+    GenerateId(_id);
+    return string(_id, ID_SIZE); // short enough for the small string buffer
 }
 
 #endif /* tools_hpp */
@@ -10,6 +10,7 @@
 #include <string>
 #include <vector>
 #include "soa.hpp"
+#include "filereader.hpp"
 
 // Trade sides
 enum Side { BUY, SELL };
@@ -109,6 +110,8 @@ template<typename T>
 class TradeBookingConnector;
 template<typename T>
 class TradeBookingToExecutionListener;
+template<typename T>
+class TradeBookingToFillListener;
 
 /**
  * Trade Booking Service to book trades to a particular book.
@@ -123,16 +126,24 @@ private:
     vector<ServiceListener<Trade<T> >*> listeners;
     TradeBookingConnector<T>* connector;
     TradeBookingToExecutionListener<T>* listener;
+    TradeBookingToFillListener<T>* fillListener;
 public:
     TradeBookingService();
     ~TradeBookingService() {} // set empty
     Trade<T>& GetData(string _key) { return trades[_key]; }
-    void OnMessage(Trade<T>& _data);
+    void OnMessage(Trade<T>& _data) { OnMessage(_data, ListenerFanout<Trade<T> >(listeners)); }
+    // store the trade and hand it to _sink instead of the registered listeners
+    template<typename Sink>
+    void OnMessage(Trade<T>& _data, Sink&& _sink);
     void AddListener(ServiceListener<Trade<T> >* _listener) { listeners.push_back(_listener); }
     const vector<ServiceListener<Trade<T> >*>& GetListeners() const { return listeners; }
     TradeBookingConnector<T>* GetConnector() { return connector; }
     TradeBookingToExecutionListener<T>* GetListener() { return listener; }
-    void BookTrade(Trade<T>& _trade);
+    // Get the listener booking the fills of a matching engine instead of the execution orders
+    TradeBookingToFillListener<T>* GetFillListener() { return fillListener; }
+    void BookTrade(Trade<T>& _trade) { BookTrade(_trade, ListenerFanout<Trade<T> >(listeners)); }
+    template<typename Sink>
+    void BookTrade(Trade<T>& _trade, Sink&& _sink) { _sink(_trade); }
 };
 
 template<typename T>
@@ -142,22 +153,16 @@ TradeBookingService<T>::TradeBookingService()
     listeners = vector<ServiceListener<Trade<T> >*>();
     connector = new TradeBookingConnector<T>(this);
     listener = new TradeBookingToExecutionListener<T>(this);
+    fillListener = new TradeBookingToFillListener<T>(this);
 }
 
 template<typename T>
-void TradeBookingService<T>::OnMessage(Trade<T>& _data)
+template<typename Sink>
+void TradeBookingService<T>::OnMessage(Trade<T>& _data, Sink&& _sink)
 {
     trades[_data.GetTradeId()] = _data;
     
-    for (auto l = listeners.begin(); l != listeners.end(); ++l)
-        (*l)->ProcessAdd(_data);
-}
-
-template<typename T>
-void TradeBookingService<T>::BookTrade(Trade<T>& _trade)
-{
-    for (auto l = listeners.begin(); l != listeners.end(); ++l)
-        (*l)->ProcessAdd(_trade);
+    _sink(_data);
 }
 
 
@@ -171,34 +176,58 @@ public:
     ~TradeBookingConnector() {} // set empty
     void Publish(Trade<T>& _data) {} // set empty
     void Subscribe(ifstream& _data);
+    void Subscribe(const MappedFile& _data);
+    // Parse the file and hand every trade to _handler(Trade<T>&) instead of the service
+    template<typename F>
+    void Parse(const MappedFile& _data, F&& _handler);
+private:
+    // Parse one row of trades.txt and hand the trade to _handler
+    template<typename F>
+    void ParseRow(const CsvRow& _cells, F& _handler);
 };
 
 template<typename T>
 void TradeBookingConnector<T>::Subscribe(ifstream& _data_in)
 {
     string _line;
+    CsvRow _cells;
+    auto _handler = [this](Trade<T>& _trade) { service->OnMessage(_trade); };
     while (getline(_data_in, _line))
     {
-        stringstream _lineStream(_line);
-        string _cell;
-        vector<string> _cells;
-        while (getline(_lineStream, _cell, ','))
-            _cells.push_back(_cell);
-        
-        string _productId = _cells[0];
-        string _tradeId = _cells[1];
-        double _price = ConvertPrice(_cells[2]);
-        string _book = _cells[3];
-        long _quantity = stol(_cells[4]);
-        Side _side;
-        if (_cells[5] == "BUY") _side = BUY;
-        else if (_cells[5] == "SELL") _side = SELL;
-        T _product = GetBond(_productId);
-        Trade<T> _trade(_product, _tradeId, _price, _book, _quantity, _side);
-        service->OnMessage(_trade);
+        SplitRow(_line, _cells);
+        ParseRow(_cells, _handler);
     }
 }
 
+template<typename T>
+void TradeBookingConnector<T>::Subscribe(const MappedFile& _data_in)
+{
+    Parse(_data_in, [this](Trade<T>& _trade) { service->OnMessage(_trade); });
+}
+
+template<typename T>
+template<typename F>
+void TradeBookingConnector<T>::Parse(const MappedFile& _data_in, F&& _handler)
+{
+    _data_in.ForEachRow([this, &_handler](const CsvRow& _cells) { ParseRow(_cells, _handler); });
+}
+
+template<typename T>
+template<typename F>
+void TradeBookingConnector<T>::ParseRow(const CsvRow& _cells, F& _handler)
+{
+    string _tradeId(_cells[1]);
+    double _price = ConvertPrice(_cells[2]);
+    string _book(_cells[3]);
+    long _quantity = ParseLong(_cells[4]);
+    Side _side;
+    if (_cells[5] == "BUY") _side = BUY;
+    else if (_cells[5] == "SELL") _side = SELL;
+    const T& _product = GetBond(_cells[0]);
+    Trade<T> _trade(_product, _tradeId, _price, _book, _quantity, _side);
+    _handler(_trade);
+}
+
 /**
  * Trade Booking Service Listener subscribing data from Execution Service to Trading Booking Service.
  * Type T is the product type.
@@ -212,7 +241,9 @@ private:
 public:
     TradeBookingToExecutionListener(TradeBookingService<T>* _service);
     ~TradeBookingToExecutionListener() {} // set empty
-    void ProcessAdd(ExecutionOrder<T>& _data);
+    void ProcessAdd(ExecutionOrder<T>& _data) { ProcessAdd(_data, ListenerFanout<Trade<T> >(service->GetListeners())); }
+    template<typename Sink>
+    void ProcessAdd(ExecutionOrder<T>& _data, Sink&& _sink);
     void ProcessRemove(ExecutionOrder<T>& _data) {} // set empty
     void ProcessUpdate(ExecutionOrder<T>& _data) {} // set empty
 };
@@ -225,10 +256,11 @@ TradeBookingToExecutionListener<T>::TradeBookingToExecutionListener(TradeBooking
 }
 
 template<typename T>
-void TradeBookingToExecutionListener<T>::ProcessAdd(ExecutionOrder<T>& _data)
+template<typename Sink>
+void TradeBookingToExecutionListener<T>::ProcessAdd(ExecutionOrder<T>& _data, Sink&& _sink)
 {
     count++;
-    T _product = _data.GetProduct();
+    const T& _product = _data.GetProduct();
     PricingSide _pricingSide = _data.GetPricingSide();
     string _orderId = _data.GetOrderId();
     double _price = _data.GetPrice();
@@ -261,8 +293,54 @@ void TradeBookingToExecutionListener<T>::ProcessAdd(ExecutionOrder<T>& _data)
     long _quantity = _visibleQuantity + _hiddenQuantity;
     
     Trade<T> _trade(_product, _orderId, _price, _book, _quantity, _side);
-    service->OnMessage(_trade);
-    service->BookTrade(_trade);
+    service->OnMessage(_trade, _sink);
+    service->BookTrade(_trade, _sink);
+}
+
+/**
+ * Trade Booking Service Listener booking every fill of a matching engine as a trade.
+ * Type T is the product type.
+ */
+template<typename T>
+class TradeBookingToFillListener : public ServiceListener<Fill<T> >
+{
+private:
+    TradeBookingService<T>* service;
+    long count;
+public:
+    TradeBookingToFillListener(TradeBookingService<T>* _service) { service = _service; count = 0; }
+    ~TradeBookingToFillListener() {} // set empty
+    void ProcessAdd(Fill<T>& _data) { ProcessAdd(_data, ListenerFanout<Trade<T> >(service->GetListeners())); }
+    template<typename Sink>
+    void ProcessAdd(Fill<T>& _data, Sink&& _sink);
+    void ProcessRemove(Fill<T>& _data) {} // set empty
+    void ProcessUpdate(Fill<T>& _data) {} // set empty
+};
+
+template<typename T>
+template<typename Sink>
+void TradeBookingToFillListener<T>::ProcessAdd(Fill<T>& _data, Sink&& _sink)
+{
+    count++;
+    // same sides and books as the booking of the execution orders
+    Side _side = _data.GetPricingSide() == BID ? SELL : BUY;
+    string _book;
+    switch (count % 3)
+    {
+        case 0:
+            _book = "TRSY1";
+            break;
+        case 1:
+            _book = "TRSY2";
+            break;
+        case 2:
+            _book = "TRSY3";
+            break;
+    }
+    
+    // a fill is booked once, the store of the trade notifies the listeners
+    Trade<T> _trade(_data.GetProduct(), _data.GetFillId(), _data.GetPrice(), _book, _data.GetQuantity(), _side);
+    service->OnMessage(_trade, _sink);
 }
 
 #endif